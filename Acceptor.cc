@@ -1,16 +1,18 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "EventLoop.h"
 
 #include <sys/types.h>    
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 
-static int CreateNonblocking()
+static int CreateNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) 
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -22,12 +24,19 @@ static int CreateNonblocking()
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , accept_socket_(CreateNonblocking())
+    , accept_socket_(CreateNonblocking(listenAddr.family()))
     , accept_channel_(loop, accept_socket_.fd())
     , listenning_(false)
 {
+    accept_channel_.set_name("acceptor");
     accept_socket_.SetReuseAddr(true);
-    accept_socket_.SetReusePort(true);
+    accept_socket_.SetReusePort(reuseport);
+
+    // 上一次运行留下的 socket 文件会导致 bind 失败，抽象地址没有文件
+    if (listenAddr.is_unix() && !listenAddr.is_abstract())
+    {
+        ::unlink(listenAddr.ToIp().c_str());
+    }
 
     // 绑定服务器端 ip:port
     accept_socket_.BindAddress(listenAddr);     
@@ -38,6 +47,21 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
 }
 
 
+Acceptor::Acceptor(EventLoop *loop, int listen_fd)
+    : loop_(loop)
+    , accept_socket_(listen_fd)
+    , accept_channel_(loop, listen_fd)
+    , listenning_(false)
+{
+    accept_channel_.set_name("acceptor");
+
+    // O_NONBLOCK 属于打开的文件，跨进程传递以后仍然保留，这里再设置一次，不依赖对方
+    int flags = ::fcntl(listen_fd, F_GETFL, 0);
+    ::fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK);
+
+    accept_channel_.set_read_callback(std::bind(&Acceptor::HandleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
     accept_channel_.DisableAll();
@@ -52,6 +76,15 @@ void Acceptor::Listen()
     accept_channel_.EnableReading(); 
 }
 
+void Acceptor::StopListening()
+{
+    if (listenning_)
+    {
+        listenning_ = false;
+        accept_channel_.DisableAll();
+    }
+}
+
 
 // 有新用户连接
 void Acceptor::HandleRead()
@@ -60,6 +93,8 @@ void Acceptor::HandleRead()
     int connfd = accept_socket_.Accept(&peer_addr);
     if (connfd >= 0)
     {
+        loop_->metrics().accepts.Increment();
+
         if (new_connection_callback_)
         {
             new_connection_callback_(connfd, peer_addr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
@@ -69,7 +104,7 @@ void Acceptor::HandleRead()
             ::close(connfd);
         }
     }
-    else
+    else if (errno != EAGAIN)     // 和别的进程共享监听 socket 时（热重启）连接可能已经被对方取走
     {
         LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
         if (errno == EMFILE)
@@ -13,6 +13,8 @@ class Acceptor : noncopyable
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经 bind 过的 fd，比如热重启时从旧进程收到的监听 socket
+    Acceptor(EventLoop *loop, int listen_fd);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback &cb) 
@@ -22,6 +24,9 @@ public:
 
     bool listenning() const { return listenning_; }
     void Listen();
+    // 不再 accept 新连接，socket 保持打开，还没 accept 的连接留在内核队列中，在 loop 线程中调用
+    void StopListening();
+    int fd() const { return accept_socket_.fd(); }
 private:
     void HandleRead();
     
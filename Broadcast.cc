@@ -0,0 +1,113 @@
+#include "Broadcast.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <functional>
+
+BroadcastGroup::BroadcastGroup()
+    : size_(0)
+{
+}
+
+BroadcastGroup::~BroadcastGroup()
+{
+}
+
+BroadcastGroup::LoopSubscribersPtr BroadcastGroup::GetLoopSubscribers(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &item : loops_)
+    {
+        if (item.first == loop)
+        {
+            return item.second;
+        }
+    }
+    LoopSubscribersPtr subscribers = std::make_shared<LoopSubscribers>();
+    loops_.push_back(std::make_pair(loop, subscribers));
+    return subscribers;
+}
+
+void BroadcastGroup::Subscribe(const TcpConnectionPtr &conn)
+{
+    EventLoop *loop = conn->loop();
+    loop->RunInLoop(std::bind(&BroadcastGroup::SubscribeInLoop, this, GetLoopSubscribers(loop), conn));
+}
+
+void BroadcastGroup::Unsubscribe(const TcpConnectionPtr &conn)
+{
+    EventLoop *loop = conn->loop();
+    loop->RunInLoop(std::bind(&BroadcastGroup::UnsubscribeInLoop, this, GetLoopSubscribers(loop), conn));
+}
+
+void BroadcastGroup::SubscribeInLoop(const LoopSubscribersPtr &subscribers, const TcpConnectionPtr &conn)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+    if (subscribers->index.insert(std::make_pair(conn.get(), subscribers->connections.size())).second)
+    {
+        subscribers->connections.push_back(conn);
+        size_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BroadcastGroup::UnsubscribeInLoop(const LoopSubscribersPtr &subscribers, const TcpConnectionPtr &conn)
+{
+    auto it = subscribers->index.find(conn.get());
+    if (it != subscribers->index.end())
+    {
+        RemoveAt(subscribers.get(), it->second);
+    }
+}
+
+// 和最后一个交换后删除，保持 connections 紧凑
+void BroadcastGroup::RemoveAt(LoopSubscribers *subscribers, size_t i)
+{
+    std::vector<TcpConnectionPtr> &connections = subscribers->connections;
+    subscribers->index.erase(connections[i].get());
+    if (i != connections.size() - 1)
+    {
+        connections[i].swap(connections.back());
+        subscribers->index[connections[i].get()] = i;
+    }
+    connections.pop_back();
+    size_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void BroadcastGroup::Broadcast(const std::string &message)
+{
+    Broadcast(std::make_shared<const std::string>(message));
+}
+
+void BroadcastGroup::Broadcast(const Payload &payload)
+{
+    std::vector<std::pair<EventLoop*, LoopSubscribersPtr>> loops;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loops = loops_;
+    }
+
+    // 每个 loop 一个任务，当前线程所在的 loop 直接执行
+    for (const auto &item : loops)
+    {
+        item.first->RunInLoop(std::bind(&BroadcastGroup::BroadcastInLoop, this, item.second, payload));
+    }
+}
+
+void BroadcastGroup::BroadcastInLoop(const LoopSubscribersPtr &subscribers, const Payload &payload)
+{
+    std::vector<TcpConnectionPtr> &connections = subscribers->connections;
+    size_t i = 0;
+    while (i < connections.size())
+    {
+        if (!connections[i]->connected())
+        {
+            RemoveAt(subscribers.get(), i);
+            continue;
+        }
+        connections[i]->Send(payload);
+        ++i;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class EventLoop;
+class TcpConnection;
+
+/**
+ * 把同一份数据发给一组连接
+ *
+ * 订阅者按所在的 loop 分组，每组只在自己的 loop 线程中访问，不需要加锁
+ * Broadcast 给每个 loop 只投递一个任务，任务持有共享的 payload，由 loop 逐个调用 Send(shared_ptr)
+ * 发不完的连接只在发送队列中保存 payload 的引用，不拷贝数据
+ * 和 TcpServer 一样，需要在所有 loop 退出之后才能析构
+ */
+class BroadcastGroup : noncopyable
+{
+public:
+    using Payload = std::shared_ptr<const std::string>;
+
+    BroadcastGroup();
+    ~BroadcastGroup();
+
+    // 可以跨线程调用，实际的增删在连接所在的 loop 中执行
+    // 断开的连接在下一次广播时自动移除
+    void Subscribe(const TcpConnectionPtr &conn);
+    void Unsubscribe(const TcpConnectionPtr &conn);
+
+    // 可以跨线程调用，同一个线程的多次广播按调用顺序到达每个订阅者
+    void Broadcast(const Payload &payload);
+    void Broadcast(const std::string &message);
+
+    // 订阅者数量，跨线程读取时只是近似值
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    // 一个 loop 上的订阅者，只在该 loop 线程中访问
+    struct LoopSubscribers
+    {
+        std::vector<TcpConnectionPtr> connections;
+        std::unordered_map<TcpConnection*, size_t> index;    // 在 connections 中的下标
+    };
+    using LoopSubscribersPtr = std::shared_ptr<LoopSubscribers>;
+
+    LoopSubscribersPtr GetLoopSubscribers(EventLoop *loop);
+    void SubscribeInLoop(const LoopSubscribersPtr &subscribers, const TcpConnectionPtr &conn);
+    void UnsubscribeInLoop(const LoopSubscribersPtr &subscribers, const TcpConnectionPtr &conn);
+    void BroadcastInLoop(const LoopSubscribersPtr &subscribers, const Payload &payload);
+    void RemoveAt(LoopSubscribers *subscribers, size_t i);
+
+    // 出现过订阅者的 loop，只增不减，数量等于 loop 数
+    std::mutex mutex_;
+    std::vector<std::pair<EventLoop*, LoopSubscribersPtr>> loops_;
+
+    std::atomic<size_t> size_;
+};
@@ -3,6 +3,11 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 /**
  * 从fd上读取数据  Poller工作在LT模式
@@ -33,7 +38,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     }
     else // extrabuf里面也写入了数据 
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable);  // writerIndex_开始写 n - writable大小的数据
     }
 
@@ -48,4 +53,192 @@ ssize_t Buffer::writeFd(int fd, int* saveErrno)
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+/**
+ * 分隔符查找，在 [begin, end) 中查找，找不到返回 nullptr
+ * x86 上按 CPU 支持情况在运行时选择 AVX2 或者 SSE2 实现，
+ * 设置环境变量 MUDUO_DISABLE_SIMD 可以强制使用标量实现
+ */ 
+namespace
+{
+
+using FindByteFunc = const char* (*)(const char*, const char*, char);
+using FindCRLFFunc = const char* (*)(const char*, const char*);
+
+const char* FindByteScalar(const char *begin, const char *end, char c)
+{
+    if (begin >= end)
+    {
+        return nullptr;
+    }
+    return static_cast<const char*>(::memchr(begin, c, end - begin));
+}
+
+const char* FindCRLFScalar(const char *begin, const char *end)
+{
+    while (begin < end)
+    {
+        const char *cr = FindByteScalar(begin, end, '\r');
+        if (cr == nullptr || cr + 1 >= end)
+        {
+            return nullptr;
+        }
+        if (cr[1] == '\n')
+        {
+            return cr;
+        }
+        begin = cr + 1;
+    }
+    return nullptr;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+const char* FindByteSse2(const char *begin, const char *end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    const char *p = begin;
+    for (; p + 16 <= end; p += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindByteScalar(p, end, c);
+}
+
+// 同时比较 p 处的 \r 和 p + 1 处的 \n，一次判断 16 个位置
+const char* FindCRLFSse2(const char *begin, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    for (; p + 17 <= end; p += 16)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        __m128i match = _mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(second, lf));
+        int mask = _mm_movemask_epi8(match);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* FindByteAvx2(const char *begin, const char *end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    const char *p = begin;
+    for (; p + 32 <= end; p += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindByteSse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* FindCRLFAvx2(const char *begin, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for (; p + 33 <= end; p += 32)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(second, lf));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFSse2(p, end);
+}
+
+#endif
+
+struct ScanFunctions
+{
+    FindByteFunc find_byte;
+    FindCRLFFunc find_crlf;
+};
+
+ScanFunctions SelectScanFunctions()
+{
+    ScanFunctions functions = {FindByteScalar, FindCRLFScalar};
+    if (::getenv("MUDUO_DISABLE_SIMD"))
+    {
+        return functions;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        functions.find_byte = FindByteAvx2;
+        functions.find_crlf = FindCRLFAvx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        functions.find_byte = FindByteSse2;
+        functions.find_crlf = FindCRLFSse2;
+    }
+#endif
+    return functions;
+}
+
+// 局部静态变量，保证在其它翻译单元的静态初始化中使用 Buffer 也是安全的
+const ScanFunctions& Scan()
+{
+    static const ScanFunctions functions = SelectScanFunctions();
+    return functions;
+}
+
+}
+
+const char* Buffer::findCRLF(const char *start) const
+{
+    return Scan().find_crlf(start, beginWrite());
+}
+
+const char* Buffer::findCRLF(size_t *scan_offset) const
+{
+    const char *crlf = Scan().find_crlf(peek() + *scan_offset, beginWrite());
+    if (crlf == nullptr)
+    {
+        // 最后一个字节可能是 \r，下次从它开始
+        size_t readable = readableBytes();
+        if (readable > *scan_offset + 1)
+        {
+            *scan_offset = readable - 1;
+        }
+    }
+    return crlf;
+}
+
+const char* Buffer::find(char c, const char *start) const
+{
+    return Scan().find_byte(start, beginWrite(), c);
+}
+
+const char* Buffer::find(char c, size_t *scan_offset) const
+{
+    const char *found = Scan().find_byte(peek() + *scan_offset, beginWrite(), c);
+    if (found == nullptr)
+    {
+        *scan_offset = readableBytes();
+    }
+    return found;
+}
@@ -3,6 +3,9 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
 
 // 网络库底层的缓冲器类型定义
 class Buffer
@@ -11,8 +14,9 @@ public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
 
+    // initialSize 为 0 时不预先分配内存，第一次写入时才分配，用于大量空闲连接的场景
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : buffer_(initialSize == 0 ? 0 : kCheapPrepend + initialSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
     {}
@@ -24,7 +28,7 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0;
     }
 
     size_t prependableBytes() const
@@ -38,6 +42,42 @@ public:
         return begin() + readerIndex_;
     }
 
+    /**
+     * 在可读数据中查找分隔符，找到返回指向分隔符的指针（\r\n 指向 \r），找不到返回 nullptr
+     * 按 CPU 支持的指令集在运行时选择 AVX2/SSE2 实现，其它平台使用标量实现
+     */ 
+    const char* findCRLF() const
+    {
+        return findCRLF(peek());
+    }
+    const char* findCRLF(const char *start) const;
+
+    // 可以断点续扫的版本：从 peek() + *scan_offset 开始查找，找不到时把 *scan_offset
+    // 更新为下次应该开始的位置，更多数据到达以后已经检查过的字节不会再被扫描
+    // retrieve 之后偏移失效，需要调用者重置为 0
+    const char* findCRLF(size_t *scan_offset) const;
+
+    // 查找 \n
+    const char* findEOL() const
+    {
+        return find('\n');
+    }
+    const char* findEOL(const char *start) const
+    {
+        return find('\n', start);
+    }
+    const char* findEOL(size_t *scan_offset) const
+    {
+        return find('\n', scan_offset);
+    }
+
+    const char* find(char c) const
+    {
+        return find(c, peek());
+    }
+    const char* find(char c, const char *start) const;
+    const char* find(char c, size_t *scan_offset) const;
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
@@ -56,6 +96,16 @@ public:
         readerIndex_ = writerIndex_ = kCheapPrepend;
     }
 
+    void retrieveUntil(const char *end)
+    {
+        retrieve(end - peek());
+    }
+
+    void retrieveInt32()
+    {
+        retrieve(sizeof(int32_t));
+    }
+
     // 把onMessage函数上报的Buffer数据，转成string类型的数据返回
     std::string retrieveAllAsString()
     {
@@ -86,6 +136,64 @@ public:
         writerIndex_ += len;
     }
 
+    void append(const void *data, size_t len)
+    {
+        append(static_cast<const char*>(data), len);
+    }
+
+    // 以网络字节序追加一个 int32
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(x)));
+        append(&be32, sizeof be32);
+    }
+
+    // 读取开头的 int32（网络字节序转成主机字节序），要求 readableBytes() >= 4
+    int32_t peekInt32() const
+    {
+        int32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return static_cast<int32_t>(be32toh(static_cast<uint32_t>(be32)));
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieveInt32();
+        return result;
+    }
+
+    // 把数据放到可读数据的前面，使用 kCheapPrepend 预留的空间，不需要移动已有数据
+    void prepend(const void *data, size_t len)
+    {
+        if (buffer_.empty())
+        {
+            buffer_.resize(kCheapPrepend);
+        }
+        if (len > prependableBytes())
+        {
+            // 前面的空间不够，把可读的数据往后移，腾出 len 字节，再留出 kCheapPrepend 给之后的 prepend
+            size_t readable = readableBytes();
+            size_t reader = len + kCheapPrepend;
+            if (buffer_.size() < reader + readable)
+            {
+                buffer_.resize(reader + readable);
+            }
+            std::copy_backward(begin() + readerIndex_, begin() + writerIndex_, begin() + reader + readable);
+            readerIndex_ = reader;
+            writerIndex_ = reader + readable;
+        }
+        readerIndex_ -= len;
+        const char *d = static_cast<const char*>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(x)));
+        prepend(&be32, sizeof be32);
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -96,6 +204,12 @@ public:
         return begin() + writerIndex_;
     }
 
+    // 直接写到 beginWrite() 以后提交写入的长度，调用前先 ensureWriteableBytes
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int* saveErrno);
     // 通过fd发送数据
@@ -103,12 +217,11 @@ public:
 private:
     char* begin()
     {
-        // it.operator*()
-        return &*buffer_.begin();  // vector底层数组首元素的地址，也就是数组的起始地址
+        return buffer_.data();  // vector底层数组首元素的地址，也就是数组的起始地址，还没有分配时为空
     }
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
     void makeSpace(size_t len)
     {
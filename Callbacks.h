@@ -6,6 +6,9 @@
 class Buffer;
 class TcpConnection;
 class Timestamp;
+class UdpChannel;
+class ShmConnection;
+struct UdpDatagram;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void (const TcpConnectionPtr&)>;
@@ -14,4 +17,16 @@ using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                         Buffer*,
                                         Timestamp)>;
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using TimerCallback = std::function<void()>;
+// 一批收到的数据报，datagrams 只在回调期间有效
+using UdpBatchCallback = std::function<void (UdpChannel*,
+                                        const UdpDatagram*,
+                                        size_t,
+                                        Timestamp)>;
+
+using ShmConnectionPtr = std::shared_ptr<ShmConnection>;
+using ShmConnectionCallback = std::function<void (const ShmConnectionPtr&)>;
+using ShmMessageCallback = std::function<void (const ShmConnectionPtr&,
+                                        Buffer*,
+                                        Timestamp)>;
@@ -9,7 +9,7 @@ const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
 
 Channel::Channel(EventLoop *loop, int fd)
-    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false)
+    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), name_(nullptr), name_provider_(nullptr), tied_(false)
 {}
 
 
@@ -26,6 +26,15 @@ void Channel::tie(const std::shared_ptr<void> &obj)
 }
 
 
+std::string Channel::DescribeOwner(const void *owner) const
+{
+    if (name_provider_ && owner)
+    {
+        return name_provider_(owner);
+    }
+    return name_ ? name_ : "";
+}
+
 // 当改变 channel 所表示 fd 的 events 事件后, 
 // Update 负责在 poller 里面更改 fd 相应的事件 epoll_ctl
 void Channel::Update()
@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 class EventLoop;
 
@@ -17,6 +18,8 @@ class Channel : noncopyable
 public:
     using EventCallback = std::function<void()>;
     using ReadEventCallback = std::function<void(Timestamp)>;
+    // 由 tie 的对象生成名字（比如连接名），owner 是 tie 的对象
+    using NameProvider = std::string (*)(const void *owner);
 
     Channel(EventLoop *loop, int fd);
     ~Channel();
@@ -33,6 +36,16 @@ public:
     // channel 还在执行回调操作
     void tie(const std::shared_ptr<void>&);
 
+    // 用于慢回调记录和 watchdog 输出的标签，必须是字符串常量
+    // watchdog 线程会不加锁地读取，此时 Channel 和它的所有者可能已经析构，不能指向连接名之类的动态字符串
+    void set_name(const char *name) { name_ = name; }
+    const char* name() const { return name_; }
+    // 慢回调记录中的名字按需生成，只在 loop 线程的慢路径上调用，避免每个连接保存一份名字
+    void set_name_provider(NameProvider provider) { name_provider_ = provider; }
+    // 持有 TiedOwner() 返回的对象期间 Channel 一定活着，可以调用 DescribeOwner
+    std::shared_ptr<void> TiedOwner() const { return tied_ ? tie_.lock() : std::shared_ptr<void>(); }
+    std::string DescribeOwner(const void *owner) const;
+
     int fd() const { return fd_; }
     int events() const { return events_; }
     void set_revents(int revt) { revents_ = revt; }
@@ -53,6 +66,8 @@ public:
     void set_index(int idx) { index_ = idx; }
 
     EventLoop* OwnerLoop() { return loop_; }
+    // 把 channel 交给另一个 loop，只能在 channel 已经 Remove、不在任何 poller 中时调用
+    void set_owner_loop(EventLoop *loop) { loop_ = loop; }
     void Remove();
 private:
 
@@ -68,6 +83,8 @@ private:
     int events_;    // 注册 fd 感兴趣的事件
     int revents_;   // poller 返回的具体发生的事件
     int index_;
+    const char *name_;
+    NameProvider name_provider_;
 
     std::weak_ptr<void> tie_;
     bool tied_;
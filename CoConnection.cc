@@ -0,0 +1,263 @@
+#include "CoConnection.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+// 每个线程按大小分级的空闲协程帧链表
+struct FreeFrame
+{
+    FreeFrame *next;
+};
+
+struct FreeList
+{
+    FreeFrame *head = nullptr;
+    size_t count = 0;
+};
+
+thread_local FreeList t_free_lists[CoFramePool::kMaxPooledSize / CoFramePool::kGranularity];
+
+size_t SizeClass(size_t size)
+{
+    return (size + CoFramePool::kGranularity - 1) / CoFramePool::kGranularity - 1;
+}
+
+}
+
+const size_t CoFramePool::kGranularity;
+const size_t CoFramePool::kMaxPooledSize;
+const size_t CoFramePool::kMaxCachedPerClass;
+
+void* CoFramePool::Allocate(size_t size)
+{
+    if (size > kMaxPooledSize)
+    {
+        return ::operator new(size);
+    }
+
+    FreeList &list = t_free_lists[SizeClass(size)];
+    if (list.head != nullptr)
+    {
+        FreeFrame *frame = list.head;
+        list.head = frame->next;
+        --list.count;
+        return frame;
+    }
+    return ::operator new((SizeClass(size) + 1) * kGranularity);
+}
+
+void CoFramePool::Deallocate(void *ptr, size_t size)
+{
+    if (size > kMaxPooledSize)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FreeList &list = t_free_lists[SizeClass(size)];
+    if (list.count >= kMaxCachedPerClass)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeFrame *frame = static_cast<FreeFrame*>(ptr);
+    frame->next = list.head;
+    list.head = frame;
+    ++list.count;
+}
+
+CoConnection::CoConnection(const TcpConnectionPtr &conn)
+    : conn_(conn)
+    , closed_(false)
+    , scan_offset_(0)
+{
+}
+
+bool CoConnection::TryRead(ReadAwaiter *awaiter)
+{
+    Buffer *buf = conn_->input_buffer();
+    if (awaiter->delimiter_.empty())
+    {
+        if (buf->readableBytes() >= awaiter->n_)
+        {
+            awaiter->out_->assign(buf->peek(), awaiter->n_);
+            buf->retrieve(awaiter->n_);
+            awaiter->ok_ = true;
+            return true;
+        }
+    }
+    else
+    {
+        const std::string &delimiter = awaiter->delimiter_;
+        const char *found = nullptr;
+        if (delimiter == "\r\n")
+        {
+            found = buf->findCRLF(&scan_offset_);
+        }
+        else
+        {
+            const char *end = buf->beginWrite();
+            const char *pos = std::search(buf->peek() + scan_offset_, end, delimiter.begin(), delimiter.end());
+            if (pos != end)
+            {
+                found = pos;
+            }
+            else if (buf->readableBytes() >= delimiter.size())
+            {
+                // 分隔符可能跨越两次到达的数据
+                scan_offset_ = buf->readableBytes() - delimiter.size() + 1;
+            }
+        }
+
+        if (found != nullptr)
+        {
+            awaiter->out_->assign(buf->peek(), found);
+            buf->retrieveUntil(found + delimiter.size());
+            scan_offset_ = 0;
+            awaiter->ok_ = true;
+            return true;
+        }
+    }
+
+    if (closed_)
+    {
+        awaiter->ok_ = false;
+        return true;
+    }
+    return false;
+}
+
+void CoConnection::Suspend(Waiter *waiter, std::coroutine_handle<> handle, void *awaiter)
+{
+    waiter->awaiter = awaiter;
+    waiter->handle = handle;
+}
+
+void CoConnection::StartWrite(WriteAwaiter *awaiter, std::coroutine_handle<> handle)
+{
+    Suspend(&writer_, handle, awaiter);
+    // 写完以后 TcpConnection 会把 WriteCompleteCallback 放进 loop 的队列，不会在这里重入
+    if (awaiter->buf_ != nullptr)
+    {
+        conn_->Send(awaiter->buf_);
+    }
+    else
+    {
+        conn_->Send(*awaiter->data_);
+    }
+}
+
+void CoConnection::Resume(Waiter *waiter)
+{
+    std::coroutine_handle<> handle = waiter->handle;
+    waiter->awaiter = nullptr;
+    waiter->handle = nullptr;
+    handle.resume();
+}
+
+void CoConnection::OnMessage()
+{
+    if (reader_.awaiter != nullptr && TryRead(static_cast<ReadAwaiter*>(reader_.awaiter)))
+    {
+        Resume(&reader_);
+    }
+}
+
+void CoConnection::OnWriteComplete()
+{
+    if (writer_.awaiter != nullptr)
+    {
+        static_cast<WriteAwaiter*>(writer_.awaiter)->ok_ = true;
+        Resume(&writer_);
+    }
+}
+
+void CoConnection::OnClose()
+{
+    closed_ = true;
+    if (writer_.awaiter != nullptr)
+    {
+        static_cast<WriteAwaiter*>(writer_.awaiter)->ok_ = false;
+        Resume(&writer_);
+    }
+    if (reader_.awaiter != nullptr && TryRead(static_cast<ReadAwaiter*>(reader_.awaiter)))
+    {
+        Resume(&reader_);
+    }
+}
+
+CoServer::CoServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            TcpServer::Option option)
+    : server_(loop, listen_addr, name, option)
+{
+    server_.set_connection_callback(
+        std::bind(&CoServer::OnConnection, this, std::placeholders::_1)
+    );
+    server_.set_message_callback(
+        std::bind(&CoServer::OnMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+    );
+    server_.set_write_complete_callback(
+        std::bind(&CoServer::OnWriteComplete, this, std::placeholders::_1)
+    );
+}
+
+Task<> CoServer::Run(CoConnectionPtr conn)
+{
+    co_await handler_(conn);
+    if (!conn->closed())
+    {
+        conn->Shutdown();
+    }
+}
+
+void CoServer::OnConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        CoConnectionPtr co_conn = std::make_shared<CoConnection>(conn);
+        conn->set_context(co_conn);
+        if (handler_)
+        {
+            CoSpawn(Run(co_conn));
+        }
+        else
+        {
+            conn->Shutdown();
+        }
+    }
+    else
+    {
+        CoConnectionPtr co_conn = std::static_pointer_cast<CoConnection>(conn->context());
+        // 断开引用环：TcpConnection -> context -> CoConnection -> TcpConnection
+        conn->set_context(std::shared_ptr<void>());
+        if (co_conn)
+        {
+            co_conn->OnClose();
+        }
+    }
+}
+
+void CoServer::OnMessage(const TcpConnectionPtr &conn, Buffer*, Timestamp)
+{
+    CoConnectionPtr co_conn = std::static_pointer_cast<CoConnection>(conn->context());
+    if (co_conn)
+    {
+        co_conn->OnMessage();
+    }
+}
+
+void CoServer::OnWriteComplete(const TcpConnectionPtr &conn)
+{
+    CoConnectionPtr co_conn = std::static_pointer_cast<CoConnection>(conn->context());
+    if (co_conn)
+    {
+        co_conn->OnWriteComplete();
+    }
+}
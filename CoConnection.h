@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Coroutine.h"
+#include "TcpServer.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "noncopyable.h"
+
+#include <string>
+#include <memory>
+#include <functional>
+
+/**
+ * 用协程读写 TcpConnection，所有操作都在连接所在的 loop 线程中执行和恢复
+ *
+ *   std::string line;
+ *   while (co_await conn->ReadUntil("\r\n", &line))
+ *   {
+ *       co_await conn->Write(line + "\r\n");
+ *   }
+ *
+ * 读操作在数据足够时不挂起，否则等 MessageCallback 收到数据以后在回调中直接恢复
+ * 写操作等数据全部交给内核（WriteCompleteCallback）以后恢复，天然有背压
+ * 连接断开时挂起的读写返回 false
+ */ 
+class CoConnection : noncopyable
+{
+public:
+    explicit CoConnection(const TcpConnectionPtr &conn);
+
+    const TcpConnectionPtr& connection() const { return conn_; }
+    EventLoop* loop() const { return conn_->loop(); }
+    bool closed() const { return closed_; }
+
+    class ReadAwaiter
+    {
+    public:
+        ReadAwaiter(CoConnection *conn, size_t n, std::string delimiter, std::string *out)
+            : conn_(conn), n_(n), delimiter_(std::move(delimiter)), out_(out), ok_(false)
+        {}
+
+        bool await_ready() { return conn_->TryRead(this); }
+        void await_suspend(std::coroutine_handle<> handle) { conn_->Suspend(&conn_->reader_, handle, this); }
+        bool await_resume() const { return ok_; }
+    private:
+        friend class CoConnection;
+
+        CoConnection *conn_;
+        size_t n_;                  // ReadExactly 的长度
+        std::string delimiter_;     // ReadUntil 的分隔符，为空时按长度读
+        std::string *out_;
+        bool ok_;
+    };
+
+    class WriteAwaiter
+    {
+    public:
+        WriteAwaiter(CoConnection *conn, const std::string *data, Buffer *buf)
+            : conn_(conn), data_(data), buf_(buf), ok_(false)
+        {}
+
+        bool await_ready() { ok_ = false; return conn_->closed(); }
+        void await_suspend(std::coroutine_handle<> handle) { conn_->StartWrite(this, handle); }
+        bool await_resume() const { return ok_; }
+    private:
+        friend class CoConnection;
+
+        CoConnection *conn_;
+        const std::string *data_;
+        Buffer *buf_;
+        bool ok_;
+    };
+
+    // 读 n 个字节到 *out
+    ReadAwaiter ReadExactly(size_t n, std::string *out) { return ReadAwaiter(this, n, std::string(), out); }
+    // 读到 delimiter 为止，*out 中不包含 delimiter
+    ReadAwaiter ReadUntil(const std::string &delimiter, std::string *out) { return ReadAwaiter(this, 0, delimiter, out); }
+    // 数据在 co_await 表达式中拷贝进输出缓冲区，之后就可以释放
+    WriteAwaiter Write(const std::string &data) { return WriteAwaiter(this, &data, nullptr); }
+    WriteAwaiter Write(Buffer *buf) { return WriteAwaiter(this, nullptr, buf); }
+    void Shutdown() { conn_->Shutdown(); }
+
+    // 以下由 CoServer 在 loop 线程中调用
+    void OnMessage();
+    void OnWriteComplete();
+    void OnClose();
+private:
+    struct Waiter
+    {
+        Waiter()
+            : awaiter(nullptr)
+        {}
+
+        void *awaiter;
+        std::coroutine_handle<> handle;
+    };
+
+    bool TryRead(ReadAwaiter *awaiter);
+    void Suspend(Waiter *waiter, std::coroutine_handle<> handle, void *awaiter);
+    void StartWrite(WriteAwaiter *awaiter, std::coroutine_handle<> handle);
+    static void Resume(Waiter *waiter);
+
+    TcpConnectionPtr conn_;
+    bool closed_;
+    size_t scan_offset_;        // ReadUntil 已经扫描过的位置
+    Waiter reader_;
+    Waiter writer_;
+};
+
+using CoConnectionPtr = std::shared_ptr<CoConnection>;
+
+/**
+ * 每个连接运行一个协程的服务器，handler 返回时关闭连接
+ */ 
+class CoServer : noncopyable
+{
+public:
+    using Handler = std::function<Task<> (CoConnectionPtr)>;
+
+    CoServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            TcpServer::Option option = TcpServer::kNoReusePort);
+
+    void set_handler(const Handler &handler) { handler_ = handler; }
+    void SetThreadNum(int num_threads) { server_.SetThreadNum(num_threads); }
+
+    // 需要设置空闲超时、统计等选项时直接使用底层的 TcpServer
+    TcpServer* server() { return &server_; }
+
+    void Start() { server_.Start(); }
+private:
+    void OnConnection(const TcpConnectionPtr &conn);
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    void OnWriteComplete(const TcpConnectionPtr &conn);
+    Task<> Run(CoConnectionPtr conn);
+
+    TcpServer server_;
+    Handler handler_;
+};
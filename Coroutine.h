@@ -0,0 +1,178 @@
+#pragma once
+
+/**
+ * C++20 协程支持，只在可选的 simple_muduo_coro 库中编译
+ *
+ * Task<T> 是惰性启动的协程，被 co_await 时才开始执行，结束时直接切回等待它的协程（对称转移）
+ * CoSpawn 启动一个顶层协程，执行完自动释放
+ * 协程帧从线程局部的空闲链表中分配，协程都在 loop 线程中创建和恢复，不需要加锁
+ */
+#include "EventLoop.h"
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <type_traits>
+#include <stddef.h>
+
+// 按 64 字节分级缓存协程帧，超过 kMaxPooledSize 的直接使用 operator new
+class CoFramePool
+{
+public:
+    static const size_t kGranularity = 64;
+    static const size_t kMaxPooledSize = 2048;
+    static const size_t kMaxCachedPerClass = 256;
+
+    static void* Allocate(size_t size);
+    static void Deallocate(void *ptr, size_t size);
+};
+
+struct CoPooledFrame
+{
+    static void* operator new(size_t size) { return CoFramePool::Allocate(size); }
+    static void operator delete(void *ptr, size_t size) { CoFramePool::Deallocate(ptr, size); }
+};
+
+struct CoPromiseBase : CoPooledFrame
+{
+    // 结束时切回等待者，没有等待者时停在终点，由 Task 析构时释放
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    // 和库的其它部分一样不使用异常
+    void unhandled_exception() { std::terminate(); }
+
+    std::coroutine_handle<> continuation;
+};
+
+template <typename T>
+struct CoPromise : CoPromiseBase
+{
+    template <typename U>
+    void return_value(U &&value) { result = std::forward<U>(value); }
+
+    T result{};
+};
+
+template <>
+struct CoPromise<void> : CoPromiseBase
+{
+    void return_void() {}
+};
+
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : CoPromise<T>
+    {
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Task(Task &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume()
+    {
+        if constexpr (!std::is_void<T>::value)
+        {
+            return std::move(handle_.promise().result);
+        }
+    }
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle_(handle)
+    {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// 立即开始执行、结束后自动释放的顶层协程
+struct CoDetached
+{
+    struct promise_type : CoPooledFrame
+    {
+        CoDetached get_return_object() { return CoDetached(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+inline CoDetached CoRunDetached(Task<> task)
+{
+    co_await task;
+}
+
+// 在当前线程中开始执行 task，直到它第一次挂起
+inline void CoSpawn(Task<> task)
+{
+    CoRunDetached(std::move(task));
+}
+
+/**
+ * co_await SleepFor(loop, ms)：由 loop 的定时器恢复，在 loop 线程中使用
+ * 协程类型不能出现在 C++11 编译的 EventLoop 里，所以是自由函数而不是 EventLoop 的成员
+ */
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(EventLoop *loop, int milliseconds)
+        : loop_(loop)
+        , milliseconds_(milliseconds)
+    {}
+
+    bool await_ready() const noexcept { return milliseconds_ <= 0; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        loop_->RunAfter(milliseconds_ / 1000.0, [handle]() { handle.resume(); });
+    }
+
+    void await_resume() noexcept {}
+private:
+    EventLoop *loop_;
+    int milliseconds_;
+};
+
+inline SleepAwaiter SleepFor(EventLoop *loop, int milliseconds)
+{
+    return SleepAwaiter(loop, milliseconds);
+}
+
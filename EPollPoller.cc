@@ -1,6 +1,7 @@
 #include "EPollPoller.h"
 #include "Logger.h"
 #include "Channel.h"
+#include "EventLoop.h"
 
 #include <errno.h>
 #include <unistd.h>
@@ -33,7 +34,11 @@ EPollPoller::~EPollPoller()
 
 Timestamp EPollPoller::Poll(int timeout_ms, ChannelList *active_channels)
 {
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    // 自旋时 timeout_ms 为 0，每秒调用上百万次，不输出日志
+    if (timeout_ms != 0)
+    {
+        LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    }
 
     int num_events = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeout_ms);
     int save_errno = errno;
@@ -80,6 +85,13 @@ void EPollPoller::UpdateChannel(Channel *channel)
             channels_[fd] = channel;
         }
 
+        // 没有关心的事件时不注册，否则 epoll 仍然会报告 EPOLLHUP/EPOLLERR
+        if (channel->IsNoneEvent())
+        {
+            channel->set_index(kDeleted);
+            return;
+        }
+
         channel->set_index(kAdded);
         Update(EPOLL_CTL_ADD, channel);
     }
@@ -140,6 +152,8 @@ void EPollPoller::Update(int operation, Channel *channel)
     event.events = channel->events();
     event.data.fd = fd; 
     event.data.ptr = channel;
+
+    owner_loop_->metrics().epoll_ctl_calls.Increment();
     
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
@@ -1,13 +1,16 @@
 #include "EventLoop.h"
+#include "Slab.h"
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <string.h>
 
 // 防止一个线程创建多个 EventLoop
 __thread EventLoop *t_loopInThisThread = nullptr;
@@ -15,6 +18,11 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 // 定义默认的 Poller IO 复用接口的超时时间
 const int kPollTimeMs = 10000;
 
+// pending functor 没有对应的 fd 和连接名
+static const char kFunctorName[] = "pending functor";
+static const char kAfterDispatchName[] = "after dispatch";
+static const char kIdleName[] = "idle functor";
+
 // 创建 wakeup fd，用来 notify 唤醒 SubReactor 处理新来的 channel
 int CreateEventfd()
 {
@@ -33,8 +41,26 @@ EventLoop::EventLoop()
     , calling_pending_functors_(false)
     , thread_id_(CurrentThread::tid())
     , poller_(Poller::NewDefaultPoller(this))
+    , timer_queue_(new TimerQueue(this))
+    , slab_(new LoopSlab(thread_id_))
     , wakeup_fd_(CreateEventfd())
     , wakeup_channel_(new Channel(this, wakeup_fd_))    // 新建一个 Channel，用于唤醒当前的 EventLoop
+    , functors_pending_(false)
+    , poll_policy_(kBlockingPoll)
+    , spin_us_(kDefaultSpinMicros)
+    , spinning_(false)
+    , next_functor_(0)
+    , functor_budget_count_(0)
+    , functor_budget_us_(0)
+    , idle_pending_(false)
+    , pending_since_us_(0)
+    , slow_callback_threshold_us_(0)
+    , next_slow_callback_(0)
+    , activity_seq_(0)
+    , activity_iteration_start_us_(0)
+    , activity_callback_start_us_(0)
+    , activity_fd_(-1)
+    , activity_name_(nullptr)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, thread_id_);
     if (t_loopInThisThread)
@@ -46,6 +72,7 @@ EventLoop::EventLoop()
         t_loopInThisThread = this;
     }
 
+    wakeup_channel_->set_name("wakeup");
     wakeup_channel_->set_read_callback(std::bind(&EventLoop::HandleRead, this));
 
     // 每一个 eventloop 都将监听 wakeup_channel的 EPOLLIN 读事件
@@ -57,6 +84,7 @@ EventLoop::~EventLoop()
     wakeup_channel_->DisableAll();
     wakeup_channel_->Remove();
     ::close(wakeup_fd_);
+    slab_->Release();
     t_loopInThisThread = nullptr;
 }
 
@@ -72,16 +100,49 @@ void EventLoop::Loop()
         active_channels_.clear();
 
         // 监听两类 fd: client的fd、wakeup_fd
-        poll_return_time_ = poller_->Poll(kPollTimeMs, &active_channels_);
+        PollForEvents();
+
+        int64_t iteration_start = MonotonicMicros();
+        activity_iteration_start_us_.store(iteration_start, std::memory_order_relaxed);
+        metrics_.loop_iterations.Increment();
+        metrics_.poll_events.Add(active_channels_.size());
+        metrics_.events_per_poll.Record(active_channels_.size());
+
+        int64_t callback_start = iteration_start;
         for (Channel *channel : active_channels_)
         {
+            int fd = channel->fd();
+            const char *name = channel->name();
+            BeginCallback(fd, name, callback_start);
+
+            // 开启了慢回调记录时先持有 tie 的对象，回调结束以后 Channel 还活着，可以生成连接名
+            std::shared_ptr<void> owner;
+            if (slow_callback_threshold_us_.load(std::memory_order_relaxed) > 0)
+            {
+                owner = channel->TiedOwner();
+            }
+
             // Poller 监听到哪些 Channel 有发生事件
             // 然后上报给 EventLoop，通知 Channel 处理相应的事件
             channel->HandleEvent(poll_return_time_);
+
+            int64_t callback_end = MonotonicMicros();
+            metrics_.callback_us.Record(callback_end - callback_start);
+            if (IsSlowCallback(callback_end - callback_start))
+            {
+                // 没有 tie 的 Channel 回调结束以后可能已经析构，只用回调之前取出的标签
+                RecordSlowCallback(fd, owner ? channel->DescribeOwner(owner.get()) : std::string(name ? name : ""),
+                    callback_end - callback_start);
+            }
+            callback_start = callback_end;
         }
 
         // 执行当前 EventLoop 事件循环需要处理的回调操作 
         DoPendingFunctors();
+        DoAfterDispatchFunctors();
+
+        metrics_.iteration_us.Record(MonotonicMicros() - iteration_start);
+        activity_iteration_start_us_.store(0, std::memory_order_relaxed);
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -121,11 +182,18 @@ void EventLoop::QueueInLoop(Functor cb)
 {
     {
         std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_functors_.empty())
+        {
+            pending_since_us_ = MonotonicMicros();
+        }
         pending_functors_.emplace_back(cb);
+        functors_pending_ = true;
     }
 
     // || calling_pending_functors_：当前 loop 正在执行回调，但是 loop 又有了新的回调
-    if (!IsInLoopThread() || calling_pending_functors_) 
+    // loop 正在自旋时会自己发现新的回调，省掉一次 eventfd 写
+    // functors_pending_ 和 spinning_ 都是 seq_cst，与 PollForEvents 中的顺序配合，保证两边至少有一边看到对方
+    if ((!IsInLoopThread() || calling_pending_functors_) && !spinning_)
     {
         Wakeup();
     }
@@ -154,6 +222,28 @@ void EventLoop::Wakeup()
     }
 }
 
+TimerId EventLoop::RunAt(Timestamp time, TimerCallback cb)
+{
+    return timer_queue_->AddTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::RunAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(AddTime(Timestamp::Now(), delay));
+    return RunAt(time, std::move(cb));
+}
+
+TimerId EventLoop::RunEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(AddTime(Timestamp::Now(), interval));
+    return timer_queue_->AddTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::Cancel(TimerId timer_id)
+{
+    timer_queue_->Cancel(timer_id);
+}
+
 void EventLoop::UpdateChannel(Channel *channel)
 {
     poller_->UpdateChannel(channel);
@@ -169,20 +259,305 @@ bool EventLoop::HasChannel(Channel *channel)
     return poller_->HasChannel(channel);
 }
 
+void EventLoop::QueueIdle(Functor cb)
+{
+    bool was_empty = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        was_empty = idle_functors_.empty();
+        idle_functors_.push_back(std::move(cb));
+        idle_pending_ = true;
+    }
+
+    // loop 可能阻塞在 epoll_wait 中，只有第一个空闲任务需要唤醒；loop 线程阻塞之前自己会检查
+    if (was_empty && !IsInLoopThread() && !spinning_)
+    {
+        Wakeup();
+    }
+}
+
 void EventLoop::DoPendingFunctors() 
 {
-    std::vector<Functor> functors;
     calling_pending_functors_ = true;
 
+    // 上一轮剩下的执行完以后才取新的，保证先入队的先执行
+    if (!HasDeferredFunctors())
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pending_functors_);
+        running_functors_.clear();
+        next_functor_ = 0;
+
+        int64_t pending_since = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            running_functors_.swap(pending_functors_);
+            functors_pending_ = false;
+            pending_since = pending_since_us_;
+        }
+
+        if (!running_functors_.empty())
+        {
+            metrics_.queue_depth.Record(running_functors_.size());
+            metrics_.queue_wait_us.Record(MonotonicMicros() - pending_since);
+        }
     }
 
-    for (const Functor &functor : functors)
+    if (HasDeferredFunctors())
     {
-        functor();
+        size_t max_functors = functor_budget_count_.load(std::memory_order_relaxed);
+        int64_t max_us = functor_budget_us_.load(std::memory_order_relaxed);
+
+        int64_t pass_start = MonotonicMicros();
+        int64_t callback_start = pass_start;
+        size_t count = 0;
+        while (HasDeferredFunctors())
+        {
+            if (count > 0 && ((max_functors > 0 && count >= max_functors) ||
+                              (max_us > 0 && callback_start - pass_start >= max_us)))
+            {
+                metrics_.functor_budget_exhausted.Increment();
+                break;
+            }
+
+            // 执行完马上析构，不让捕获的连接等到整批结束才释放
+            Functor functor(std::move(running_functors_[next_functor_++]));
+            BeginCallback(-1, kFunctorName, callback_start);
+            functor();
+
+            int64_t callback_end = MonotonicMicros();
+            EndCallback(-1, kFunctorName, callback_start, callback_end);
+            callback_start = callback_end;
+            ++count;
+        }
+        metrics_.functors_run.Add(count);
+
+        if (!HasDeferredFunctors())
+        {
+            running_functors_.clear();
+            next_functor_ = 0;
+        }
     }
 
     calling_pending_functors_ = false;
-}
\ No newline at end of file
+}
+
+void EventLoop::RunIdleFunctors()
+{
+    int64_t slice_start = MonotonicMicros();
+    int64_t callback_start = slice_start;
+    // 让 watchdog 能看到卡住的空闲任务
+    activity_iteration_start_us_.store(slice_start, std::memory_order_relaxed);
+
+    while (callback_start - slice_start < kIdleSliceMicros)
+    {
+        Functor functor;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (idle_functors_.empty())
+            {
+                break;
+            }
+            functor = std::move(idle_functors_.front());
+            idle_functors_.pop_front();
+            idle_pending_ = !idle_functors_.empty();
+        }
+
+        BeginCallback(-1, kIdleName, callback_start);
+        functor();
+
+        int64_t callback_end = MonotonicMicros();
+        EndCallback(-1, kIdleName, callback_start, callback_end);
+        callback_start = callback_end;
+        metrics_.idle_functors_run.Increment();
+    }
+
+    activity_iteration_start_us_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * 按 poll_policy_ 等待事件
+ * 自旋期间 spinning_ 为 true，其它线程只入队不唤醒，所以停止自旋以后要先清掉 spinning_，
+ * 再检查一次 functors_pending_，都为空才能阻塞
+ * 上一轮还有没执行完的 functor 时不阻塞；本来要阻塞时先执行一段空闲任务，下一轮再检查事件
+ */
+void EventLoop::PollForEvents()
+{
+    if (HasDeferredFunctors())
+    {
+        poll_return_time_ = poller_->Poll(0, &active_channels_);
+        return;
+    }
+
+    PollPolicy policy = poll_policy_.load(std::memory_order_relaxed);
+    if (policy == kBlockingPoll)
+    {
+        // after dispatch 回调（比如 auto-cork 的 FlushCorked）在 loop 线程中 QueueInLoop 不会写 eventfd，
+        // 这时阻塞的话 functor 要等到下一个事件或者超时才执行
+        if (functors_pending_ || idle_pending_)
+        {
+            poll_return_time_ = poller_->Poll(0, &active_channels_);
+            if (active_channels_.empty() && !functors_pending_)
+            {
+                RunIdleFunctors();
+            }
+            return;
+        }
+        poll_return_time_ = poller_->Poll(kPollTimeMs, &active_channels_);
+        return;
+    }
+
+    int64_t spin_deadline = MonotonicMicros() + spin_us_.load(std::memory_order_relaxed);
+    spinning_ = true;
+    while (true)
+    {
+        poll_return_time_ = poller_->Poll(0, &active_channels_);
+        if (!active_channels_.empty() || functors_pending_ || quit_)
+        {
+            spinning_ = false;
+            return;
+        }
+        if (policy == kSpinThenBlock && MonotonicMicros() >= spin_deadline)
+        {
+            break;
+        }
+        if (policy == kBusyPoll && (idle_pending_ || poll_policy_.load(std::memory_order_relaxed) != kBusyPoll))
+        {
+            break;
+        }
+    }
+    spinning_ = false;
+
+    // 刚刚的 epoll_wait(0) 没有事件
+    if (idle_pending_ && !functors_pending_)
+    {
+        RunIdleFunctors();
+        return;
+    }
+    if (!functors_pending_)
+    {
+        poll_return_time_ = poller_->Poll(kPollTimeMs, &active_channels_);
+    }
+}
+
+void EventLoop::QueueAfterDispatch(Functor cb)
+{
+    after_dispatch_functors_.push_back(std::move(cb));
+}
+
+void EventLoop::DoAfterDispatchFunctors()
+{
+    // 回调中可能再加入新的回调，一直执行到队列为空
+    std::vector<Functor> functors;
+    while (!after_dispatch_functors_.empty())
+    {
+        functors.swap(after_dispatch_functors_);
+
+        int64_t callback_start = MonotonicMicros();
+        for (const Functor &functor : functors)
+        {
+            BeginCallback(-1, kAfterDispatchName, callback_start);
+            functor();
+
+            int64_t callback_end = MonotonicMicros();
+            EndCallback(-1, kAfterDispatchName, callback_start, callback_end);
+            callback_start = callback_end;
+        }
+        functors.clear();
+    }
+}
+
+void EventLoop::BeginCallback(int fd, const char *name, int64_t start_us)
+{
+    uint32_t seq = activity_seq_.load(std::memory_order_relaxed);
+    activity_seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    activity_callback_start_us_.store(start_us, std::memory_order_relaxed);
+    activity_fd_.store(fd, std::memory_order_relaxed);
+    activity_name_.store(name, std::memory_order_relaxed);
+
+    activity_seq_.store(seq + 2, std::memory_order_release);
+}
+
+void EventLoop::EndCallback(int fd, const char *name, int64_t start_us, int64_t end_us)
+{
+    if (IsSlowCallback(end_us - start_us))
+    {
+        RecordSlowCallback(fd, name ? name : "", end_us - start_us);
+    }
+}
+
+bool EventLoop::IsSlowCallback(int64_t duration_us) const
+{
+    int64_t threshold = slow_callback_threshold_us_.load(std::memory_order_relaxed);
+    return threshold > 0 && duration_us >= threshold;
+}
+
+void EventLoop::RecordSlowCallback(int fd, const std::string &name, int64_t duration_us)
+{
+    SlowCallbackRecord record;
+    record.when = Timestamp(Timestamp::Now().micro_seconds_since_epoch() - duration_us);
+    record.duration_us = duration_us;
+    record.fd = fd;
+    record.name = name;
+
+    LOG_INFO("EventLoop %p slow callback fd=%d [%s] took %ld us \n",
+        this, fd, record.name.c_str(), static_cast<long>(duration_us));
+
+    std::unique_lock<std::mutex> lock(slow_mutex_);
+    if (slow_callbacks_.size() < kMaxSlowCallbackRecords)
+    {
+        slow_callbacks_.push_back(std::move(record));
+    }
+    else
+    {
+        slow_callbacks_[next_slow_callback_] = std::move(record);
+    }
+    next_slow_callback_ = (next_slow_callback_ + 1) % kMaxSlowCallbackRecords;
+}
+
+std::vector<SlowCallbackRecord> EventLoop::RecentSlowCallbacks() const
+{
+    std::vector<SlowCallbackRecord> records;
+    std::unique_lock<std::mutex> lock(slow_mutex_);
+
+    // 按时间先后顺序返回
+    size_t start = slow_callbacks_.size() < kMaxSlowCallbackRecords ? 0 : next_slow_callback_;
+    for (size_t i = 0; i < slow_callbacks_.size(); ++i)
+    {
+        records.push_back(slow_callbacks_[(start + i) % slow_callbacks_.size()]);
+    }
+    return records;
+}
+
+bool EventLoop::ReadActivity(LoopActivity *activity) const
+{
+    activity->iteration = metrics_.loop_iterations.value();
+    activity->iteration_start_us = activity_iteration_start_us_.load(std::memory_order_relaxed);
+    if (activity->iteration_start_us == 0)
+    {
+        return false;
+    }
+
+    uint32_t seq = activity_seq_.load(std::memory_order_acquire);
+    if (seq & 1)
+    {
+        // loop 正在切换回调，说明并没有卡住
+        return false;
+    }
+
+    activity->callback_start_us = activity_callback_start_us_.load(std::memory_order_relaxed);
+    activity->fd = activity_fd_.load(std::memory_order_relaxed);
+    const char *name = activity_name_.load(std::memory_order_relaxed);
+
+    // name 只会是 Channel 的标签或者常量字符串，不会被释放；连接名要在 loop 线程中生成，这里读不到
+    // 拷贝完以后再检查一次序号，中途切换了回调就丢掉结果
+    activity->name[0] = '\0';
+    if (name)
+    {
+        strncpy(activity->name, name, sizeof activity->name - 1);
+        activity->name[sizeof activity->name - 1] = '\0';
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return activity_seq_.load(std::memory_order_relaxed) == seq;
+}
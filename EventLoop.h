@@ -5,13 +5,39 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <deque>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "Metrics.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class LoopSlab;
+
+// 一次执行时间超过阈值的回调
+struct SlowCallbackRecord
+{
+    Timestamp when;         // 回调开始的时间
+    int64_t duration_us;
+    int fd;                 // pending functor 为 -1
+    std::string name;       // 连接名，没有名字的 Channel 和 pending functor 为描述信息
+};
+
+// loop 正在执行的回调，供 watchdog 线程读取
+struct LoopActivity
+{
+    int64_t iteration;              // 当前是第几轮循环
+    int64_t iteration_start_us;     // 本轮开始处理事件的时间，0 表示阻塞在 poll 中
+    int64_t callback_start_us;
+    int fd;
+    char name[64];                  // Channel 的标签，比如 "tcp connection"，不是连接名
+};
 
 // 主要包含了两个大模块 Channel、Poller
 class EventLoop : noncopyable
@@ -19,6 +45,14 @@ class EventLoop : noncopyable
 public:
     using Functor = std::function<void()>;
 
+    // 等待事件的方式
+    enum PollPolicy
+    {
+        kBlockingPoll,      // 阻塞在 epoll_wait 中，默认
+        kSpinThenBlock,     // 先用 epoll_wait(0) 自旋 spin_us 微秒，没有事件再阻塞
+        kBusyPoll,          // 一直自旋，独占一个核
+    };
+
     EventLoop();
     ~EventLoop();
 
@@ -34,19 +68,85 @@ public:
     // 把 cb 放入队列中，唤醒 loop 所在的线程，执行 cb
     void QueueInLoop(Functor cb);
 
+    // 在 loop 线程中调用，cb 在本轮的事件和 pending functor 都处理完以后执行
+    // 用于把一轮循环中的多次操作合并成一次，比如 TcpConnection 的 auto-cork
+    void QueueAfterDispatch(Functor cb);
+
+    // 低优先级任务，只在 loop 空闲（本来要阻塞在 epoll_wait 中）时执行，可以跨线程调用
+    // 每次空闲最多执行 kIdleSliceMicros 微秒，然后重新检查有没有事件；适合压缩、统计之类的后台工作
+    // kBusyPoll 从不阻塞，在 epoll_wait(0) 没有事件时执行
+    void QueueIdle(Functor cb);
+
     // 用来唤醒 loop 所在的线程
     void Wakeup();
 
+    // 定时器，可以跨线程调用，回调都在 loop 线程中执行
+    // 在 time 时刻执行 cb
+    TimerId RunAt(Timestamp time, TimerCallback cb);
+    // delay 秒以后执行 cb
+    TimerId RunAfter(double delay, TimerCallback cb);
+    // 每隔 interval 秒执行一次 cb
+    TimerId RunEvery(double interval, TimerCallback cb);
+    void Cancel(TimerId timer_id);
+
     // EventLoop的方法 =》 Poller的方法
     void UpdateChannel(Channel *channel);
     void RemoveChannel(Channel *channel);
     bool HasChannel(Channel *channel);
 
+    // 统计数据，只能在 loop 线程中修改，任意线程都可以读取快照
+    LoopMetrics& metrics() { return metrics_; }
+    const LoopMetrics& metrics() const { return metrics_; }
+
+    // 超过 micro_seconds 的 Channel 回调和 pending functor 会被记录下来，0 表示不记录
+    void set_slow_callback_threshold(int64_t micro_seconds) { slow_callback_threshold_us_ = micro_seconds; }
+    // 最近的慢回调记录，任意线程都可以调用
+    std::vector<SlowCallbackRecord> RecentSlowCallbacks() const;
+
+    // 读取 loop 当前正在执行的回调，loop 阻塞在 poll 中时返回 false，任意线程都可以调用
+    bool ReadActivity(LoopActivity *activity) const;
+
+    // 可以跨线程调用，下一次等待事件时生效
+    // 自旋期间其它线程 QueueInLoop 不需要写 eventfd 唤醒
+    void set_poll_policy(PollPolicy policy, int spin_us = kDefaultSpinMicros)
+    {
+        spin_us_.store(spin_us, std::memory_order_relaxed);
+        poll_policy_.store(policy, std::memory_order_relaxed);
+    }
+    PollPolicy poll_policy() const { return poll_policy_.load(std::memory_order_relaxed); }
+
+    // 每轮循环最多执行 max_functors 个 pending functor 或者执行 max_us 微秒，0 表示不限制
+    // 超出的留到下一轮，先于之后入队的执行；还有剩余时下一轮 epoll_wait 不阻塞
+    // 可以跨线程调用，至少执行一个，防止 loop 停滞
+    void set_functor_budget(size_t max_functors, int64_t max_us)
+    {
+        functor_budget_count_.store(max_functors, std::memory_order_relaxed);
+        functor_budget_us_.store(max_us, std::memory_order_relaxed);
+    }
+
+    pid_t thread_id() const { return thread_id_; }
+
+    // 这个 loop 的对象分配器（配合 SlabAllocator），只在 loop 线程中分配
+    LoopSlab* slab() const { return slab_; }
+
     // 判断 EventLoop 对象是否在自己的线程里面
     bool IsInLoopThread() const { return thread_id_ ==  CurrentThread::tid(); }
+    static const int kDefaultSpinMicros = 50;
+    static const int64_t kIdleSliceMicros = 1000;
 private:
+    void PollForEvents();
     void HandleRead();
     void DoPendingFunctors();
+    // 上一轮超出预算没有执行的 functor
+    bool HasDeferredFunctors() const { return next_functor_ < running_functors_.size(); }
+    // 执行空闲任务，最多 kIdleSliceMicros 微秒
+    void RunIdleFunctors();
+    void DoAfterDispatchFunctors();
+
+    void BeginCallback(int fd, const char *name, int64_t start_us);
+    void EndCallback(int fd, const char *name, int64_t start_us, int64_t end_us);
+    bool IsSlowCallback(int64_t duration_us) const;
+    void RecordSlowCallback(int fd, const std::string &name, int64_t duration_us);
 
     using ChannelList = std::vector<Channel*>;
 
@@ -60,6 +160,8 @@ private:
     // poller 返回发生事件的 channels 的时间点
     Timestamp poll_return_time_; 
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timer_queue_;
+    LoopSlab *slab_;            // 析构时 Release，还有对象没有释放时由最后一个对象释放
 
     // 当 MainLoop 获取一个新用户的 channel，
     // 通过轮询算法选择一个 subloop，通过该成员唤醒 subloop 处理 channel
@@ -73,7 +175,46 @@ private:
 
     // 存储 loop 需要执行的所有的回调操作
     std::vector<Functor> pending_functors_; 
+    // pending_functors_ 是否非空，在 mutex_ 中修改，自旋时不加锁读取
+    std::atomic_bool functors_pending_;
+
+    std::atomic<PollPolicy> poll_policy_;
+    std::atomic_int spin_us_;
+    // loop 正在自旋，会主动检查 functors_pending_
+    std::atomic_bool spinning_;
+
+    // 正在执行的一批 functor，超出预算时剩下的从 next_functor_ 开始留到下一轮，只在 loop 线程中访问
+    std::vector<Functor> running_functors_;
+    size_t next_functor_;
+    std::atomic<size_t> functor_budget_count_;
+    std::atomic<int64_t> functor_budget_us_;
 
     // 互斥锁，用来保护上面 vecto r容器的线程安全操作
     std::mutex mutex_; 
+
+    // 空闲任务，由 mutex_ 保护；idle_pending_ 和 functors_pending_ 一样在自旋和阻塞前不加锁读取
+    std::deque<Functor> idle_functors_;
+    std::atomic_bool idle_pending_;
+
+    // pending_functors_ 中最早的 functor 入队的时间，由 mutex_ 保护
+    int64_t pending_since_us_;
+
+    // 本轮循环结束前执行的回调，只在 loop 线程中访问，不需要加锁
+    std::vector<Functor> after_dispatch_functors_;
+
+    LoopMetrics metrics_;
+
+    std::atomic<int64_t> slow_callback_threshold_us_;
+    static const size_t kMaxSlowCallbackRecords = 64;
+    // 环形记录最近的慢回调，只在出现慢回调时加锁
+    mutable std::mutex slow_mutex_;
+    std::vector<SlowCallbackRecord> slow_callbacks_;
+    size_t next_slow_callback_;
+
+    // 当前回调的信息，用序号实现的顺序锁发布给 watchdog 线程，序号为奇数表示正在修改
+    std::atomic<uint32_t> activity_seq_;
+    std::atomic<int64_t> activity_iteration_start_us_;
+    std::atomic<int64_t> activity_callback_start_us_;
+    std::atomic<int> activity_fd_;
+    std::atomic<const char*> activity_name_;
 };
\ No newline at end of file
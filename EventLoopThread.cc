@@ -3,7 +3,8 @@
 
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb, 
-        const std::string &name)
+        const std::string &name,
+        int cpu)
         : loop_(nullptr)
         , exiting_(false)
         , thread_(std::bind(&EventLoopThread::ThreadFunc, this), name)
@@ -11,15 +12,23 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
         , cond_()
         , callback_(cb)
 {
-
+    thread_.set_cpu(cpu);
 }
 
 EventLoopThread::~EventLoopThread()
 {
     exiting_ = true;
-    if (loop_ != nullptr)
+
+    // loop 线程退出时在锁内把 loop_ 置空，之后才析构 loop，所以要在锁内调用 Quit
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (loop_ != nullptr)
+        {
+            loop_->Quit();
+        }
+    }
+    if (thread_.started())
     {
-        loop_->Quit();
         thread_.Join();
     }
 }
@@ -15,8 +15,10 @@ class EventLoopThread : noncopyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>; 
 
+    // cpu 为 -1 时不绑定
     EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(), 
-        const std::string &name = std::string());
+        const std::string &name = std::string(),
+        int cpu = -1);
     ~EventLoopThread();
 
     EventLoop* StartLoop();
@@ -2,6 +2,7 @@
 #include "EventLoopThread.h"
 
 #include <memory>
+#include <algorithm>
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *loop, const std::string &name_arg)
     : base_loop_(loop)
@@ -19,17 +20,11 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::Start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    init_callback_ = cb;
 
     for (int i = 0; i < num_threads_; ++i)
     {
-        char buf[name_.size() + 32];
-        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-
-        EventLoopThread *t = new EventLoopThread(cb, buf);
-        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-
-        // 底层创建线程，绑定一个新的 EventLoop，并返回该 loop 的地址
-        loops_.push_back(t->StartLoop()); 
+        CreateLoopThread();
     }
 
     // 整个服务端只有一个线程，运行着 baseloop
@@ -39,27 +34,89 @@ void EventLoopThreadPool::Start(const ThreadInitCallback &cb)
     }
 }
 
+EventLoop* EventLoopThreadPool::CreateLoopThread()
+{
+    size_t i = threads_.size();
+    char buf[name_.size() + 32];
+    snprintf(buf, sizeof buf, "%s%zu", name_.c_str(), i);
+
+    int cpu = cpus_.empty() ? -1 : cpus_[i % cpus_.size()];
+    EventLoopThread *t = new EventLoopThread(init_callback_, buf, cpu);
+
+    // 底层创建线程，绑定一个新的 EventLoop，并返回该 loop 的地址
+    EventLoop *loop = t->StartLoop();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+    loops_.push_back(loop);
+    active_loops_.push_back(loop);
+    return loop;
+}
+
 // 如果工作在多线程中，baseLoop_默认以轮询的方式分配 channel 给 subloop
 EventLoop* EventLoopThreadPool::GetNextLoop()
 {
     EventLoop *loop = base_loop_;
 
-    // 通过轮询获取下一个处理事件的loop
-    if (!loops_.empty()) 
+    // 通过轮询获取下一个处理事件的loop，只在 baseloop 线程中修改 active_loops_，这里不需要加锁
+    if (!active_loops_.empty()) 
     {
-        loop = loops_[next_];
-        ++next_;
-        if (next_ >= loops_.size())
+        if (next_ >= active_loops_.size())
         {
             next_ = 0;
         }
+        loop = active_loops_[next_];
+        ++next_;
     }
 
     return loop;
 }
 
+EventLoop* EventLoopThreadPool::AddLoop(bool *created)
+{
+    if (created)
+    {
+        *created = retired_loops_.empty();
+    }
+    if (retired_loops_.empty())
+    {
+        return CreateLoopThread();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    EventLoop *loop = retired_loops_.back();
+    retired_loops_.pop_back();
+    active_loops_.push_back(loop);
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::RetireLoop()
+{
+    if (active_loops_.size() <= 1)
+    {
+        return nullptr;
+    }
+    EventLoop *loop = active_loops_.back();
+    RetireLoop(loop);
+    return loop;
+}
+
+bool EventLoopThreadPool::RetireLoop(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = std::find(active_loops_.begin(), active_loops_.end(), loop);
+    if (it == active_loops_.end() || active_loops_.size() <= 1)
+    {
+        return false;
+    }
+    active_loops_.erase(it);
+    retired_loops_.push_back(loop);
+    return true;
+}
+
 std::vector<EventLoop*> EventLoopThreadPool::GetAllLoops()
 {
+    std::unique_lock<std::mutex> lock(mutex_);
     if (loops_.empty())
     {
         return std::vector<EventLoop*>(1, base_loop_);
@@ -68,4 +125,23 @@ std::vector<EventLoop*> EventLoopThreadPool::GetAllLoops()
     {
         return loops_;
     }
-}
\ No newline at end of file
+}
+
+std::vector<EventLoop*> EventLoopThreadPool::GetActiveLoops()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (active_loops_.empty())
+    {
+        return std::vector<EventLoop*>(1, base_loop_);
+    }
+    else
+    {
+        return active_loops_;
+    }
+}
+
+size_t EventLoopThreadPool::num_active_loops()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return active_loops_.empty() ? 1 : active_loops_.size();
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class EventLoop;
 class EventLoopThread;
@@ -18,23 +19,50 @@ public:
     ~EventLoopThreadPool();
 
     void set_num_threads(int num) { num_threads_ = num; }
+    // 第 i 个 loop 线程绑定到 cpus[i % cpus.size()] 上，在 Start 之前设置
+    void set_cpu_affinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+    bool pinned() const { return !cpus_.empty(); }
 
     void Start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // 如果工作在多线程中，baseLoop_默认以轮询的方式分配 channel 给 subloop
     EventLoop* GetNextLoop();
 
+    /**
+     * 运行时调整参与分配的 loop，在 baseloop 线程中调用
+     * RetireLoop 只是不再给 loop 分配新连接，已有的连接继续在上面运行直到关闭
+     * loop 线程不会退出（空闲时阻塞在 epoll_wait 中，不占用 cpu），其它模块持有的 EventLoop* 一直有效
+     * 自旋的等待方式由 TcpServer 在退役时改成 kBlockingPoll，重新启用时恢复
+     * AddLoop 优先重新启用退役的 loop，没有时才创建新线程，返回的 loop 是否新建由 created 给出
+     */
+    EventLoop* AddLoop(bool *created = nullptr);
+    // 退役最后加入的 loop，只剩一个时返回 nullptr
+    EventLoop* RetireLoop();
+    bool RetireLoop(EventLoop *loop);
+
+    // 所有创建过的 loop，包括退役的，任意线程都可以调用
     std::vector<EventLoop*> GetAllLoops();
+    // 参与分配新连接的 loop，任意线程都可以调用
+    std::vector<EventLoop*> GetActiveLoops();
+    size_t num_active_loops();
 
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 private:
+    EventLoop* CreateLoopThread();
 
     EventLoop *base_loop_;
     std::string name_;
     bool started_;
     int num_threads_;
-    int next_;
+    size_t next_;
+    std::vector<int> cpus_;
+    ThreadInitCallback init_callback_;
+
+    // 只在 baseloop 线程中修改，其它线程读取时加锁
+    std::mutex mutex_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
-};
\ No newline at end of file
+    std::vector<EventLoop*> active_loops_;
+    std::vector<EventLoop*> retired_loops_;
+};
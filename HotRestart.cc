@@ -0,0 +1,150 @@
+#include "HotRestart.h"
+#include "Socket.h"
+#include "Logger.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+
+static const char kFetchRequest[] = "FDS\n";
+
+HotRestartListener::HotRestartListener(EventLoop *loop, const std::string &path)
+    : server_(loop, InetAddress::UnixDomain(path), "HotRestartListener")
+    , allowed_uids_(1, ::geteuid())
+    , handed_off_(false)
+{
+    // bind 时的权限受 umask 影响，Start 之前还没有 listen，别人连不上，这里改成只有自己能连
+    InetAddress addr = InetAddress::UnixDomain(path);
+    if (!addr.is_abstract() && ::chmod(addr.ToIp().c_str(), S_IRUSR | S_IWUSR) < 0)
+    {
+        LOG_ERROR("HotRestartListener chmod %s error:%d \n", path.c_str(), errno);
+    }
+
+    server_.set_connection_callback([](const TcpConnectionPtr&) {});
+    server_.set_message_callback(std::bind(&HotRestartListener::OnMessage, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HotRestartListener::Start()
+{
+    server_.Start();
+}
+
+void HotRestartListener::OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    const char *eol = buf->findEOL();
+    if (eol == nullptr)
+    {
+        return;
+    }
+    std::string request(buf->peek(), eol + 1);
+    buf->retrieveAll();
+
+    // 抽象地址没有文件权限，同一台机器上谁都能连，只有这里的检查
+    if (!PeerAllowed(conn->fd()))
+    {
+        conn->Shutdown();
+        return;
+    }
+
+    if (request != kFetchRequest || listen_fds_.empty())
+    {
+        LOG_ERROR("HotRestartListener bad request from %s \n", conn->name().c_str());
+        conn->Shutdown();
+        return;
+    }
+
+    // 先把 fd 交出去，新进程已经能 accept 以后旧进程才停止 accept
+    // 单线程 server，连接在当前线程中，fd 可以直接使用
+    std::string reply = std::to_string(listen_fds_.size()) + "\n";
+    if (Socket::SendFds(conn->fd(), listen_fds_, reply))
+    {
+        LOG_INFO("HotRestartListener handed %zu listen fds to %s \n",
+            listen_fds_.size(), conn->name().c_str());
+        if (!handed_off_ && handoff_callback_)
+        {
+            handed_off_ = true;
+            handoff_callback_();
+        }
+    }
+    conn->Shutdown();
+}
+
+bool HotRestartListener::PeerAllowed(int fd) const
+{
+    ucred cred;
+    socklen_t len = sizeof cred;
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    {
+        LOG_ERROR("HotRestartListener SO_PEERCRED error:%d \n", errno);
+        return false;
+    }
+    for (uid_t uid : allowed_uids_)
+    {
+        if (cred.uid == uid)
+        {
+            return true;
+        }
+    }
+    LOG_ERROR("HotRestartListener rejected pid %d uid %u \n", static_cast<int>(cred.pid), static_cast<unsigned>(cred.uid));
+    return false;
+}
+
+std::vector<int> HotRestartListener::FetchListenFds(const std::string &path, int timeout_ms)
+{
+    std::vector<int> fds;
+    InetAddress addr = InetAddress::UnixDomain(path);
+
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_ERROR("HotRestartListener socket error:%d \n", errno);
+        return fds;
+    }
+    Socket sock(sockfd);
+
+    timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    ::setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    ::setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+    if (::connect(sockfd, addr.sock_addr(), addr.sock_len()) < 0)
+    {
+        // 没有旧进程在运行
+        if (errno != ENOENT && errno != ECONNREFUSED)
+        {
+            LOG_ERROR("HotRestartListener connect %s error:%d \n", path.c_str(), errno);
+        }
+        return fds;
+    }
+
+    if (::send(sockfd, kFetchRequest, sizeof kFetchRequest - 1, MSG_NOSIGNAL) != sizeof kFetchRequest - 1)
+    {
+        LOG_ERROR("HotRestartListener send request error:%d \n", errno);
+        return fds;
+    }
+
+    char reply[32] = {0};
+    ssize_t n = Socket::RecvFds(sockfd, &fds, reply, sizeof reply - 1);
+    if (n <= 0)
+    {
+        LOG_ERROR("HotRestartListener receive fds error:%d \n", n < 0 ? errno : 0);
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        fds.clear();
+        return fds;
+    }
+
+    size_t expected = static_cast<size_t>(::atoi(reply));
+    if (expected != fds.size())
+    {
+        LOG_ERROR("HotRestartListener expected %zu fds, received %zu \n", expected, fds.size());
+    }
+    return fds;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+
+#include <functional>
+#include <vector>
+#include <string>
+#include <sys/types.h>
+
+class EventLoop;
+
+/**
+ * 热重启：新进程通过 Unix socket 向旧进程要监听 fd（SCM_RIGHTS），拿到以后马上开始 accept
+ * 旧进程交出 fd 以后停止 accept，已有的连接用 TcpServer::GracefulShutdown 排空
+ * 两个进程共享同一个监听 socket，内核队列中的连接不会丢，客户端看不到 connection refused
+ *
+ * 新进程：
+ *   std::vector<int> fds = HotRestartListener::FetchListenFds(path);
+ *   fds 为空时（没有旧进程）正常 bind，否则用 TcpServer(loop, fds[0], name) 接管
+ * 然后两种情况下都启动 HotRestartListener，等待下一次重启
+ *
+ * path 最好使用文件系统路径：旧进程还在时抽象地址不能再 bind，文件路径可以 unlink 以后重新 bind
+ * socket 文件的权限是 0600，每个请求还会用 SO_PEERCRED 检查对端的 uid，默认只接受和当前进程相同的 uid
+ */
+class HotRestartListener : noncopyable
+{
+public:
+    using HandoffCallback = std::function<void()>;
+
+    HotRestartListener(EventLoop *loop, const std::string &path);
+
+    // 要交给新进程的监听 fd，按添加的顺序传递，在 Start 之前调用
+    void AddListenFd(int fd) { listen_fds_.push_back(fd); }
+    // fd 已经交给新进程，通常在这里调用 TcpServer::GracefulShutdown，只调用一次
+    void set_handoff_callback(const HandoffCallback &cb) { handoff_callback_ = cb; }
+    // 额外允许请求 fd 的 uid（比如用另一个用户启动新进程），在 Start 之前调用
+    void AllowUid(uid_t uid) { allowed_uids_.push_back(uid); }
+
+    void Start();
+
+    /**
+     * 阻塞地向 path 上的旧进程请求监听 fd，在启动 loop 之前调用
+     * 没有旧进程或者超时返回空
+     */
+    static std::vector<int> FetchListenFds(const std::string &path, int timeout_ms = 1000);
+private:
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time);
+    bool PeerAllowed(int fd) const;
+
+    TcpServer server_;
+    std::vector<int> listen_fds_;
+    std::vector<uid_t> allowed_uids_;
+    HandoffCallback handoff_callback_;
+    bool handed_off_;
+};
@@ -0,0 +1,232 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+HttpContext::ParseResult HttpContext::Parse(Buffer *buf)
+{
+    const char *base = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    while (state_ == kExpectRequestLine || state_ == kExpectHeaders)
+    {
+        // 从上次停下的位置继续找，已经扫描过的字节不再重复扫描
+        const char *crlf = buf->findCRLF(&scan_offset_);
+        if (crlf == nullptr)
+        {
+            if (readable > kMaxHeaderBytes)
+            {
+                return Fail(431);
+            }
+            return kNeedMore;
+        }
+
+        size_t line_end = crlf - base;
+        if (line_end > kMaxHeaderBytes)
+        {
+            return Fail(431);
+        }
+
+        if (state_ == kExpectRequestLine)
+        {
+            // 请求行之前的空行直接忽略
+            if (line_end != line_start_)
+            {
+                if (!ProcessRequestLine(base, line_start_, line_end))
+                {
+                    return Fail(400);
+                }
+                state_ = kExpectHeaders;
+            }
+        }
+        else if (line_end == line_start_)
+        {
+            // 空行，请求头结束
+            line_start_ = line_end + 2;
+            scan_offset_ = line_start_;
+            if (!ProcessHeadersDone(base))
+            {
+                return kError;
+            }
+            break;
+        }
+        else if (!ProcessHeader(base, line_start_, line_end))
+        {
+            return kError;
+        }
+
+        line_start_ = line_end + 2;
+        scan_offset_ = line_start_;
+    }
+
+    if (state_ == kExpectBody)
+    {
+        if (readable - line_start_ < content_length_)
+        {
+            return kNeedMore;
+        }
+        request_.body_range_ = HttpRequest::Range(line_start_, content_length_);
+        state_ = kGotAll;
+    }
+
+    request_.base_ = base;
+    return kComplete;
+}
+
+void HttpContext::Consume(Buffer *buf)
+{
+    buf->retrieve(line_start_ + content_length_);
+    Reset();
+}
+
+bool HttpContext::ProcessRequestLine(const char *base, size_t begin, size_t end)
+{
+    const char *start = base + begin;
+    const char *line_end = base + end;
+
+    const char *space = static_cast<const char*>(::memchr(start, ' ', line_end - start));
+    if (space == nullptr)
+    {
+        return false;
+    }
+
+    StringPiece method(start, space - start);
+    if (method == "GET")
+    {
+        request_.method_ = HttpRequest::kGet;
+    }
+    else if (method == "POST")
+    {
+        request_.method_ = HttpRequest::kPost;
+    }
+    else if (method == "HEAD")
+    {
+        request_.method_ = HttpRequest::kHead;
+    }
+    else if (method == "PUT")
+    {
+        request_.method_ = HttpRequest::kPut;
+    }
+    else if (method == "DELETE")
+    {
+        request_.method_ = HttpRequest::kDelete;
+    }
+    else if (method == "OPTIONS")
+    {
+        request_.method_ = HttpRequest::kOptions;
+    }
+    else
+    {
+        return false;
+    }
+    request_.method_range_ = HttpRequest::Range(begin, method.size());
+
+    const char *target = space + 1;
+    space = static_cast<const char*>(::memchr(target, ' ', line_end - target));
+    if (space == nullptr || space == target)
+    {
+        return false;
+    }
+
+    const char *question = static_cast<const char*>(::memchr(target, '?', space - target));
+    if (question != nullptr)
+    {
+        request_.path_range_ = HttpRequest::Range(target - base, question - target);
+        request_.query_range_ = HttpRequest::Range(question + 1 - base, space - question - 1);
+    }
+    else
+    {
+        request_.path_range_ = HttpRequest::Range(target - base, space - target);
+    }
+
+    StringPiece version(space + 1, line_end - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool HttpContext::ProcessHeader(const char *base, size_t begin, size_t end)
+{
+    if (request_.header_count_ >= HttpRequest::kMaxHeaders)
+    {
+        error_status_ = 431;
+        return false;
+    }
+
+    const char *start = base + begin;
+    const char *line_end = base + end;
+    const char *colon = static_cast<const char*>(::memchr(start, ':', line_end - start));
+    if (colon == nullptr || colon == start)
+    {
+        error_status_ = 400;
+        return false;
+    }
+
+    const char *value = colon + 1;
+    while (value < line_end && IsSpace(*value))
+    {
+        ++value;
+    }
+    const char *value_end = line_end;
+    while (value_end > value && IsSpace(value_end[-1]))
+    {
+        --value_end;
+    }
+
+    HttpRequest::Header &header = request_.headers_[request_.header_count_++];
+    header.name = HttpRequest::Range(begin, colon - start);
+    header.value = HttpRequest::Range(value - base, value_end - value);
+    return true;
+}
+
+bool HttpContext::ProcessHeadersDone(const char *base)
+{
+    request_.base_ = base;
+
+    // 不支持分块传输的请求体
+    if (!request_.GetHeader("Transfer-Encoding").empty())
+    {
+        error_status_ = 501;
+        return false;
+    }
+
+    StringPiece length = request_.GetHeader("Content-Length");
+    if (!length.empty())
+    {
+        size_t value = 0;
+        for (size_t i = 0; i < length.size(); ++i)
+        {
+            if (length[i] < '0' || length[i] > '9' || value > kMaxBodyBytes)
+            {
+                error_status_ = length[i] < '0' || length[i] > '9' ? 400 : 413;
+                return false;
+            }
+            value = value * 10 + (length[i] - '0');
+        }
+        if (value > kMaxBodyBytes)
+        {
+            error_status_ = 413;
+            return false;
+        }
+        content_length_ = value;
+    }
+
+    state_ = content_length_ > 0 ? kExpectBody : kGotAll;
+    return true;
+}
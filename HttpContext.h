@@ -0,0 +1,78 @@
+#pragma once
+
+#include "HttpRequest.h"
+
+#include <stddef.h>
+
+class Buffer;
+
+/**
+ * 每个连接一个的 HTTP 请求解析器，直接在 input buffer 上增量解析
+ * 
+ * 解析的中间结果只记录偏移，数据到达时 Buffer 扩容或者挪动数据也不受影响；
+ * 已经扫描过的字节不会重复扫描。一个请求解析完成以后，调用 Consume 把它从 Buffer 中移走，
+ * 然后可以继续解析同一个 Buffer 中流水线发过来的下一个请求
+ */ 
+class HttpContext
+{
+public:
+    enum ParseResult
+    {
+        kNeedMore,      // 请求还不完整，等待更多的数据
+        kComplete,      // request() 可用
+        kError,         // 请求格式错误，error_status() 是应该返回的状态码
+    };
+
+    // 请求行加上所有请求头的最大长度
+    static const size_t kMaxHeaderBytes = 8 * 1024;
+    static const size_t kMaxBodyBytes = 8 * 1024 * 1024;
+
+    HttpContext()
+    {
+        Reset();
+    }
+
+    ParseResult Parse(Buffer *buf);
+
+    const HttpRequest& request() const { return request_; }
+    int error_status() const { return error_status_; }
+
+    // 把解析完成的请求从 buf 中移走，准备解析下一个请求
+    void Consume(Buffer *buf);
+private:
+    enum State
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+        kGotAll,
+    };
+
+    void Reset()
+    {
+        state_ = kExpectRequestLine;
+        scan_offset_ = 0;
+        line_start_ = 0;
+        content_length_ = 0;
+        error_status_ = 0;
+        request_.Reset();
+    }
+
+    // 行的范围都是相对请求起始位置的偏移，不包括 \r\n
+    bool ProcessRequestLine(const char *base, size_t begin, size_t end);
+    bool ProcessHeader(const char *base, size_t begin, size_t end);
+    bool ProcessHeadersDone(const char *base);
+
+    ParseResult Fail(int status)
+    {
+        error_status_ = status;
+        return kError;
+    }
+
+    State state_;
+    size_t scan_offset_;        // 下一次从这里开始找 \r\n
+    size_t line_start_;         // 当前行的起始位置
+    size_t content_length_;
+    int error_status_;
+    HttpRequest request_;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <stdint.h>
+#include <strings.h>
+
+/**
+ * 解析好的 HTTP 请求，所有字段都以 (偏移, 长度) 的形式记录，
+ * 解析完成后以 StringPiece 的形式指向 input buffer，不做任何拷贝
+ * 只在这个请求被 HttpContext::Consume 之前有效
+ */ 
+class HttpRequest
+{
+public:
+    enum Method
+    {
+        kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions
+    };
+
+    enum Version
+    {
+        kUnknown, kHttp10, kHttp11
+    };
+
+    static const int kMaxHeaders = 32;
+
+    HttpRequest()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        base_ = nullptr;
+        method_ = kInvalid;
+        version_ = kUnknown;
+        header_count_ = 0;
+        method_range_ = path_range_ = query_range_ = body_range_ = Range();
+    }
+
+    Method method() const { return method_; }
+    Version version() const { return version_; }
+    StringPiece method_string() const { return Piece(method_range_); }
+    StringPiece path() const { return Piece(path_range_); }
+    StringPiece query() const { return Piece(query_range_); }
+    StringPiece body() const { return Piece(body_range_); }
+
+    int header_count() const { return header_count_; }
+    StringPiece header_name(int i) const { return Piece(headers_[i].name); }
+    StringPiece header_value(int i) const { return Piece(headers_[i].value); }
+
+    // 按名字查找请求头，不区分大小写，找不到返回空
+    StringPiece GetHeader(StringPiece name) const
+    {
+        for (int i = 0; i < header_count_; ++i)
+        {
+            const Range &range = headers_[i].name;
+            if (range.len == name.size()
+                && ::strncasecmp(base_ + range.offset, name.data(), name.size()) == 0)
+            {
+                return Piece(headers_[i].value);
+            }
+        }
+        return StringPiece();
+    }
+
+    // HTTP/1.1 默认长连接，HTTP/1.0 需要显式的 Connection: Keep-Alive
+    bool keep_alive() const
+    {
+        StringPiece connection = GetHeader("Connection");
+        if (version_ == kHttp11)
+        {
+            return !EqualsIgnoreCase(connection, "close");
+        }
+        return EqualsIgnoreCase(connection, "keep-alive");
+    }
+
+    static bool EqualsIgnoreCase(StringPiece lhs, StringPiece rhs)
+    {
+        return lhs.size() == rhs.size() && ::strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    }
+private:
+    friend class HttpContext;
+
+    struct Range
+    {
+        Range()
+            : offset(0)
+            , len(0)
+        {}
+        Range(size_t off, size_t length)
+            : offset(static_cast<uint32_t>(off))
+            , len(static_cast<uint32_t>(length))
+        {}
+
+        uint32_t offset;    // 相对请求起始位置的偏移
+        uint32_t len;
+    };
+
+    struct Header
+    {
+        Range name;
+        Range value;
+    };
+
+    StringPiece Piece(const Range &range) const
+    {
+        return StringPiece(base_ + range.offset, range.len);
+    }
+
+    const char *base_;      // 请求在 input buffer 中的起始位置，解析完成时才设置
+    Method method_;
+    Version version_;
+    Range method_range_;
+    Range path_range_;
+    Range query_range_;
+    Range body_range_;
+    int header_count_;
+    Header headers_[kMaxHeaders];
+};
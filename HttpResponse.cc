@@ -0,0 +1,119 @@
+#include "HttpResponse.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+
+void HttpResponse::Reset(bool close, HttpRequest::Version version)
+{
+    status_code_ = k200Ok;
+    version_ = version;
+    close_connection_ = close;
+    head_only_ = false;
+    chunked_ = false;
+    headers_.clear();
+    body_.clear();
+    stream_.reset();
+}
+
+void HttpResponse::AddHeader(StringPiece key, StringPiece value)
+{
+    headers_.append(key.data(), key.size());
+    headers_.append(": ", 2);
+    headers_.append(value.data(), value.size());
+    headers_.append("\r\n", 2);
+}
+
+void HttpResponse::AppendChunk(StringPiece data)
+{
+    // 长度为 0 的 chunk 表示结束，由 AppendToBuffer 统一添加
+    if (data.empty())
+    {
+        return;
+    }
+    if (http10())
+    {
+        body_.append(data.data(), data.size());
+        return;
+    }
+
+    char size[32] = {0};
+    int n = snprintf(size, sizeof size, "%zx\r\n", data.size());
+    body_.append(size, n);
+    body_.append(data.data(), data.size());
+    body_.append("\r\n", 2);
+}
+
+std::shared_ptr<HttpStream> HttpResponse::StartStream()
+{
+    chunked_ = true;
+    if (http10())
+    {
+        close_connection_ = true;
+    }
+    stream_ = std::make_shared<HttpStream>(http10(), head_only_);
+    return stream_;
+}
+
+void HttpResponse::AppendToBuffer(Buffer *output, StringPiece date_header) const
+{
+    char buf[128] = {0};
+    int n = snprintf(buf, sizeof buf, "HTTP/1.%d %d %s\r\n",
+        http10() ? 0 : 1, status_code_, StatusMessage(status_code_));
+    output->append(buf, n);
+
+    if (close_connection_)
+    {
+        output->append("Connection: close\r\n", 19);
+    }
+    else if (http10())
+    {
+        output->append("Connection: keep-alive\r\n", 24);
+    }
+
+    bool chunked = chunked_ && !http10();
+    if (chunked)
+    {
+        output->append("Transfer-Encoding: chunked\r\n", 28);
+    }
+    else if (!stream_)
+    {
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", body_.size());
+        output->append(buf, n);
+    }
+
+    output->append(date_header.data(), date_header.size());
+    output->append(headers_.data(), headers_.size());
+    output->append("\r\n", 2);
+
+    if (!head_only_)
+    {
+        output->append(body_.data(), body_.size());
+        // 流式响应的结束 chunk 由 HttpStream::Finish 发送
+        if (chunked && !stream_)
+        {
+            output->append("0\r\n\r\n", 5);
+        }
+    }
+}
+
+const char* HttpResponse::StatusMessage(int code)
+{
+    switch (code)
+    {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "HttpRequest.h"
+#include "HttpStream.h"
+
+#include <memory>
+#include <string>
+
+class Buffer;
+
+/**
+ * HTTP 响应，每个连接复用同一个对象，内部 string 的容量可以重复使用
+ * 打开 chunked 以后，AppendChunk 追加的数据按 Transfer-Encoding: chunked 编码输出，和响应头一起发送
+ * 响应体要在回调返回以后才能产生时使用 StartStream，响应头先发出，之后通过 HttpStream 逐个发送 chunk
+ */ 
+class HttpResponse
+{
+public:
+    enum StatusCode
+    {
+        kUnknown,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k400BadRequest = 400,
+        k404NotFound = 404,
+        k413PayloadTooLarge = 413,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+    };
+
+    explicit HttpResponse(bool close = false)
+    {
+        Reset(close);
+    }
+
+    // version 是请求的版本，响应使用同样的版本；HTTP/1.0 的长连接需要在响应中回复 Connection: keep-alive
+    void Reset(bool close, HttpRequest::Version version = HttpRequest::kHttp11);
+
+    void set_status_code(int code) { status_code_ = code; }
+    int status_code() const { return status_code_; }
+
+    void set_close_connection(bool on) { close_connection_ = on; }
+    bool close_connection() const { return close_connection_; }
+
+    // HEAD 请求只输出响应头
+    void set_head_only(bool on) { head_only_ = on; }
+
+    void set_content_type(StringPiece content_type) { AddHeader("Content-Type", content_type); }
+    void AddHeader(StringPiece key, StringPiece value);
+
+    void set_body(StringPiece body) { body_.assign(body.data(), body.size()); }
+    void AppendBody(StringPiece data) { body_.append(data.data(), data.size()); }
+
+    // HTTP/1.0 不支持 chunked，此时 AppendChunk 直接追加原始数据，按 Content-Length 输出
+    void set_chunked(bool on) { chunked_ = on; }
+    bool chunked() const { return chunked_; }
+    void AppendChunk(StringPiece data);
+
+    // 开始流式响应，打开 chunked，之前 AppendChunk 的数据作为最前面的 chunk 发出
+    // HTTP/1.0 的流式响应没有长度，以关闭连接结束
+    std::shared_ptr<HttpStream> StartStream();
+    const std::shared_ptr<HttpStream>& stream() const { return stream_; }
+
+    // date_header 是预先生成好的完整的 "Date: ...\r\n"
+    void AppendToBuffer(Buffer *output, StringPiece date_header) const;
+
+    static const char* StatusMessage(int code);
+private:
+    bool http10() const { return version_ == HttpRequest::kHttp10; }
+
+    int status_code_;
+    HttpRequest::Version version_;
+    bool close_connection_;
+    bool head_only_;
+    bool chunked_;
+    std::string headers_;   // 已经按 "Key: Value\r\n" 拼好的额外响应头
+    std::string body_;      // chunked 时保存编码好的 chunk
+    std::shared_ptr<HttpStream> stream_;
+};
@@ -0,0 +1,182 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+
+#include <time.h>
+#include <stdio.h>
+
+namespace
+{
+
+// 每个 loop 线程一份预先生成好的 Date 响应头
+__thread char t_date_header[64];
+__thread size_t t_date_header_len = 0;
+
+void UpdateDateHeader()
+{
+    time_t now = ::time(nullptr);
+    tm tm_time;
+    ::gmtime_r(&now, &tm_time);
+    t_date_header_len = ::strftime(t_date_header, sizeof t_date_header,
+        "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_time);
+}
+
+// 每个连接上的状态，响应对象和输出缓冲区在连接上复用
+struct HttpSession
+{
+    HttpSession()
+        : closing(false)
+        , close_after_stream(false)
+    {}
+
+    HttpContext context;
+    HttpResponse response;
+    Buffer output;
+    bool closing;       // 已经决定关闭连接，后面收到的数据直接丢弃
+    std::shared_ptr<HttpStream> stream;     // 还没有 Finish 的流式响应
+    bool close_after_stream;
+};
+
+void DefaultHttpCallback(const HttpRequest&, HttpResponse *resp)
+{
+    resp->set_status_code(HttpResponse::k404NotFound);
+    resp->set_close_connection(true);
+}
+
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            TcpServer::Option option)
+    : server_(loop, listen_addr, name, option)
+    , http_callback_(DefaultHttpCallback)
+{
+    server_.set_connection_callback(
+        std::bind(&HttpServer::OnConnection, this, std::placeholders::_1)
+    );
+    server_.set_message_callback(
+        std::bind(&HttpServer::OnMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+    );
+    server_.set_thread_init_callback(
+        std::bind(&HttpServer::OnThreadInit, this, std::placeholders::_1)
+    );
+}
+
+void HttpServer::Start()
+{
+    LOG_INFO("HttpServer[%s] starts listening \n", server_.name().c_str());
+    server_.Start();
+}
+
+// 在 loop 线程中执行
+void HttpServer::OnThreadInit(EventLoop *loop)
+{
+    UpdateDateHeader();
+    loop->RunEvery(1.0, UpdateDateHeader);
+
+    if (thread_init_callback_)
+    {
+        thread_init_callback_(loop);
+    }
+}
+
+void HttpServer::OnConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->set_context(std::make_shared<HttpSession>());
+    }
+}
+
+void HttpServer::OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    HttpSession *session = static_cast<HttpSession*>(conn->context().get());
+    if (session->closing)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    // 流式响应还没结束，后面的请求等 Finish 以后再处理
+    if (session->stream)
+    {
+        return;
+    }
+
+    StringPiece date_header(t_date_header, t_date_header_len);
+    bool close = false;
+
+    // 流水线：把 buf 中所有完整的请求按顺序处理完，响应写到同一个 output 中
+    while (!close)
+    {
+        HttpContext::ParseResult result = session->context.Parse(buf);
+        if (result == HttpContext::kNeedMore)
+        {
+            break;
+        }
+
+        HttpResponse &response = session->response;
+        if (result == HttpContext::kError)
+        {
+            response.Reset(true);
+            response.set_status_code(session->context.error_status());
+            response.AppendToBuffer(&session->output, date_header);
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+
+        const HttpRequest &request = session->context.request();
+        response.Reset(!request.keep_alive(), request.version());
+        response.set_head_only(request.method() == HttpRequest::kHead);
+        http_callback_(request, &response);
+        response.AppendToBuffer(&session->output, date_header);
+
+        close = response.close_connection();
+        session->context.Consume(buf);
+
+        std::shared_ptr<HttpStream> stream = response.stream();
+        if (stream && !stream->Bind(conn, std::bind(&HttpServer::OnStreamFinished, this, std::placeholders::_1),
+                                    &session->output))
+        {
+            // 前面的响应和响应头先发出去，连接等 Finish 以后再关闭
+            session->stream = stream;
+            session->close_after_stream = close;
+            close = false;
+            break;
+        }
+    }
+
+    if (session->output.readableBytes() > 0)
+    {
+        conn->Send(&session->output);
+    }
+
+    if (close)
+    {
+        session->closing = true;
+        conn->Shutdown();
+    }
+}
+
+void HttpServer::OnStreamFinished(const TcpConnectionPtr &conn)
+{
+    HttpSession *session = static_cast<HttpSession*>(conn->context().get());
+    if (!session || !session->stream)
+    {
+        return;
+    }
+    session->stream.reset();
+
+    if (session->close_after_stream)
+    {
+        session->closing = true;
+        conn->Shutdown();
+    }
+    else if (conn->connected() && conn->input_buffer()->readableBytes() > 0)
+    {
+        // 继续处理流水线中后面的请求
+        OnMessage(conn, conn->input_buffer(), Timestamp::Now());
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * 基于 TcpServer 的 HTTP/1.1 服务器
+ * 
+ * 支持长连接和流水线：同一次读到的多个请求依次处理，响应按请求的顺序追加到一个 Buffer 里，一次发送
+ * 流式响应（HttpResponse::StartStream）结束之前，后面的请求留在 input buffer 中，Finish 以后继续处理
+ * Date 响应头每个 loop 一份，由定时器每秒刷新一次
+ */ 
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+    using ThreadInitCallback = TcpServer::ThreadInitCallback;
+
+    HttpServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            TcpServer::Option option = TcpServer::kNoReusePort);
+
+    // 在 loop 线程中同步调用，request 只在回调期间有效
+    void set_http_callback(const HttpCallback &cb) { http_callback_ = cb; }
+    void set_thread_init_callback(const ThreadInitCallback &cb) { thread_init_callback_ = cb; }
+
+    void SetThreadNum(int num_threads) { server_.SetThreadNum(num_threads); }
+
+    // 需要设置空闲超时、统计等选项时直接使用底层的 TcpServer
+    TcpServer* server() { return &server_; }
+
+    void Start();
+private:
+    void OnThreadInit(EventLoop *loop);
+    void OnConnection(const TcpConnectionPtr &conn);
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    // 在 loop 线程中执行
+    void OnStreamFinished(const TcpConnectionPtr &conn);
+
+    TcpServer server_;
+    HttpCallback http_callback_;
+    ThreadInitCallback thread_init_callback_;
+};
@@ -0,0 +1,107 @@
+#include "HttpStream.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+
+static const char kLastChunk[] = "0\r\n\r\n";
+
+HttpStream::HttpStream(bool raw, bool head_only)
+    : raw_(raw)
+    , head_only_(head_only)
+    , bound_(false)
+    , finished_(false)
+{}
+
+void HttpStream::Encode(StringPiece data, std::string *out) const
+{
+    if (raw_)
+    {
+        out->append(data.data(), data.size());
+        return;
+    }
+
+    char size[32] = {0};
+    int n = snprintf(size, sizeof size, "%zx\r\n", data.size());
+    out->append(size, n);
+    out->append(data.data(), data.size());
+    out->append("\r\n", 2);
+}
+
+void HttpStream::SendChunk(StringPiece data)
+{
+    // 长度为 0 的 chunk 表示结束，只由 Finish 发送
+    if (data.empty() || head_only_)
+    {
+        return;
+    }
+
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_)
+        {
+            return;
+        }
+        if (!bound_)
+        {
+            Encode(data, &pending_);
+            return;
+        }
+        conn = conn_.lock();
+    }
+
+    if (conn)
+    {
+        std::string chunk;
+        Encode(data, &chunk);
+        conn->Send(chunk);
+    }
+}
+
+void HttpStream::Finish()
+{
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_)
+        {
+            return;
+        }
+        finished_ = true;
+        // 还没有 Bind，结束的 chunk 和响应头一起发出
+        if (!bound_)
+        {
+            return;
+        }
+        conn = conn_.lock();
+    }
+
+    if (!conn)
+    {
+        return;
+    }
+    if (!raw_ && !head_only_)
+    {
+        conn->Send(std::string(kLastChunk, sizeof kLastChunk - 1));
+    }
+    // 排在前面的 Send 之后执行，连接迁移时也一样
+    conn->QueueInOwnerLoop(std::bind(finish_callback_, conn));
+}
+
+bool HttpStream::Bind(const TcpConnectionPtr &conn, const FinishCallback &finish_callback, Buffer *output)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    output->append(pending_.data(), pending_.size());
+    pending_.clear();
+    if (finished_ && !raw_ && !head_only_)
+    {
+        output->append(kLastChunk, sizeof kLastChunk - 1);
+    }
+
+    bound_ = true;
+    conn_ = conn;
+    finish_callback_ = finish_callback;
+    return finished_;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class Buffer;
+
+/**
+ * 流式的 chunked 响应，在 http 回调中由 HttpResponse::StartStream 创建
+ *
+ * 回调返回以后响应头先发出去，之后每次 SendChunk 直接发送一个 chunk，Finish 发送结束的空 chunk
+ * SendChunk 和 Finish 可以在任意线程、任意时刻调用，回调返回之前调用的先暂存，和响应头一起发出
+ * Finish 之前流水线中后面的请求不会被处理，响应按请求的顺序发出
+ * HTTP/1.0 不支持 chunked，直接发送原始数据，Finish 以后关闭连接；HEAD 请求只发送响应头
+ */
+class HttpStream : noncopyable
+{
+public:
+    using FinishCallback = std::function<void(const TcpConnectionPtr&)>;
+
+    HttpStream(bool raw, bool head_only);
+
+    void SendChunk(StringPiece data);
+    void Finish();
+private:
+    friend class HttpServer;
+
+    /**
+     * 回调返回以后由 HttpServer 在 loop 线程中调用，把暂存的数据追加到 output 中
+     * 已经 Finish 时同时追加结束的 chunk，返回 true，不再调用 finish_callback
+     */
+    bool Bind(const TcpConnectionPtr &conn, const FinishCallback &finish_callback, Buffer *output);
+    void Encode(StringPiece data, std::string *out) const;
+
+    const bool raw_;
+    const bool head_only_;
+
+    std::mutex mutex_;
+    bool bound_;
+    bool finished_;
+    std::string pending_;       // Bind 之前的数据，已经编码
+    std::weak_ptr<TcpConnection> conn_;
+    FinishCallback finish_callback_;
+};
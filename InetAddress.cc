@@ -1,38 +1,143 @@
 #include "InetAddress.h"
+#include "Logger.h"
 
 #include <strings.h>
 #include <string.h>
+#include <stddef.h>
+#include <algorithm>
 
-InetAddress::InetAddress(uint16_t port, std::string ip)
+InetAddress::InetAddress(uint16_t port, const std::string &ip)
 {
-    bzero(&sock_addr_, sizeof(sock_addr_));
-    sock_addr_.sin_family = AF_INET;
-    sock_addr_.sin_port = htons(port);
-    // sock_addr_.sin_addr.s_addr = inet_addr(ip.c_str());
-    sock_addr_.sin_addr.s_addr = htonl(INADDR_ANY);
+    bzero(&addr_, sizeof(addr_));
+    if (ip.find(':') != std::string::npos)
+    {
+        addr_.in6.sin6_family = AF_INET6;
+        addr_.in6.sin6_port = htons(port);
+        if (::inet_pton(AF_INET6, ip.c_str(), &addr_.in6.sin6_addr) != 1)
+        {
+            LOG_ERROR("invalid ipv6 address %s \n", ip.c_str());
+        }
+        len_ = sizeof(sockaddr_in6);
+    }
+    else
+    {
+        addr_.in.sin_family = AF_INET;
+        addr_.in.sin_port = htons(port);
+        if (::inet_pton(AF_INET, ip.c_str(), &addr_.in.sin_addr) != 1)
+        {
+            LOG_ERROR("invalid ipv4 address %s \n", ip.c_str());
+        }
+        len_ = sizeof(sockaddr_in);
+    }
+}
 
+InetAddress::InetAddress(const sockaddr_in &addr)
+{
+    bzero(&addr_, sizeof(addr_));
+    addr_.in = addr;
+    len_ = sizeof(sockaddr_in);
+}
+
+InetAddress::InetAddress(const sockaddr_in6 &addr)
+{
+    bzero(&addr_, sizeof(addr_));
+    addr_.in6 = addr;
+    len_ = sizeof(sockaddr_in6);
+}
+
+InetAddress InetAddress::UnixDomain(const std::string &path)
+{
+    InetAddress addr;
+    bzero(&addr.addr_, sizeof(addr.addr_));
+    addr.addr_.un.sun_family = AF_UNIX;
+
+    size_t len = std::min(path.size(), sizeof(addr.addr_.un.sun_path) - 1);
+    if (len < path.size())
+    {
+        LOG_ERROR("unix socket path too long: %s \n", path.c_str());
+    }
+    memcpy(addr.addr_.un.sun_path, path.data(), len);
+
+    if (len > 0 && path[0] == '@')
+    {
+        // 抽象命名空间：第一个字节是 0，长度不包含结尾的 0
+        addr.addr_.un.sun_path[0] = '\0';
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len);
+    }
+    else
+    {
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len + 1);
+    }
+    return addr;
+}
+
+bool InetAddress::is_abstract() const
+{
+    return is_unix() && len_ > offsetof(sockaddr_un, sun_path) && addr_.un.sun_path[0] == '\0';
+}
+
+void InetAddress::set_sock_addr(const sockaddr *addr, socklen_t len)
+{
+    bzero(&addr_, sizeof(addr_));
+    len_ = std::min(len, static_cast<socklen_t>(sizeof(addr_)));
+    memcpy(&addr_, addr, len_);
 }
 
 std::string InetAddress::ToIp() const
 {
-    // addr_
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &sock_addr_.sin_addr, buf, sizeof(buf));
-    return buf;
+    char buf[128] = {0};
+    switch (family())
+    {
+    case AF_INET:
+        ::inet_ntop(AF_INET, &addr_.in.sin_addr, buf, sizeof(buf));
+        return buf;
+    case AF_INET6:
+        ::inet_ntop(AF_INET6, &addr_.in6.sin6_addr, buf, sizeof(buf));
+        return buf;
+    case AF_UNIX:
+        {
+            // 对端一般是未绑定的匿名地址，长度只有 sun_family
+            if (len_ <= offsetof(sockaddr_un, sun_path))
+            {
+                return std::string();
+            }
+            size_t path_len = len_ - offsetof(sockaddr_un, sun_path);
+            if (addr_.un.sun_path[0] == '\0')
+            {
+                return "@" + std::string(addr_.un.sun_path + 1, path_len - 1);
+            }
+            return std::string(addr_.un.sun_path, strnlen(addr_.un.sun_path, path_len));
+        }
+    default:
+        return std::string();
+    }
 }
 
 std::string InetAddress::ToIpPort() const
 {
-    // ip:port
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &sock_addr_.sin_addr, buf, sizeof buf);
-    size_t end = strlen(buf);
-    uint16_t port = ntohs(sock_addr_.sin_port);
-    sprintf(buf + end, ":%u", port);
-    return buf;
+    // ip:port，IPv6 写成 [ip]:port，Unix 域只有路径
+    switch (family())
+    {
+    case AF_INET:
+        return ToIp() + ":" + std::to_string(ToPort());
+    case AF_INET6:
+        return "[" + ToIp() + "]:" + std::to_string(ToPort());
+    case AF_UNIX:
+        return "unix:" + ToIp();
+    default:
+        return std::string();
+    }
 }
 
 uint16_t InetAddress::ToPort() const
 {
-    return ntohs(sock_addr_.sin_port);
-}
\ No newline at end of file
+    switch (family())
+    {
+    case AF_INET:
+        return ntohs(addr_.in.sin_port);
+    case AF_INET6:
+        return ntohs(addr_.in6.sin6_port);
+    default:
+        return 0;
+    }
+}
@@ -2,23 +2,43 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-// 封装socket地址类型
+/**
+ * 封装socket地址类型，支持 IPv4、IPv6 和 Unix 域套接字
+ * Unix 域地址的路径以 '@' 开头时表示 Linux 的抽象命名空间，不在文件系统中创建文件
+ */ 
 class InetAddress
 {
 public:
-    explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr)
-        : sock_addr_(addr)
-    {}
+    // ip 中含有 ':' 时按 IPv6 解析
+    explicit InetAddress(uint16_t port = 0, const std::string &ip = "0.0.0.0");
+    explicit InetAddress(const sockaddr_in &addr);
+    explicit InetAddress(const sockaddr_in6 &addr);
 
+    static InetAddress UnixDomain(const std::string &path);
+
+    sa_family_t family() const { return addr_.sa.sa_family; }
+    bool is_unix() const { return family() == AF_UNIX; }
+    bool is_abstract() const;
+
+    // Unix 域地址返回路径，抽象地址以 '@' 开头
     std::string ToIp() const;
     std::string ToIpPort() const;
     uint16_t ToPort() const;
 
-    const sockaddr_in* sock_addr() const {return &sock_addr_;}
-    void set_sock_addr(const sockaddr_in &addr) { sock_addr_ = addr; }
+    const sockaddr* sock_addr() const { return &addr_.sa; }
+    socklen_t sock_len() const { return len_; }
+    void set_sock_addr(const sockaddr *addr, socklen_t len);
 private:
-    sockaddr_in sock_addr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr sa;
+        sockaddr_in in;
+        sockaddr_in6 in6;
+        sockaddr_un un;
+    } addr_;
+    socklen_t len_;
+};
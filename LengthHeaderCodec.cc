@@ -0,0 +1,49 @@
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <string>
+#include <endian.h>
+
+void LengthHeaderCodec::OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receive_time)
+{
+    // 一次可能收到多个完整的消息，也可能只收到半个
+    while (buf->readableBytes() >= kHeaderLen)
+    {
+        const int32_t len = buf->peekInt32();
+        if (len < 0 || len > max_message_len_)
+        {
+            LOG_ERROR("LengthHeaderCodec invalid length %d from [%s] \n", len, conn->name().c_str());
+            buf->retrieveAll();
+            conn->Shutdown();
+            break;
+        }
+
+        if (buf->readableBytes() < kHeaderLen + len)
+        {
+            break;
+        }
+
+        message_callback_(conn, StringPiece(buf->peek() + kHeaderLen, len), receive_time);
+        buf->retrieve(kHeaderLen + len);
+    }
+}
+
+void LengthHeaderCodec::Send(const TcpConnectionPtr &conn, Buffer *message)
+{
+    int32_t len = static_cast<int32_t>(message->readableBytes());
+    message->prependInt32(len);
+    conn->Send(message);
+}
+
+void LengthHeaderCodec::Send(const TcpConnectionPtr &conn, StringPiece message)
+{
+    // 长度头和消息体拼在一个 string 里，消息体只拷贝一次
+    int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(message.size())));
+    std::string frame;
+    frame.reserve(kHeaderLen + message.size());
+    frame.append(reinterpret_cast<const char*>(&be32), kHeaderLen);
+    frame.append(message.data(), message.size());
+    conn->Send(frame);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * 4 字节长度头（网络字节序）+ 消息体 的分包编解码
+ * 
+ * 接收：把 OnMessage 设置为 TcpServer 的 message callback，
+ *       每个完整的消息以 StringPiece 的形式直接指向 input buffer 交给用户，不做拷贝，
+ *       StringPiece 只在回调期间有效
+ * 发送：消息写在 Buffer 里，长度头直接写到 Buffer 的 prepend 空间中，不移动消息体
+ */ 
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using StringPieceMessageCallback = std::function<void (const TcpConnectionPtr&,
+                                                        StringPiece,
+                                                        Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+
+    explicit LengthHeaderCodec(const StringPieceMessageCallback &cb,
+                            int32_t max_message_len = 64 * 1024 * 1024)
+        : message_callback_(cb)
+        , max_message_len_(max_message_len)
+    {}
+
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receive_time);
+
+    // 原地加上长度头以后发送，message 的 prependableBytes() 至少要有 kHeaderLen
+    void Send(const TcpConnectionPtr &conn, Buffer *message);
+    void Send(const TcpConnectionPtr &conn, StringPiece message);
+private:
+    StringPieceMessageCallback message_callback_;
+    const int32_t max_message_len_;
+};
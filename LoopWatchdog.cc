@@ -0,0 +1,98 @@
+#include "LoopWatchdog.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+
+LoopWatchdog::LoopWatchdog(int deadline_ms)
+    : deadline_ms_(deadline_ms)
+    , thread_(std::bind(&LoopWatchdog::ThreadFunc, this), "LoopWatchdog")
+    , running_(false)
+{}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    Stop();
+}
+
+void LoopWatchdog::Watch(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    WatchedLoop watched = {loop, -1};
+    loops_.push_back(watched);
+}
+
+void LoopWatchdog::Unwatch(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+        [loop](const WatchedLoop &watched) { return watched.loop == loop; }), loops_.end());
+}
+
+void LoopWatchdog::Start()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (running_)
+        {
+            return;
+        }
+        running_ = true;
+    }
+    thread_.Start();
+}
+
+void LoopWatchdog::Stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+        cond_.notify_one();
+    }
+    thread_.Join();
+}
+
+void LoopWatchdog::ThreadFunc()
+{
+    // 检查间隔取 deadline 的四分之一，卡住的 loop 最迟在 1.25 倍 deadline 内被发现
+    const int check_interval_ms = std::max(1, deadline_ms_ / 4);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, std::chrono::milliseconds(check_interval_ms));
+
+        int64_t now_us = MonotonicMicros();
+        for (WatchedLoop &watched : loops_)
+        {
+            Check(&watched, now_us);
+        }
+    }
+}
+
+void LoopWatchdog::Check(WatchedLoop *watched, int64_t now_us)
+{
+    LoopActivity activity;
+    if (!watched->loop->ReadActivity(&activity))
+    {
+        return;
+    }
+
+    int64_t iteration_ms = (now_us - activity.iteration_start_us) / 1000;
+    if (iteration_ms < deadline_ms_ || activity.iteration == watched->reported_iteration)
+    {
+        return;
+    }
+    watched->reported_iteration = activity.iteration;
+
+    LOG_ERROR("LoopWatchdog: EventLoop %p (tid %d) stalled, iteration running %ld ms, "
+        "current callback fd=%d [%s] running %ld ms \n",
+        watched->loop, watched->loop->thread_id(), static_cast<long>(iteration_ms),
+        activity.fd, activity.name,
+        static_cast<long>((now_us - activity.callback_start_us) / 1000));
+}
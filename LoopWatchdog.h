@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 检测卡住的 EventLoop：独立的线程定期检查每个 loop，
+ * 如果某一轮循环超过 deadline 还没有结束，输出这个 loop 当前正在执行的回调
+ * 同一轮循环只报告一次
+ */ 
+class LoopWatchdog : noncopyable
+{
+public:
+    explicit LoopWatchdog(int deadline_ms);
+    ~LoopWatchdog();
+
+    // 要在 loop 析构之前 Unwatch 或者 Stop
+    void Watch(EventLoop *loop);
+    void Unwatch(EventLoop *loop);
+
+    void Start();
+    void Stop();
+
+    int deadline_ms() const { return deadline_ms_; }
+private:
+    struct WatchedLoop
+    {
+        EventLoop *loop;
+        int64_t reported_iteration;     // 已经报告过的那一轮，避免重复输出
+    };
+
+    void ThreadFunc();
+    void Check(WatchedLoop *watched, int64_t now_us);
+
+    const int deadline_ms_;
+    Thread thread_;
+    bool running_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<WatchedLoop> loops_;
+};
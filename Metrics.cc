@@ -0,0 +1,150 @@
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+HistogramSnapshot::HistogramSnapshot()
+    : count(0)
+    , sum(0)
+{
+    memset(buckets, 0, sizeof buckets);
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot &other)
+{
+    count += other.count;
+    sum += other.sum;
+    for (int i = 0; i < kNumBuckets; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+void Histogram::Snapshot(HistogramSnapshot *snapshot) const
+{
+    snapshot->count = 0;
+    for (int i = 0; i < kNumBuckets; ++i)
+    {
+        snapshot->buckets[i] = buckets_[i].value();
+        snapshot->count += snapshot->buckets[i];
+    }
+    snapshot->sum = sum_.value();
+}
+
+LoopStats::LoopStats()
+    : loop_iterations(0)
+    , poll_events(0)
+    , bytes_read(0)
+    , bytes_written(0)
+    , functors_run(0)
+    , functor_budget_exhausted(0)
+    , idle_functors_run(0)
+    , epoll_ctl_calls(0)
+    , accepts(0)
+    , closes(0)
+    , connections(0)
+    , output_bytes_pending(0)
+{}
+
+void LoopStats::Merge(const LoopStats &other)
+{
+    loop_iterations += other.loop_iterations;
+    poll_events += other.poll_events;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    functors_run += other.functors_run;
+    functor_budget_exhausted += other.functor_budget_exhausted;
+    idle_functors_run += other.idle_functors_run;
+    epoll_ctl_calls += other.epoll_ctl_calls;
+    accepts += other.accepts;
+    closes += other.closes;
+    connections += other.connections;
+    output_bytes_pending += other.output_bytes_pending;
+
+    events_per_poll.Merge(other.events_per_poll);
+    iteration_us.Merge(other.iteration_us);
+    callback_us.Merge(other.callback_us);
+    queue_depth.Merge(other.queue_depth);
+    queue_wait_us.Merge(other.queue_wait_us);
+}
+
+void LoopMetrics::Snapshot(LoopStats *stats) const
+{
+    stats->loop_iterations = loop_iterations.value();
+    stats->poll_events = poll_events.value();
+    stats->bytes_read = bytes_read.value();
+    stats->bytes_written = bytes_written.value();
+    stats->functors_run = functors_run.value();
+    stats->functor_budget_exhausted = functor_budget_exhausted.value();
+    stats->idle_functors_run = idle_functors_run.value();
+    stats->epoll_ctl_calls = epoll_ctl_calls.value();
+    stats->accepts = accepts.value();
+    stats->closes = closes.value();
+    stats->connections = connections.value();
+    stats->output_bytes_pending = output_bytes_pending.value();
+
+    events_per_poll.Snapshot(&stats->events_per_poll);
+    iteration_us.Snapshot(&stats->iteration_us);
+    callback_us.Snapshot(&stats->callback_us);
+    queue_depth.Snapshot(&stats->queue_depth);
+    queue_wait_us.Snapshot(&stats->queue_wait_us);
+}
+
+static void AppendMetric(std::string *out, const char *name, const char *type,
+                        const std::string &server, int64_t value)
+{
+    char buf[256] = {0};
+    snprintf(buf, sizeof buf, "# TYPE simple_muduo_%s %s\nsimple_muduo_%s{server=\"%s\"} %lld\n",
+        name, type, name, server.c_str(), static_cast<long long>(value));
+    out->append(buf);
+}
+
+static void AppendHistogram(std::string *out, const char *name,
+                        const std::string &server, const HistogramSnapshot &histogram)
+{
+    char buf[256] = {0};
+    snprintf(buf, sizeof buf, "# TYPE simple_muduo_%s histogram\n", name);
+    out->append(buf);
+
+    // Prometheus 的桶是累计的
+    int64_t cumulative = 0;
+    for (int i = 0; i < HistogramSnapshot::kNumBuckets - 1; ++i)
+    {
+        cumulative += histogram.buckets[i];
+        snprintf(buf, sizeof buf, "simple_muduo_%s_bucket{server=\"%s\",le=\"%lld\"} %lld\n",
+            name, server.c_str(), static_cast<long long>(HistogramSnapshot::UpperBound(i)),
+            static_cast<long long>(cumulative));
+        out->append(buf);
+    }
+
+    snprintf(buf, sizeof buf, "simple_muduo_%s_bucket{server=\"%s\",le=\"+Inf\"} %lld\n"
+        "simple_muduo_%s_sum{server=\"%s\"} %lld\nsimple_muduo_%s_count{server=\"%s\"} %lld\n",
+        name, server.c_str(), static_cast<long long>(histogram.count),
+        name, server.c_str(), static_cast<long long>(histogram.sum),
+        name, server.c_str(), static_cast<long long>(histogram.count));
+    out->append(buf);
+}
+
+std::string RenderPrometheus(const std::string &server, const LoopStats &stats)
+{
+    std::string out;
+    AppendMetric(&out, "loop_iterations_total", "counter", server, stats.loop_iterations);
+    AppendMetric(&out, "poll_events_total", "counter", server, stats.poll_events);
+    AppendMetric(&out, "bytes_read_total", "counter", server, stats.bytes_read);
+    AppendMetric(&out, "bytes_written_total", "counter", server, stats.bytes_written);
+    AppendMetric(&out, "functors_run_total", "counter", server, stats.functors_run);
+    AppendMetric(&out, "functor_budget_exhausted_total", "counter", server, stats.functor_budget_exhausted);
+    AppendMetric(&out, "idle_functors_run_total", "counter", server, stats.idle_functors_run);
+    AppendMetric(&out, "epoll_ctl_calls_total", "counter", server, stats.epoll_ctl_calls);
+    AppendMetric(&out, "accepts_total", "counter", server, stats.accepts);
+    AppendMetric(&out, "closes_total", "counter", server, stats.closes);
+    AppendMetric(&out, "connections", "gauge", server, stats.connections);
+    AppendMetric(&out, "output_bytes_pending", "gauge", server, stats.output_bytes_pending);
+
+    AppendHistogram(&out, "events_per_poll", server, stats.events_per_poll);
+    AppendHistogram(&out, "loop_iteration_us", server, stats.iteration_us);
+    AppendHistogram(&out, "callback_us", server, stats.callback_us);
+    AppendHistogram(&out, "queue_depth", server, stats.queue_depth);
+    AppendHistogram(&out, "queue_wait_us", server, stats.queue_wait_us);
+    return out;
+}
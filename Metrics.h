@@ -0,0 +1,145 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+// 单调时钟，单位微秒，用于统计耗时
+inline int64_t MonotonicMicros()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * 单写者计数器：只允许所属 loop 线程修改，其它线程可以随时无锁读取
+ * 只有一个写者，所以用 load + store 代替带 lock 前缀的 fetch_add
+ * 值可以减小，也可以当作 gauge 使用
+ */ 
+class Counter : noncopyable
+{
+public:
+    Counter() : value_(0) {}
+
+    void Add(int64_t n)
+    {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void Increment() { Add(1); }
+
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<int64_t> value_;
+};
+
+struct HistogramSnapshot
+{
+    static const int kNumBuckets = 32;
+
+    HistogramSnapshot();
+    void Merge(const HistogramSnapshot &other);
+
+    // 第 i 个桶的上界（包含），值都是整数，[2^(i-1), 2^i) 的上界是 2^i - 1，最后一个桶为 +Inf
+    static int64_t UpperBound(int i) { return (static_cast<int64_t>(1) << i) - 1; }
+
+    int64_t count;
+    int64_t sum;
+    int64_t buckets[kNumBuckets];
+};
+
+// 以 2 的幂划分桶的直方图，同样是单写者
+class Histogram : noncopyable
+{
+public:
+    static const int kNumBuckets = HistogramSnapshot::kNumBuckets;
+
+    void Record(int64_t value)
+    {
+        buckets_[BucketOf(value)].Increment();
+        sum_.Add(value);
+    }
+
+    void Snapshot(HistogramSnapshot *snapshot) const;
+    int64_t sum() const { return sum_.value(); }
+private:
+    // 第 i 个桶记录 [2^(i-1), 2^i) 范围内的值，第 0 个桶记录 <= 0 的值
+    static int BucketOf(int64_t value)
+    {
+        if (value <= 0)
+        {
+            return 0;
+        }
+        int bucket = 64 - __builtin_clzll(static_cast<uint64_t>(value));
+        return bucket < kNumBuckets ? bucket : kNumBuckets - 1;
+    }
+
+    Counter buckets_[kNumBuckets];
+    Counter sum_;
+};
+
+// 某一时刻的统计快照，可以跨 loop 累加
+struct LoopStats
+{
+    LoopStats();
+    void Merge(const LoopStats &other);
+
+    int64_t loop_iterations;
+    int64_t poll_events;
+    int64_t bytes_read;
+    int64_t bytes_written;
+    int64_t functors_run;
+    int64_t functor_budget_exhausted;
+    int64_t idle_functors_run;
+    int64_t epoll_ctl_calls;
+    int64_t accepts;
+    int64_t closes;
+    int64_t connections;
+    int64_t output_bytes_pending;
+
+    HistogramSnapshot events_per_poll;
+    HistogramSnapshot iteration_us;
+    HistogramSnapshot callback_us;
+    HistogramSnapshot queue_depth;
+    HistogramSnapshot queue_wait_us;
+};
+
+/**
+ * 每个 EventLoop 一份的统计数据，只由 loop 线程写入
+ * 前后各填充一个 cache line，避免和相邻 loop 的数据产生伪共享
+ */ 
+struct LoopMetrics : noncopyable
+{
+    static const size_t kCacheLineSize = 64;
+
+    void Snapshot(LoopStats *stats) const;
+
+    char pad_front_[kCacheLineSize];
+
+    Counter loop_iterations;
+    Counter poll_events;            // epoll_wait 返回的事件总数
+    Counter bytes_read;             // 从 socket 读到的字节数
+    Counter bytes_written;          // 写入 socket 的字节数
+    Counter functors_run;           // 执行的 pending functor 个数
+    Counter functor_budget_exhausted; // 预算用完、还有 functor 留到下一轮的次数
+    Counter idle_functors_run;      // 执行的空闲任务个数
+    Counter epoll_ctl_calls;
+    Counter accepts;
+    Counter closes;
+    Counter connections;            // gauge，当前连接数
+    Counter output_bytes_pending;   // gauge，所有连接 output buffer 中待发送的字节数
+
+    Histogram events_per_poll;      // 每次 epoll_wait 返回的事件个数
+    Histogram iteration_us;         // 每轮循环除去 epoll_wait 以外的耗时
+    Histogram callback_us;          // 每个 Channel::HandleEvent 的耗时
+    Histogram queue_depth;          // 每次 DoPendingFunctors 取出的 functor 个数
+    Histogram queue_wait_us;        // 每批 functor 中最早入队的那个等待的时间
+
+    char pad_back_[kCacheLineSize];
+};
+
+// 按 Prometheus 文本格式输出，server 作为 label
+std::string RenderPrometheus(const std::string &server, const LoopStats &stats);
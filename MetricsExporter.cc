@@ -0,0 +1,49 @@
+#include "MetricsExporter.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+MetricsExporter::MetricsExporter(EventLoop *loop,
+                const InetAddress &listen_addr,
+                const std::string &name,
+                const RenderCallback &render)
+    : server_(loop, listen_addr, name)
+    , render_(render)
+{
+    server_.set_connection_callback(
+        std::bind(&MetricsExporter::OnConnection, this, std::placeholders::_1)
+    );
+    server_.set_message_callback(
+        std::bind(&MetricsExporter::OnMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+    );
+}
+
+void MetricsExporter::OnConnection(const TcpConnectionPtr &conn)
+{
+    LOG_INFO("MetricsExporter connection %s %s \n", conn->name().c_str(), conn->connected() ? "up" : "down");
+}
+
+void MetricsExporter::OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    // 不关心请求的路径，等请求头收完整就返回
+    static const char kHeaderEnd[] = "\r\n\r\n";
+    const char *data_end = buf->peek() + buf->readableBytes();
+    const char *end = std::search(buf->peek(), data_end, kHeaderEnd, kHeaderEnd + 4);
+    if (end == data_end)
+    {
+        return;
+    }
+    buf->retrieveAll();
+
+    std::string body = render_();
+    char header[128] = {0};
+    snprintf(header, sizeof header,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %lu\r\n"
+        "Connection: close\r\n\r\n", static_cast<unsigned long>(body.size()));
+
+    conn->Send(header + body);
+    conn->Shutdown();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * 在单独的端口上以 Prometheus 文本格式输出统计数据
+ * 运行在 baseloop 上，收到一个完整的 HTTP 请求就返回一次渲染结果然后关闭连接
+ */ 
+class MetricsExporter : noncopyable
+{
+public:
+    using RenderCallback = std::function<std::string()>;
+
+    MetricsExporter(EventLoop *loop,
+                const InetAddress &listen_addr,
+                const std::string &name,
+                const RenderCallback &render);
+
+    void Start() { server_.Start(); }
+private:
+    void OnConnection(const TcpConnectionPtr &conn);
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+
+    TcpServer server_;
+    RenderCallback render_;
+};
@@ -31,7 +31,7 @@ protected:
     // key：sockfd
     using ChannelMap = std::unordered_map<int, Channel*>;
     ChannelMap channels_;
-private:
+
     // 定义 Poller 所属的事件循环 EventLoop
     EventLoop *owner_loop_; 
 };
\ No newline at end of file
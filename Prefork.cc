@@ -0,0 +1,465 @@
+#include "Prefork.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "TcpServer.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+/**
+ * 每个 worker 一个槽位，放在共享内存中
+ * stats 由 worker 的 baseloop 单独写，用 seqlock 保护：写之前 sequence 变成奇数，写完变回偶数
+ */
+struct PreforkSlot
+{
+    std::atomic<uint32_t> sequence;
+    std::atomic<int> pid;
+    std::atomic<int64_t> restarts;
+    std::atomic<int64_t> heartbeat_us;      // 最近一次写统计的时间，0 表示 worker 还没有 Attach
+    LoopStats stats;
+
+    char pad_[LoopMetrics::kCacheLineSize];
+};
+
+static const double kPublishInterval = 1.0;
+static const int64_t kMinHealthyMicros = 1000 * 1000;       // 活不到 1 秒就退出的 worker 重启时退避
+static const int64_t kMinBackoffMicros = 100 * 1000;
+static const int64_t kMaxBackoffMicros = 10 * 1000 * 1000;
+static const int64_t kMaxWaitMicros = 1000 * 1000;
+static const int kMaxReadRetries = 100;
+
+// worker 中由 signalfd 接收，监督进程中由 sigtimedwait 接收，两边都阻塞这些信号
+static void ForwardedSignals(sigset_t *set)
+{
+    ::sigemptyset(set);
+    ::sigaddset(set, SIGTERM);
+    ::sigaddset(set, SIGINT);
+    ::sigaddset(set, SIGHUP);
+    ::sigaddset(set, SIGUSR1);
+    ::sigaddset(set, SIGUSR2);
+}
+
+static void WriteSlotStats(PreforkSlot *slot, const LoopStats &stats)
+{
+    uint32_t seq = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    ::memcpy(&slot->stats, &stats, sizeof stats);
+    slot->sequence.store(seq + 2, std::memory_order_release);
+}
+
+// worker 在写的过程中被杀掉时 sequence 一直是奇数，重试若干次后放弃
+static bool ReadSlotStats(const PreforkSlot *slot, LoopStats *stats)
+{
+    for (int i = 0; i < kMaxReadRetries; ++i)
+    {
+        uint32_t before = slot->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        ::memcpy(stats, &slot->stats, sizeof *stats);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+PreforkWorker::PreforkWorker(int index, PreforkSlot *slot)
+    : index_(index)
+    , slot_(slot)
+    , loop_(nullptr)
+    , server_(nullptr)
+    , drain_seconds_(0)
+    , signal_fd_(-1)
+{
+}
+
+PreforkWorker::~PreforkWorker()
+{
+    if (signal_fd_ >= 0)
+    {
+        ::close(signal_fd_);
+    }
+}
+
+void PreforkWorker::Attach(EventLoop *loop, TcpServer *server, double drain_seconds)
+{
+    loop_ = loop;
+    server_ = server;
+    drain_seconds_ = drain_seconds;
+
+    // 这些信号从 fork 开始就是阻塞的，所有线程都继承，这里统一由 signalfd 读取
+    sigset_t set;
+    ForwardedSignals(&set);
+    signal_fd_ = ::signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0)
+    {
+        LOG_ERROR("signalfd error:%d \n", errno);
+    }
+    else
+    {
+        signal_channel_.reset(new Channel(loop, signal_fd_));
+        signal_channel_->set_name("prefork signal");
+        signal_channel_->set_read_callback(std::bind(&PreforkWorker::HandleSignal, this));
+        signal_channel_->EnableReading();
+    }
+
+    PublishStats();
+    loop->RunEvery(kPublishInterval, std::bind(&PreforkWorker::PublishStats, this));
+}
+
+void PreforkWorker::HandleSignal()
+{
+    signalfd_siginfo info;
+    while (::read(signal_fd_, &info, sizeof info) == sizeof info)
+    {
+        int signo = static_cast<int>(info.ssi_signo);
+        if (signo == SIGTERM || signo == SIGINT)
+        {
+            LOG_INFO("prefork worker %d got signal %d, draining \n", index_, signo);
+            EventLoop *loop = loop_;
+            server_->GracefulShutdown(drain_seconds_, [loop]() { loop->Quit(); });
+        }
+        else if (signal_callback_)
+        {
+            signal_callback_(signo);
+        }
+    }
+}
+
+void PreforkWorker::PublishStats()
+{
+    WriteSlotStats(slot_, server_->StatsSnapshot());
+    slot_->heartbeat_us.store(MonotonicMicros(), std::memory_order_release);
+}
+
+PreforkSupervisor::PreforkSupervisor(int num_workers, const WorkerMain &worker_main)
+    : num_workers_(num_workers < 1 ? 1 : (num_workers > kMaxWorkers ? kMaxWorkers : num_workers))
+    , worker_main_(worker_main)
+    , stats_interval_(10.0)
+    , shutdown_timeout_(60.0)
+    , hang_timeout_(0)
+    , slots_(nullptr)
+    , slots_size_(sizeof(PreforkSlot) * num_workers_)
+    , workers_(num_workers_)
+    , stopping_(false)
+{
+    void *mem = ::mmap(nullptr, slots_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap prefork slots error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    slots_ = static_cast<PreforkSlot*>(mem);
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        PreforkSlot *slot = new (&slots_[i]) PreforkSlot;
+        slot->sequence.store(0);
+        slot->pid.store(0);
+        slot->restarts.store(0);
+        slot->heartbeat_us.store(0);
+
+        workers_[i].pid = 0;
+        workers_[i].started_us = 0;
+        workers_[i].respawn_at_us = 0;
+        workers_[i].backoff_us = 0;
+    }
+}
+
+PreforkSupervisor::~PreforkSupervisor()
+{
+    ::munmap(slots_, slots_size_);
+}
+
+void PreforkSupervisor::Spawn(int index)
+{
+    PreforkSlot *slot = &slots_[index];
+    // 上一个 worker 可能死在写统计的中途
+    uint32_t seq = slot->sequence.load();
+    if (seq & 1)
+    {
+        slot->sequence.store(seq + 1);
+    }
+    slot->heartbeat_us.store(0);
+
+    // 避免缓冲区中还没输出的日志在子进程中再输出一次
+    ::fflush(stdout);
+    std::cout.flush();
+
+    pid_t parent = ::getpid();
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("prefork fork worker %d error:%d \n", index, errno);
+        workers_[index].respawn_at_us = MonotonicMicros() + kMinBackoffMicros;
+        return;
+    }
+
+    if (pid == 0)
+    {
+        // 监督进程退出时 worker 也退出
+        ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (::getppid() != parent)
+        {
+            ::_exit(1);
+        }
+        sigset_t chld;
+        ::sigemptyset(&chld);
+        ::sigaddset(&chld, SIGCHLD);
+        ::sigprocmask(SIG_UNBLOCK, &chld, nullptr);
+
+        slot->pid.store(::getpid());
+        int code = 0;
+        {
+            PreforkWorker worker(index, slot);
+            code = worker_main_(&worker);
+        }
+        ::fflush(stdout);
+        std::cout.flush();
+        ::_exit(code);
+    }
+
+    LOG_INFO("prefork started worker %d pid %d \n", index, pid);
+    workers_[index].pid = pid;
+    workers_[index].started_us = MonotonicMicros();
+    workers_[index].respawn_at_us = 0;
+}
+
+void PreforkSupervisor::ReapChildren()
+{
+    int status = 0;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        int index = -1;
+        for (int i = 0; i < num_workers_; ++i)
+        {
+            if (workers_[i].pid == pid)
+            {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0)
+        {
+            continue;
+        }
+
+        if (WIFSIGNALED(status))
+        {
+            LOG_ERROR("prefork worker %d pid %d killed by signal %d \n", index, pid, WTERMSIG(status));
+        }
+        else
+        {
+            LOG_INFO("prefork worker %d pid %d exited with %d \n", index, pid, WEXITSTATUS(status));
+        }
+
+        WorkerProcess &worker = workers_[index];
+        worker.pid = 0;
+        slots_[index].pid.store(0);
+        if (stopping_)
+        {
+            continue;
+        }
+
+        int64_t now = MonotonicMicros();
+        if (now - worker.started_us < kMinHealthyMicros)
+        {
+            worker.backoff_us = worker.backoff_us == 0 ? kMinBackoffMicros : worker.backoff_us * 2;
+            if (worker.backoff_us > kMaxBackoffMicros)
+            {
+                worker.backoff_us = kMaxBackoffMicros;
+            }
+        }
+        else
+        {
+            worker.backoff_us = 0;
+        }
+        worker.respawn_at_us = now + worker.backoff_us;
+        slots_[index].restarts.fetch_add(1);
+    }
+}
+
+void PreforkSupervisor::RespawnDue(int64_t now)
+{
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        if (workers_[i].pid == 0 && workers_[i].respawn_at_us > 0 && now >= workers_[i].respawn_at_us)
+        {
+            Spawn(i);
+        }
+    }
+}
+
+void PreforkSupervisor::CheckHung(int64_t now)
+{
+    if (hang_timeout_ <= 0)
+    {
+        return;
+    }
+    int64_t limit = static_cast<int64_t>(hang_timeout_ * 1000 * 1000);
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        int64_t heartbeat = slots_[i].heartbeat_us.load(std::memory_order_acquire);
+        if (workers_[i].pid > 0 && heartbeat > 0 && now - heartbeat > limit)
+        {
+            LOG_ERROR("prefork worker %d pid %d hung for %ld ms, killing \n",
+                i, workers_[i].pid, static_cast<long>((now - heartbeat) / 1000));
+            ::kill(workers_[i].pid, SIGKILL);
+            slots_[i].heartbeat_us.store(0);
+        }
+    }
+}
+
+void PreforkSupervisor::ForwardSignal(int signo)
+{
+    for (const WorkerProcess &worker : workers_)
+    {
+        if (worker.pid > 0)
+        {
+            ::kill(worker.pid, signo);
+        }
+    }
+}
+
+int64_t PreforkSupervisor::NextWakeup(int64_t now) const
+{
+    int64_t wakeup = now + kMaxWaitMicros;
+    for (const WorkerProcess &worker : workers_)
+    {
+        if (worker.pid == 0 && worker.respawn_at_us > 0 && worker.respawn_at_us < wakeup)
+        {
+            wakeup = worker.respawn_at_us;
+        }
+    }
+    return wakeup;
+}
+
+int PreforkSupervisor::Run()
+{
+    sigset_t set;
+    ForwardedSignals(&set);
+    ::sigaddset(&set, SIGCHLD);
+    sigset_t old_set;
+    ::sigprocmask(SIG_BLOCK, &set, &old_set);
+
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        Spawn(i);
+    }
+
+    int64_t stats_interval_us = static_cast<int64_t>(stats_interval_ * 1000 * 1000);
+    int64_t next_stats = MonotonicMicros() + stats_interval_us;
+    int64_t kill_at = 0;
+    while (true)
+    {
+        bool any_alive = false;
+        for (const WorkerProcess &worker : workers_)
+        {
+            any_alive = any_alive || worker.pid > 0;
+        }
+        if (stopping_ && !any_alive)
+        {
+            break;
+        }
+
+        int64_t now = MonotonicMicros();
+        int64_t wait_us = NextWakeup(now) - now;
+        if (stats_callback_ && next_stats - now < wait_us)
+        {
+            wait_us = next_stats - now;
+        }
+        if (wait_us < 0)
+        {
+            wait_us = 0;
+        }
+        timespec timeout;
+        timeout.tv_sec = wait_us / (1000 * 1000);
+        timeout.tv_nsec = (wait_us % (1000 * 1000)) * 1000;
+
+        int signo = ::sigtimedwait(&set, nullptr, &timeout);
+        if (signo == SIGTERM || signo == SIGINT)
+        {
+            if (!stopping_)
+            {
+                LOG_INFO("prefork supervisor got signal %d, stopping workers \n", signo);
+                stopping_ = true;
+                kill_at = MonotonicMicros() + static_cast<int64_t>(shutdown_timeout_ * 1000 * 1000);
+            }
+            ForwardSignal(signo);
+        }
+        else if (signo == SIGHUP || signo == SIGUSR1 || signo == SIGUSR2)
+        {
+            ForwardSignal(signo);
+        }
+
+        // SIGCHLD 会合并，每一轮都回收一次
+        ReapChildren();
+
+        now = MonotonicMicros();
+        if (!stopping_)
+        {
+            RespawnDue(now);
+            CheckHung(now);
+        }
+        else if (kill_at > 0 && now >= kill_at)
+        {
+            LOG_ERROR("prefork workers did not exit in %.1fs, killing \n", shutdown_timeout_);
+            ForwardSignal(SIGKILL);
+            kill_at = 0;
+        }
+
+        if (stats_callback_ && now >= next_stats)
+        {
+            stats_callback_(StatsSnapshot());
+            next_stats = now + stats_interval_us;
+        }
+    }
+
+    ::sigprocmask(SIG_SETMASK, &old_set, nullptr);
+    return 0;
+}
+
+LoopStats PreforkSupervisor::StatsSnapshot() const
+{
+    LoopStats total;
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        LoopStats stats;
+        if (ReadSlotStats(&slots_[i], &stats))
+        {
+            total.Merge(stats);
+        }
+    }
+    return total;
+}
+
+std::string PreforkSupervisor::RenderMetrics(const std::string &server) const
+{
+    return RenderPrometheus(server, StatsSnapshot());
+}
+
+int64_t PreforkSupervisor::restarts() const
+{
+    int64_t total = 0;
+    for (int i = 0; i < num_workers_; ++i)
+    {
+        total += slots_[i].restarts.load();
+    }
+    return total;
+}
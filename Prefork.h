@@ -0,0 +1,118 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Metrics.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sys/types.h>
+
+class EventLoop;
+class Channel;
+class TcpServer;
+struct PreforkSlot;
+
+/**
+ * worker 进程中的句柄，由 PreforkSupervisor 创建后传给 worker 的入口函数
+ * Attach 以后：定期把 server 的统计写到共享内存，收到 SIGTERM/SIGINT 时排空连接并退出 loop
+ */
+class PreforkWorker : noncopyable
+{
+public:
+    using SignalCallback = std::function<void(int signo)>;
+
+    PreforkWorker(int index, PreforkSlot *slot);
+    ~PreforkWorker();
+
+    // 第几个 worker，从 0 开始，重启后不变
+    int index() const { return index_; }
+
+    // 在 loop 线程中，server Start 之后、loop.Loop() 之前调用
+    void Attach(EventLoop *loop, TcpServer *server, double drain_seconds = 30.0);
+    // 监督进程转发过来的其它信号（SIGHUP、SIGUSR1、SIGUSR2），在 loop 线程中调用
+    void set_signal_callback(const SignalCallback &cb) { signal_callback_ = cb; }
+private:
+    void HandleSignal();
+    void PublishStats();
+
+    const int index_;
+    PreforkSlot *slot_;
+    EventLoop *loop_;
+    TcpServer *server_;
+    double drain_seconds_;
+    int signal_fd_;
+    std::unique_ptr<Channel> signal_channel_;
+    SignalCallback signal_callback_;
+};
+
+/**
+ * 多进程模式：监督进程 fork 出 N 个 worker，每个 worker 有自己的 EventLoop/线程池，
+ * 各自用 SO_REUSEPORT 监听同一个端口（TcpServer::kReusePort），由内核分配连接
+ *
+ * 监督进程不运行 EventLoop，只做三件事：
+ *   worker 退出（崩溃）后重新 fork，连续快速崩溃时退避
+ *   把收到的 SIGTERM/SIGINT/SIGHUP/SIGUSR1/SIGUSR2 转发给所有 worker，SIGTERM/SIGINT 时等 worker 全部退出后返回
+ *   从共享内存中汇总各个 worker 的统计
+ *
+ * 必须在创建任何线程和 EventLoop 之前构造并调用 Run
+ */
+class PreforkSupervisor : noncopyable
+{
+public:
+    // worker 的入口，在子进程中调用，返回值作为子进程的退出码
+    using WorkerMain = std::function<int(PreforkWorker*)>;
+    using StatsCallback = std::function<void(const LoopStats &total)>;
+
+    static const int kMaxWorkers = 256;
+
+    PreforkSupervisor(int num_workers, const WorkerMain &worker_main);
+    ~PreforkSupervisor();
+
+    // 每 interval 秒在监督进程中调用一次，参数是所有 worker 统计的和
+    void set_stats_callback(const StatsCallback &cb, double interval = 10.0)
+    {
+        stats_callback_ = cb;
+        stats_interval_ = interval;
+    }
+    // 收到 SIGTERM/SIGINT 以后等待 worker 退出的时间，超时 SIGKILL
+    void set_shutdown_timeout(double seconds) { shutdown_timeout_ = seconds; }
+    // worker 超过 seconds 秒没有更新统计时认为卡死，SIGKILL 后重启，0 表示不检查
+    void set_hang_timeout(double seconds) { hang_timeout_ = seconds; }
+
+    // 阻塞到收到 SIGTERM/SIGINT 并且所有 worker 退出，返回 0
+    int Run();
+
+    // 在监督进程中调用，worker 每秒更新一次；重启后的 worker 计数从 0 开始
+    LoopStats StatsSnapshot() const;
+    std::string RenderMetrics(const std::string &server) const;
+    int64_t restarts() const;
+private:
+    struct WorkerProcess
+    {
+        pid_t pid;
+        int64_t started_us;
+        int64_t respawn_at_us;      // 等待重启的时间点，0 表示不需要重启
+        int64_t backoff_us;
+    };
+
+    void Spawn(int index);
+    void ReapChildren();
+    void RespawnDue(int64_t now);
+    void CheckHung(int64_t now);
+    void ForwardSignal(int signo);
+    int64_t NextWakeup(int64_t now) const;
+
+    const int num_workers_;
+    WorkerMain worker_main_;
+    StatsCallback stats_callback_;
+    double stats_interval_;
+    double shutdown_timeout_;
+    double hang_timeout_;
+
+    PreforkSlot *slots_;            // MAP_SHARED 匿名映射，fork 以后父子进程共享
+    size_t slots_size_;
+    std::vector<WorkerProcess> workers_;
+    bool stopping_;
+};
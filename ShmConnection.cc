@@ -0,0 +1,441 @@
+#include "ShmConnection.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Socket.h"
+#include "Logger.h"
+
+#include <functional>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+
+static const char kSetupMessage[] = "SHM\n";
+
+static int CreateDoorbell()
+{
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("shm doorbell eventfd error:%d \n", errno);
+    }
+    return fd;
+}
+
+ShmConnectionPtr ShmConnection::Create(EventLoop *loop, const std::string &name,
+                                       int control_fd, size_t ring_size)
+{
+    size_t capacity = ShmRing::RoundCapacity(ring_size);
+    size_t mapped_size = 2 * ShmRing::MappedSize(capacity);
+
+    int memfd = ::memfd_create("simple_muduo_shm", MFD_CLOEXEC);
+    if (memfd < 0 || ::ftruncate(memfd, static_cast<off_t>(mapped_size)) < 0)
+    {
+        LOG_ERROR("shm memfd create error:%d \n", errno);
+        if (memfd >= 0)
+        {
+            ::close(memfd);
+        }
+        ::close(control_fd);
+        return ShmConnectionPtr();
+    }
+
+    int creator_doorbell = CreateDoorbell();
+    int opener_doorbell = CreateDoorbell();
+    ShmConnectionPtr conn = std::make_shared<ShmConnection>(
+        loop, name, true, memfd, creator_doorbell, opener_doorbell, control_fd);
+    if (conn->mapped_ == nullptr || creator_doorbell < 0 || opener_doorbell < 0)
+    {
+        return ShmConnectionPtr();
+    }
+
+    // 对方的门铃在前，对方看来是 [memfd, 自己的门铃, 对方的门铃]
+    std::vector<int> fds = {memfd, opener_doorbell, creator_doorbell};
+    if (!Socket::SendFds(control_fd, fds, kSetupMessage))
+    {
+        return ShmConnectionPtr();
+    }
+    return conn;
+}
+
+ShmConnectionPtr ShmConnection::Open(EventLoop *loop, const std::string &name, int control_fd)
+{
+    std::vector<int> fds;
+    char buf[sizeof kSetupMessage] = {0};
+    ssize_t n = Socket::RecvFds(control_fd, &fds, buf, sizeof buf - 1);
+    if (n <= 0 || fds.size() != 3 || std::string(buf) != kSetupMessage)
+    {
+        LOG_ERROR("shm open: bad setup message, %zu fds error:%d \n", fds.size(), n < 0 ? errno : 0);
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        ::close(control_fd);
+        return ShmConnectionPtr();
+    }
+
+    ShmConnectionPtr conn = std::make_shared<ShmConnection>(
+        loop, name, false, fds[0], fds[1], fds[2], control_fd);
+    if (conn->mapped_ == nullptr)
+    {
+        return ShmConnectionPtr();
+    }
+    return conn;
+}
+
+ShmConnection::ShmConnection(EventLoop *loop, const std::string &name, bool creator,
+                             int memfd, int own_doorbell, int peer_doorbell, int control_fd)
+    : loop_(loop)
+    , name_(name)
+    , state_(kConnecting)
+    , memfd_(memfd)
+    , own_doorbell_(own_doorbell)
+    , peer_doorbell_(peer_doorbell)
+    , control_fd_(control_fd)
+    , mapped_(nullptr)
+    , mapped_size_(0)
+    , doorbell_channel_(new Channel(loop, own_doorbell))
+    , control_channel_(new Channel(loop, control_fd))
+    , read_scheduled_(false)
+    , peer_closed_(false)
+    , doorbells_(0)
+{
+    struct stat st;
+    if (::fstat(memfd, &st) == 0 && st.st_size > 0)
+    {
+        void *mem = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (mem != MAP_FAILED)
+        {
+            mapped_ = mem;
+            mapped_size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    if (mapped_ == nullptr)
+    {
+        LOG_ERROR("shm mmap memfd=%d error:%d \n", memfd, errno);
+        return;
+    }
+
+    // 第一个环是创建方发给打开方的，第二个环反过来
+    char *ring0 = static_cast<char*>(mapped_);
+    char *ring1 = ring0 + mapped_size_ / 2;
+    if (creator)
+    {
+        size_t capacity = mapped_size_ / 2 - sizeof(ShmRing::Header);
+        tx_.Init(ring0, capacity);
+        rx_.Init(ring1, capacity);
+    }
+    else if (!tx_.Attach(ring1, mapped_size_ / 2) || !rx_.Attach(ring0, mapped_size_ / 2))
+    {
+        // 容量来自对方写的 Header，和映射的大小对不上时不能用
+        LOG_ERROR("shm bad ring header, mapped size %zu \n", mapped_size_);
+        ::munmap(mapped_, mapped_size_);
+        mapped_ = nullptr;
+        return;
+    }
+
+    doorbell_channel_->set_name("shm doorbell");
+    doorbell_channel_->set_read_callback(std::bind(&ShmConnection::HandleDoorbell, this, std::placeholders::_1));
+    control_channel_->set_name("shm control");
+    control_channel_->set_read_callback(std::bind(&ShmConnection::HandleControl, this, std::placeholders::_1));
+    control_channel_->set_close_callback(std::bind(&ShmConnection::HandleClose, this));
+    control_channel_->set_error_callback(std::bind(&ShmConnection::HandleClose, this));
+}
+
+ShmConnection::~ShmConnection()
+{
+    LOG_INFO("ShmConnection::dtor[%s] doorbells=%lu \n", name_.c_str(), static_cast<unsigned long>(doorbells_));
+    if (mapped_ != nullptr)
+    {
+        ::munmap(mapped_, mapped_size_);
+    }
+    for (int fd : {memfd_, own_doorbell_, peer_doorbell_, control_fd_})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+}
+
+void ShmConnection::Start()
+{
+    loop_->RunInLoop(std::bind(&ShmConnection::StartInLoop, shared_from_this()));
+}
+
+void ShmConnection::StartInLoop()
+{
+    state_ = kConnected;
+    doorbell_channel_->tie(shared_from_this());
+    control_channel_->tie(shared_from_this());
+    doorbell_channel_->EnableReading();
+    control_channel_->EnableReading();
+
+    connection_callback_(shared_from_this());
+
+    // 对方可能在我们 Start 之前已经写了数据，那时等待标志还没有设置，不会有门铃
+    ReadRing(Timestamp::Now());
+}
+
+void ShmConnection::Send(const std::string &buf)
+{
+    Send(buf.data(), buf.size());
+}
+
+void ShmConnection::Send(const void *data, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->IsInLoopThread())
+        {
+            SendInLoop(data, len);
+        }
+        else
+        {
+            // 跨线程发送时拷贝一份
+            std::string copy(static_cast<const char*>(data), len);
+            ShmConnectionPtr self = shared_from_this();
+            loop_->RunInLoop([self, copy]() { self->SendInLoop(copy.data(), copy.size()); });
+        }
+    }
+}
+
+void ShmConnection::SendInLoop(const void *data, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("shm connection %s disconnected, give up writing \n", name_.c_str());
+        return;
+    }
+
+    size_t written = 0;
+    if (output_buffer_.readableBytes() == 0)
+    {
+        written = tx_.Write(data, len);
+        if (written > 0)
+        {
+            RingPeer();
+        }
+    }
+
+    if (written < len)
+    {
+        output_buffer_.append(static_cast<const char*>(data) + written, len - written);
+        FlushOutput();
+    }
+    else if (write_complete_callback_)
+    {
+        loop_->QueueInLoop(std::bind(write_complete_callback_, shared_from_this()));
+    }
+}
+
+void ShmConnection::FlushOutput()
+{
+    if (output_buffer_.readableBytes() == 0)
+    {
+        return;
+    }
+
+    while (output_buffer_.readableBytes() > 0)
+    {
+        size_t n = tx_.Write(output_buffer_.peek(), output_buffer_.readableBytes());
+        if (n > 0)
+        {
+            output_buffer_.retrieve(n);
+            RingPeer();
+        }
+        // 环满，等对方读出数据以后敲门铃
+        if (output_buffer_.readableBytes() > 0 && tx_.ArmProducerWait())
+        {
+            return;
+        }
+    }
+
+    if (write_complete_callback_)
+    {
+        loop_->QueueInLoop(std::bind(write_complete_callback_, shared_from_this()));
+    }
+    if (peer_closed_)
+    {
+        // 对方半关闭以后还在读环，我们的数据都写进去了，可以关闭
+        HandleClose();
+    }
+    else if (state_ == kDisconnecting)
+    {
+        ShutdownInLoop();
+    }
+}
+
+void ShmConnection::RingPeer()
+{
+    if (tx_.TakeConsumerWaiting())
+    {
+        uint64_t one = 1;
+        if (::write(peer_doorbell_, &one, sizeof one) != sizeof one)
+        {
+            LOG_ERROR("shm doorbell write error:%d \n", errno);
+        }
+        ++doorbells_;
+    }
+}
+
+void ShmConnection::ReadRing(Timestamp receive_time)
+{
+    read_scheduled_ = false;
+
+    // 每次最多读一个环的容量，对方一直在写时不饿死这个 loop 上的其它 Channel
+    size_t budget = rx_.capacity();
+    size_t total = 0;
+    while (true)
+    {
+        size_t readable = rx_.ReadableBytes();
+        if (readable == 0)
+        {
+            if (rx_.ArmConsumerWait())
+            {
+                break;
+            }
+            continue;
+        }
+        if (total >= budget)
+        {
+            // 没有设置等待标志，对方不会敲门铃，自己排队继续读
+            if (!read_scheduled_)
+            {
+                read_scheduled_ = true;
+                ShmConnectionPtr self = shared_from_this();
+                loop_->QueueInLoop([self]() { self->ReadRing(Timestamp::Now()); });
+            }
+            break;
+        }
+
+        input_buffer_.ensureWriteableBytes(readable);
+        size_t n = rx_.Read(input_buffer_.beginWrite(), readable);
+        input_buffer_.hasWritten(n);
+        total += n;
+
+        // 对方在等空间
+        if (rx_.TakeProducerWaiting())
+        {
+            uint64_t one = 1;
+            if (::write(peer_doorbell_, &one, sizeof one) != sizeof one)
+            {
+                LOG_ERROR("shm doorbell write error:%d \n", errno);
+            }
+            ++doorbells_;
+        }
+    }
+
+    if (total > 0 && state_ != kDisconnected)
+    {
+        message_callback_(shared_from_this(), &input_buffer_, receive_time);
+    }
+}
+
+void ShmConnection::HandleDoorbell(Timestamp receive_time)
+{
+    uint64_t count = 0;
+    ::read(own_doorbell_, &count, sizeof count);
+
+    ReadRing(receive_time);
+    FlushOutput();
+}
+
+void ShmConnection::HandleControl(Timestamp receive_time)
+{
+    char buf[64];
+    ssize_t n = ::read(control_fd_, buf, sizeof buf);
+    if (n == 0)
+    {
+        // 对方 Shutdown 或者进程退出，先把环中剩下的数据读完
+        ReadRing(receive_time);
+        if (state_ == kDisconnected)
+        {
+            return;
+        }
+
+        // 进程退出（或者 SHUT_RDWR）时两个方向都关闭，有 POLLHUP，没有人再读环了
+        pollfd pfd = { control_fd_, POLLOUT, 0 };
+        bool peer_gone = ::poll(&pfd, 1, 0) < 0 || (pfd.revents & (POLLHUP | POLLERR));
+        if (peer_gone || output_buffer_.readableBytes() == 0)
+        {
+            HandleClose();
+            return;
+        }
+
+        // 半关闭：对方还在读环，等 FlushOutput 把 output_buffer_ 写完以后关闭
+        // EOF 一直可读，不再关注控制连接
+        peer_closed_ = true;
+        control_channel_->DisableReading();
+    }
+    else if (n < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR("shm control read error:%d \n", errno);
+        HandleClose();
+    }
+}
+
+void ShmConnection::Shutdown()
+{
+    if (state_ == kConnected)
+    {
+        state_ = kDisconnecting;
+        loop_->RunInLoop(std::bind(&ShmConnection::ShutdownInLoop, shared_from_this()));
+    }
+}
+
+void ShmConnection::ShutdownInLoop()
+{
+    // 还有数据没写入环时，FlushOutput 写完以后再调用
+    if (output_buffer_.readableBytes() == 0)
+    {
+        ::shutdown(control_fd_, SHUT_WR);
+    }
+}
+
+void ShmConnection::ForceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        state_ = kDisconnecting;
+        loop_->QueueInLoop(std::bind(&ShmConnection::ForceCloseInLoop, shared_from_this()));
+    }
+}
+
+void ShmConnection::ForceCloseInLoop()
+{
+    if (state_ != kDisconnected)
+    {
+        HandleClose();
+    }
+}
+
+void ShmConnection::HandleClose()
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    state_ = kDisconnected;
+    doorbell_channel_->DisableAll();
+    control_channel_->DisableAll();
+    // 对方从控制连接上读到 EOF
+    ::shutdown(control_fd_, SHUT_RDWR);
+
+    ShmConnectionPtr guard(shared_from_this());
+    connection_callback_(guard);
+    if (close_callback_)
+    {
+        close_callback_(guard);
+    }
+    loop_->QueueInLoop(std::bind(&ShmConnection::Destroy, guard));
+}
+
+void ShmConnection::Destroy()
+{
+    doorbell_channel_->Remove();
+    control_channel_->Remove();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "Timestamp.h"
+#include "ShmRing.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 同一台机器上两个进程之间的共享内存连接，接口和 TcpConnection 一样是字节流
+ *
+ * 一个 memfd 中有两个方向各一个 ShmRing，每一方有一个 eventfd 门铃注册成 Channel
+ * 数据只在用户态拷贝（写入环、读出到 input_buffer_），消费者一直在读的时候生产者不敲门铃
+ * 环满时写不下的数据留在 output_buffer_ 中，等对方腾出空间后敲门铃再继续写
+ *
+ * 建立连接用一条 Unix socket（控制连接）：创建方用 SCM_RIGHTS 把 memfd 和两个 eventfd 发给对方
+ * 控制连接之后一直保留，对方进程退出或者 Shutdown 时在这里读到 EOF，用来发现连接关闭
+ * 对方只是 Shutdown（半关闭）时，还会读完环中的数据，我们这边 output_buffer_ 中的数据都写入环以后才关闭
+ *
+ * 每一方都只有 loop 线程读写自己的环，其它线程的 Send 转到 loop 线程中执行，
+ * 所以每个方向是单生产者单消费者
+ */
+class ShmConnection : noncopyable, public std::enable_shared_from_this<ShmConnection>
+{
+public:
+    static const size_t kDefaultRingSize = 4 * 1024 * 1024;
+
+    /**
+     * 创建共享内存和门铃，通过 control_fd 发给对方，失败返回 nullptr
+     * control_fd 是已经连接的 Unix socket，之后由 ShmConnection 持有并关闭
+     */
+    static ShmConnectionPtr Create(EventLoop *loop, const std::string &name,
+                                   int control_fd, size_t ring_size = kDefaultRingSize);
+    // 从 control_fd 上接收对方 Create 发来的 fd，control_fd 需要已经可读或者是阻塞的
+    static ShmConnectionPtr Open(EventLoop *loop, const std::string &name, int control_fd);
+
+    ShmConnection(EventLoop *loop, const std::string &name, bool creator,
+                  int memfd, int own_doorbell, int peer_doorbell, int control_fd);
+    ~ShmConnection();
+
+    EventLoop* loop() const { return loop_; }
+    const std::string& name() const { return name_; }
+    bool connected() const { return state_ == kConnected; }
+
+    // 设置好回调以后调用，可以跨线程调用
+    void Start();
+
+    // 可以跨线程调用
+    void Send(const std::string &buf);
+    void Send(const void *data, size_t len);
+    // 数据都写入环以后关闭控制连接的写端，对方读完环中的数据后关闭
+    void Shutdown();
+    void ForceClose();
+
+    void set_connection_callback(const ShmConnectionCallback &cb) { connection_callback_ = cb; }
+    void set_message_callback(const ShmMessageCallback &cb) { message_callback_ = cb; }
+    void set_write_complete_callback(const ShmConnectionCallback &cb) { write_complete_callback_ = cb; }
+    void set_close_callback(const ShmConnectionCallback &cb) { close_callback_ = cb; }
+
+    Buffer* input_buffer() { return &input_buffer_; }
+    size_t ring_size() const { return tx_.capacity(); }
+    // 敲门铃（写 eventfd）的次数，对方一直在读的时候不增加
+    uint64_t doorbells() const { return doorbells_; }
+private:
+    enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
+
+    void StartInLoop();
+    void SendInLoop(const void *data, size_t len);
+    void ShutdownInLoop();
+    void ForceCloseInLoop();
+
+    void HandleDoorbell(Timestamp receive_time);
+    void HandleControl(Timestamp receive_time);
+    void HandleClose();
+    void Destroy();
+
+    // 读出环中的数据交给 message_callback_，读空以后设置等待标志
+    void ReadRing(Timestamp receive_time);
+    // 把 output_buffer_ 中的数据写入环
+    void FlushOutput();
+    void RingPeer();
+
+    EventLoop *loop_;
+    const std::string name_;
+    StateE state_;
+
+    int memfd_;
+    int own_doorbell_;
+    int peer_doorbell_;
+    int control_fd_;
+    void *mapped_;
+    size_t mapped_size_;
+    ShmRing tx_;
+    ShmRing rx_;
+
+    std::unique_ptr<Channel> doorbell_channel_;
+    std::unique_ptr<Channel> control_channel_;
+
+    ShmConnectionCallback connection_callback_;
+    ShmMessageCallback message_callback_;
+    ShmConnectionCallback write_complete_callback_;
+    ShmConnectionCallback close_callback_;
+
+    Buffer input_buffer_;
+    Buffer output_buffer_;      // 环满时写不下的数据
+    bool read_scheduled_;
+    bool peer_closed_;          // 对方已经半关闭，我们的数据写完就关闭
+    uint64_t doorbells_;
+};
@@ -0,0 +1,137 @@
+#include "ShmRing.h"
+
+#include <new>
+#include <string.h>
+
+size_t ShmRing::RoundCapacity(size_t capacity)
+{
+    size_t rounded = 4096;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+void ShmRing::Init(void *base, size_t capacity)
+{
+    header_ = new (base) Header;
+    header_->head.store(0);
+    header_->tail.store(0);
+    header_->consumer_waiting.store(0);
+    header_->producer_waiting.store(0);
+    header_->capacity = capacity;
+    Attach(base, MappedSize(capacity));
+}
+
+bool ShmRing::Attach(void *base, size_t mapped_size)
+{
+    // 只读一次，检查和使用的是同一个值
+    uint64_t capacity = static_cast<Header*>(base)->capacity;
+    // 不小于一个 cache line 的 2 的幂，第二个环的 Header 也是对齐的
+    if (mapped_size <= sizeof(Header) || capacity != mapped_size - sizeof(Header)
+        || capacity < kCacheLineSize || (capacity & (capacity - 1)) != 0)
+    {
+        return false;
+    }
+    header_ = static_cast<Header*>(base);
+    data_ = static_cast<char*>(base) + sizeof(Header);
+    capacity_ = capacity;
+    mask_ = capacity - 1;
+    return true;
+}
+
+size_t ShmRing::Write(const void *data, size_t len)
+{
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    size_t space = static_cast<size_t>(capacity_ - Used(head, tail));
+    size_t n = len < space ? len : space;
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    // 可能绕回开头，分两段拷贝
+    size_t offset = static_cast<size_t>(head & mask_);
+    size_t first = n < capacity_ - offset ? n : static_cast<size_t>(capacity_ - offset);
+    ::memcpy(data_ + offset, data, first);
+    ::memcpy(data_, static_cast<const char*>(data) + first, n - first);
+
+    header_->head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+bool ShmRing::TakeConsumerWaiting()
+{
+    // 和 ArmConsumerWait 配对：一边先写 head 再读标志，另一边先写标志再读 head
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->consumer_waiting.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    return header_->consumer_waiting.exchange(0) != 0;
+}
+
+bool ShmRing::ArmProducerWait()
+{
+    header_->producer_waiting.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (Used(head, tail) < capacity_)
+    {
+        header_->producer_waiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+size_t ShmRing::ReadableBytes() const
+{
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    return static_cast<size_t>(Used(head, tail));
+}
+
+size_t ShmRing::Read(void *buf, size_t len)
+{
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    size_t readable = static_cast<size_t>(Used(head, tail));
+    size_t n = len < readable ? len : readable;
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    size_t offset = static_cast<size_t>(tail & mask_);
+    size_t first = n < capacity_ - offset ? n : static_cast<size_t>(capacity_ - offset);
+    ::memcpy(buf, data_ + offset, first);
+    ::memcpy(static_cast<char*>(buf) + first, data_, n - first);
+
+    header_->tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+bool ShmRing::ArmConsumerWait()
+{
+    header_->consumer_waiting.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->head.load(std::memory_order_relaxed) != header_->tail.load(std::memory_order_relaxed))
+    {
+        header_->consumer_waiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+bool ShmRing::TakeProducerWaiting()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_->producer_waiting.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    return header_->producer_waiting.exchange(0) != 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 放在共享内存中的单生产者单消费者字节环，生产者和消费者可以在不同的进程中
+ * ShmRing 本身不持有内存，只是 [Header][data] 这段映射的视图
+ *
+ * head 只由生产者写，tail 只由消费者写，各占一个 cache line
+ * 门铃抑制：消费者读空以后才设置 consumer_waiting 然后再检查一次，生产者写完只在这个标志存在时敲门铃
+ * 消费者一直在读（没有读空）的时候生产者不做任何系统调用；环满的时候反过来用 producer_waiting 等待空间
+ *
+ * Header 对方进程随时可以改写：容量在 Attach 时检查以后保存在本地，head/tail 的差值截断到容量以内，
+ * 对方写坏了也只会读到错误的数据，不会越界访问
+ */
+class ShmRing
+{
+public:
+    static const size_t kCacheLineSize = 64;
+
+    struct Header
+    {
+        alignas(kCacheLineSize) std::atomic<uint64_t> head;     // 生产者已经写入的总字节数
+        alignas(kCacheLineSize) std::atomic<uint64_t> tail;     // 消费者已经读出的总字节数
+        alignas(kCacheLineSize) std::atomic<uint32_t> consumer_waiting;
+        std::atomic<uint32_t> producer_waiting;
+        uint64_t capacity;                                      // 2 的幂
+    };
+
+    // 一个容量为 capacity 的环占用的字节数
+    static size_t MappedSize(size_t capacity) { return sizeof(Header) + capacity; }
+    // 向上取整到 2 的幂
+    static size_t RoundCapacity(size_t capacity);
+
+    ShmRing() : header_(nullptr), data_(nullptr), capacity_(0), mask_(0) {}
+
+    // 创建方初始化 Header，打开方只 Attach
+    void Init(void *base, size_t capacity);
+    // 映射中留给这个环的是 mapped_size 字节，Header 中的容量不是 mapped_size - sizeof(Header) 或者不是 2 的幂时返回 false
+    bool Attach(void *base, size_t mapped_size);
+
+    size_t capacity() const { return capacity_; }
+
+    // 生产者：写入尽可能多的字节，返回写入的字节数
+    size_t Write(const void *data, size_t len);
+    // 生产者：写入以后如果消费者在等待，清除标志并返回 true，调用方负责敲门铃
+    bool TakeConsumerWaiting();
+    // 生产者：环满时设置等待标志，返回 false 表示设置期间已经有了空间，标志已清除
+    bool ArmProducerWait();
+
+    // 消费者：当前可读的字节数
+    size_t ReadableBytes() const;
+    // 消费者：读出最多 len 字节，返回读出的字节数
+    size_t Read(void *buf, size_t len);
+    // 消费者：读空以后设置等待标志，返回 false 表示设置期间又有了数据，标志已清除
+    bool ArmConsumerWait();
+    // 消费者：读出以后如果生产者在等空间，清除标志并返回 true
+    bool TakeProducerWaiting();
+private:
+    // 对方写坏 head/tail 时差值可能超过容量
+    uint64_t Used(uint64_t head, uint64_t tail) const { return head - tail < capacity_ ? head - tail : capacity_; }
+
+    Header *header_;
+    char *data_;
+    uint64_t capacity_;
+    uint64_t mask_;
+};
@@ -0,0 +1,141 @@
+#include "Slab.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+
+#include <new>
+#include <stdlib.h>
+
+FixedSlab::FixedSlab(size_t block_size, size_t blocks_per_chunk)
+    : block_size_(block_size)
+    , blocks_per_chunk_(blocks_per_chunk)
+    , local_free_(nullptr)
+    , remote_free_(nullptr)
+{
+}
+
+FixedSlab::~FixedSlab()
+{
+    for (char *chunk : chunks_)
+    {
+        ::free(chunk);
+    }
+}
+
+void* FixedSlab::Allocate()
+{
+    if (local_free_ == nullptr)
+    {
+        local_free_ = remote_free_.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    if (local_free_ == nullptr)
+    {
+        // block_size_ 是 64 的倍数，malloc 的对齐对块中的对象足够
+        char *chunk = static_cast<char*>(::malloc(block_size_ * blocks_per_chunk_));
+        if (chunk == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        chunks_.push_back(chunk);
+        for (size_t i = blocks_per_chunk_; i > 0; --i)
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * block_size_);
+            block->next = local_free_;
+            local_free_ = block;
+        }
+    }
+
+    FreeBlock *block = local_free_;
+    local_free_ = block->next;
+    return block;
+}
+
+void FixedSlab::DeallocateLocal(void *ptr)
+{
+    FreeBlock *block = static_cast<FreeBlock*>(ptr);
+    block->next = local_free_;
+    local_free_ = block;
+}
+
+void FixedSlab::DeallocateRemote(void *ptr)
+{
+    FreeBlock *block = static_cast<FreeBlock*>(ptr);
+    FreeBlock *head = remote_free_.load(std::memory_order_relaxed);
+    do
+    {
+        block->next = head;
+    } while (!remote_free_.compare_exchange_weak(head, block,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+LoopSlab::LoopSlab(pid_t owner_tid)
+    : owner_tid_(owner_tid)
+    , refs_(1)
+{
+    for (size_t i = 0; i < kNumClasses; ++i)
+    {
+        classes_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+LoopSlab::~LoopSlab()
+{
+    for (size_t i = 0; i < kNumClasses; ++i)
+    {
+        delete classes_[i].load(std::memory_order_relaxed);
+    }
+}
+
+void* LoopSlab::Allocate(size_t size)
+{
+    if (size > kMaxBlockSize)
+    {
+        return ::operator new(size);
+    }
+    if (CurrentThread::tid() != owner_tid_)
+    {
+        LOG_FATAL("LoopSlab %p allocating in thread %d, owner is %d \n", this, CurrentThread::tid(), owner_tid_);
+    }
+
+    size_t index = ClassOf(size);
+    FixedSlab *slab = classes_[index].load(std::memory_order_relaxed);
+    if (slab == nullptr)
+    {
+        slab = new FixedSlab((index + 1) * kGranularity, kBlocksPerChunk);
+        classes_[index].store(slab, std::memory_order_release);
+    }
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    return slab->Allocate();
+}
+
+void LoopSlab::Deallocate(void *ptr, size_t size)
+{
+    if (size > kMaxBlockSize)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FixedSlab *slab = classes_[ClassOf(size)].load(std::memory_order_acquire);
+    if (CurrentThread::tid() == owner_tid_)
+    {
+        slab->DeallocateLocal(ptr);
+    }
+    else
+    {
+        slab->DeallocateRemote(ptr);
+    }
+
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+void LoopSlab::Release()
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * 固定大小的块分配器，只由所属线程分配
+ * 所属线程释放的块直接放回本地空闲链表，其它线程释放的块压入无锁的远程空闲栈，
+ * 所属线程在本地链表用完时一次取走整个远程栈，只有一个消费者，没有 ABA 问题
+ * 按 chunk 批量向系统申请，高峰时分配的内存一直留给这个 slab 复用，析构时才归还
+ */
+class FixedSlab : noncopyable
+{
+public:
+    FixedSlab(size_t block_size, size_t blocks_per_chunk);
+    ~FixedSlab();
+
+    size_t block_size() const { return block_size_; }
+
+    // 在所属线程中调用
+    void* Allocate();
+    void DeallocateLocal(void *ptr);
+    // 可以在任意线程中调用
+    void DeallocateRemote(void *ptr);
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    const size_t block_size_;
+    const size_t blocks_per_chunk_;
+    FreeBlock *local_free_;
+    std::atomic<FreeBlock*> remote_free_;
+    std::vector<char*> chunks_;
+};
+
+/**
+ * 每个 EventLoop 一个的分配器，按 64 字节分级，每一级是一个 FixedSlab
+ * 在 loop 线程中分配，可以在任意线程中释放，内存总是回到分配它的 loop 的 slab
+ *
+ * EventLoop 析构时调用 Release，还有块没有归还时（比如连接比 loop 活得久）等最后一块归还以后再释放
+ */
+class LoopSlab : noncopyable
+{
+public:
+    static const size_t kGranularity = 64;
+    static const size_t kMaxBlockSize = 4096;   // 更大的直接使用 operator new
+    static const size_t kBlocksPerChunk = 64;
+
+    explicit LoopSlab(pid_t owner_tid);
+
+    void* Allocate(size_t size);
+    void Deallocate(void *ptr, size_t size);
+    void Release();
+
+    // 还没有归还的块数
+    int64_t live_blocks() const { return refs_.load(std::memory_order_relaxed) - 1; }
+private:
+    static const size_t kNumClasses = kMaxBlockSize / kGranularity;
+
+    ~LoopSlab();
+
+    static size_t ClassOf(size_t size) { return (size + kGranularity - 1) / kGranularity - 1; }
+
+    const pid_t owner_tid_;
+    // 只由所属线程创建，其它线程释放时读取，块分配出去之前它所在的级别已经创建好
+    std::atomic<FixedSlab*> classes_[kNumClasses];
+    std::atomic<int64_t> refs_;         // 还没有归还的块数 + 1（EventLoop 持有的引用）
+};
+
+/**
+ * 配合 std::allocate_shared 使用，对象和引用计数分配在同一块中：
+ *   std::allocate_shared<T>(SlabAllocator<T>(loop->slab()), args...)
+ * 需要在 loop 线程中调用，对象可以在任意线程中销毁
+ */
+template <typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(LoopSlab *slab) : slab_(slab) {}
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U> &other) : slab_(other.slab()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(slab_->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n)
+    {
+        slab_->Deallocate(ptr, n * sizeof(T));
+    }
+
+    LoopSlab* slab() const { return slab_; }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U> &other) const { return slab_ == other.slab(); }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U> &other) const { return slab_ != other.slab(); }
+private:
+    LoopSlab *slab_;
+};
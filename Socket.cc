@@ -6,9 +6,18 @@
 #include <sys/types.h>         
 #include <sys/socket.h>
 #include <strings.h>
+#include <errno.h>
+#include <string.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
 Socket::~Socket()
 {
     close(sockfd_);
@@ -16,7 +25,7 @@ Socket::~Socket()
 
 void Socket::BindAddress(const InetAddress &localaddr)
 {
-    if (0 != ::bind(sockfd_, (sockaddr*)localaddr.sock_addr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.sock_addr(), localaddr.sock_len()))
     {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
@@ -38,13 +47,13 @@ int Socket::Accept(InetAddress *peeraddr)
      * Reactor模型 one loop per thread
      * poller + non-blocking IO
      */ 
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof addr;
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->set_sock_addr(addr);
+        peeraddr->set_sock_addr((sockaddr*)&addr, len);
     }
     return connfd;
 }
@@ -79,4 +88,99 @@ void Socket::SetKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
-}
\ No newline at end of file
+}
+
+bool Socket::SetBusyPoll(int usecs, bool prefer)
+{
+    // 超过 net.core.busy_read 的值需要 CAP_NET_ADMIN
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0)
+    {
+        LOG_ERROR("setsockopt SO_BUSY_POLL fd=%d error:%d \n", sockfd_, errno);
+        return false;
+    }
+    if (prefer)
+    {
+        int optval = 1;
+        if (::setsockopt(sockfd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &optval, sizeof(optval)) < 0)
+        {
+            LOG_ERROR("setsockopt SO_PREFER_BUSY_POLL fd=%d error:%d \n", sockfd_, errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+static const size_t kMaxPassedFds = 64;
+
+bool Socket::SendFds(int sockfd, const std::vector<int> &fds, const std::string &data)
+{
+    if (fds.empty() || fds.size() > kMaxPassedFds || data.empty())
+    {
+        return false;
+    }
+
+    char control[CMSG_SPACE(sizeof(int) * kMaxPassedFds)];
+    ::bzero(control, sizeof control);
+
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = data.size();
+
+    msghdr msg;
+    ::bzero(&msg, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t n = ::sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    if (n != static_cast<ssize_t>(data.size()))
+    {
+        LOG_ERROR("sendmsg SCM_RIGHTS fd=%d error:%d \n", sockfd, errno);
+        return false;
+    }
+    return true;
+}
+
+ssize_t Socket::RecvFds(int sockfd, std::vector<int> *fds, char *buf, size_t len)
+{
+    char control[CMSG_SPACE(sizeof(int) * kMaxPassedFds)];
+
+    iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+
+    msghdr msg;
+    ::bzero(&msg, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    ssize_t n = ::recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0)
+    {
+        return n;
+    }
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds->insert(fds->end(), received, received + count);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        LOG_ERROR("recvmsg SCM_RIGHTS fd=%d: control data truncated \n", sockfd);
+    }
+    return n;
+}
@@ -2,6 +2,10 @@
 
 #include "noncopyable.h"
 
+#include <vector>
+#include <string>
+#include <sys/types.h>
+
 class InetAddress;
 
 // 封装socket fd
@@ -25,6 +29,13 @@ public:
     void SetReuseAddr(bool on);
     void SetReusePort(bool on);
     void SetKeepAlive(bool on);
+    // SO_BUSY_POLL：没有数据时在驱动中忙等 usecs 微秒，prefer 时设置 SO_PREFER_BUSY_POLL，失败返回 false
+    bool SetBusyPoll(int usecs, bool prefer);
+
+    // 通过 Unix socket 传递 fd（SCM_RIGHTS），随 fd 一起发送 data，data 不能为空
+    static bool SendFds(int sockfd, const std::vector<int> &fds, const std::string &data);
+    // 接收 fd 和随之发送的数据，返回读到的字节数，收到的 fd 带 FD_CLOEXEC
+    static ssize_t RecvFds(int sockfd, std::vector<int> *fds, char *buf, size_t len);
 private:
     const int sockfd_;
 };
\ No newline at end of file
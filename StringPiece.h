@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+
+/**
+ * 只读的字符串视图，不拥有内存
+ * 指向 Buffer 内部时，只在 Buffer 被修改（retrieve、append）之前有效
+ */ 
+class StringPiece
+{
+public:
+    StringPiece()
+        : data_(nullptr)
+        , size_(0)
+    {}
+    StringPiece(const char *str)
+        : data_(str)
+        , size_(strlen(str))
+    {}
+    StringPiece(const std::string &str)
+        : data_(str.data())
+        , size_(str.size())
+    {}
+    StringPiece(const char *data, size_t size)
+        : data_(data)
+        , size_(size)
+    {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+    char operator[](size_t i) const { return data_[i]; }
+
+    void remove_prefix(size_t n) { data_ += n; size_ -= n; }
+    void remove_suffix(size_t n) { size_ -= n; }
+
+    bool operator==(const StringPiece &other) const
+    {
+        return size_ == other.size_ && memcmp(data_, other.data_, size_) == 0;
+    }
+    bool operator!=(const StringPiece &other) const { return !(*this == other); }
+
+    std::string ToString() const { return std::string(data_, size_); }
+private:
+    const char *data_;
+    size_t size_;
+};
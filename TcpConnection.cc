@@ -12,6 +12,23 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <string>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// 连接销毁时内核可能还在引用零拷贝发送的页面，数据再多保留一段时间
+static const double kZeroCopyLingerSeconds = 30.0;
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -22,66 +39,273 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
-TcpConnection::TcpConnection(EventLoop *loop, 
-                const std::string &nameArg, 
+TcpConnection::TcpConnection(EventLoop *loop,
+                const std::shared_ptr<TcpConnectionShared> &shared,
+                uint64_t id,
                 int sockfd,
-                const InetAddress& localAddr,
                 const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , shared_(shared)
+    , id_(id)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
-    , local_addr_(localAddr)
+    , owns_shared_(false)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , peer_addr_(peerAddr)
-    , high_watermark_(64*1024*1024) // 64M
+    , input_buffer_(0)
+    , output_buffer_(0)
+    , zerocopy_threshold_(0)
+    , auto_cork_(false)
+    , cork_flush_scheduled_(false)
+    , migrating_(false)
+    , traffic_bytes_(0)
 {
-    // 下面给 channel 设置相应的回调函数，poller会回调相关事件
-    channel_->set_read_callback(
-        std::bind(&TcpConnection::HandleRead, this, std::placeholders::_1)
-    );
+    // 连接名按需生成：watchdog 只看到固定的标签和 fd，慢回调记录在 loop 线程中通过 name provider 取连接名
+    channel_.set_name("tcp connection");
+    channel_.set_name_provider(&TcpConnection::ChannelOwnerName);
 
-    channel_->set_write_callback(
-        std::bind(&TcpConnection::HandleWrite, this)
-    );
+    // 下面给 channel 设置相应的回调函数，poller会回调相关事件
+    // 只捕获 this 的 lambda 可以放在 std::function 内部，不需要额外分配内存
+    channel_.set_read_callback([this](Timestamp receive_time) { HandleRead(receive_time); });
+    channel_.set_write_callback([this]() { HandleWrite(); });
+    channel_.set_close_callback([this]() { HandleClose(); });
+    channel_.set_error_callback([this]() { HandleError(); });
 
-    channel_->set_close_callback(
-        std::bind(&TcpConnection::HandleClose, this)
-    );
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
 
-    channel_->set_error_callback(
-        std::bind(&TcpConnection::HandleError, this)
-    );
+    socket_.SetKeepAlive(true);
+}
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+TcpConnection::TcpConnection(EventLoop *loop,
+                const std::string &name,
+                int sockfd,
+                const InetAddress& peerAddr)
+    : TcpConnection(loop, std::make_shared<TcpConnectionShared>(), 0, sockfd, peerAddr)
+{
+    shared_->name_prefix = name;
+    owns_shared_ = true;
+}
 
-    socket_->SetKeepAlive(true);
+std::string TcpConnection::ChannelOwnerName(const void *owner)
+{
+    return static_cast<const TcpConnection*>(owner)->name();
 }
 
 
 TcpConnection::~TcpConnection()
 {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
-        name_.c_str(), channel_->fd(), (int)state_);
+        name().c_str(), channel_.fd(), (int)state_);
+}
+
+std::string TcpConnection::name() const
+{
+    return id_ == 0 ? shared_->name_prefix : shared_->name_prefix + std::to_string(id_);
+}
+
+InetAddress TcpConnection::local_addr() const
+{
+    sockaddr_storage local;
+    ::bzero(&local, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(socket_.fd(), (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("TcpConnection::local_addr getsockname error:%d \n", errno);
+    }
+
+    InetAddress addr;
+    addr.set_sock_addr((sockaddr*)&local, addrlen);
+    return addr;
+}
+
+TcpConnectionShared* TcpConnection::MutableShared()
+{
+    if (!owns_shared_)
+    {
+        shared_ = std::make_shared<TcpConnectionShared>(*shared_);
+        owns_shared_ = true;
+    }
+    return shared_.get();
 }
 
 void TcpConnection::Send(const std::string &buf)
 {
     if (state_ == kConnected)
     {
-        if (loop_->IsInLoopThread())
+        if (IsInOwnerLoop())
         {
             SendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->RunInLoop(std::bind(
-                &TcpConnection::SendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
-            ));
+            // 跨线程发送时，数据要拷贝一份由回调持有，调用者的 buf 可能已经失效
+            void (TcpConnection::*fp)(const std::string&) = &TcpConnection::SendInLoop;
+            RunInOwnerLoop(std::bind(fp, shared_from_this(), buf));
+        }
+    }
+}
+
+void TcpConnection::Send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (IsInOwnerLoop())
+        {
+            SendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            void (TcpConnection::*fp)(const std::string&) = &TcpConnection::SendInLoop;
+            RunInOwnerLoop(std::bind(fp, shared_from_this(), buf->retrieveAllAsString()));
+        }
+    }
+}
+
+void TcpConnection::Send(const std::shared_ptr<const std::string> &payload)
+{
+    if (state_ == kConnected)
+    {
+        if (IsInOwnerLoop())
+        {
+            SendSharedInLoop(payload);
+        }
+        else
+        {
+            RunInOwnerLoop(std::bind(&TcpConnection::SendSharedInLoop, shared_from_this(), payload));
+        }
+    }
+}
+
+void TcpConnection::SendInLoop(const std::string &message)
+{
+    SendInLoop(message.data(), message.size());
+}
+
+size_t TcpConnection::PendingOutputBytes() const
+{
+    return output_buffer_.readableBytes() + (shared_output_ ? shared_output_->bytes : 0);
+}
+
+// 零拷贝发送还没有完成时，写完成回调推迟到收到内核的完成通知以后
+void TcpConnection::QueueWriteComplete()
+{
+    if (!shared_->write_complete_callback)
+    {
+        return;
+    }
+    if (shared_output_ && !shared_output_->zerocopy_inflight.empty())
+    {
+        shared_output_->write_complete_pending = true;
+        return;
+    }
+    loop()->QueueInLoop(
+        std::bind(shared_->write_complete_callback, shared_from_this())
+    );
+}
+
+// 发送共享数据块中从 offset 开始的部分，足够大时使用 MSG_ZEROCOPY
+ssize_t TcpConnection::WriteShared(const std::shared_ptr<const std::string> &payload, size_t offset)
+{
+    const char *data = payload->data() + offset;
+    size_t len = payload->size() - offset;
+
+    if (zerocopy_threshold_ > 0 && len >= zerocopy_threshold_)
+    {
+        ssize_t n = ::send(channel_.fd(), data, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            // 每次成功的零拷贝发送占用内核的一个序号
+            shared_output_->zerocopy_inflight.push_back(
+                std::make_pair(shared_output_->next_zerocopy_id++, payload));
+            return n;
+        }
+        if (n < 0 && errno != ENOBUFS)
+        {
+            return n;
+        }
+        // ENOBUFS：锁定页面的额度用完了，这一次退回普通发送
+    }
+    return ::write(channel_.fd(), data, len);
+}
+
+void TcpConnection::SendSharedInLoop(const std::shared_ptr<const std::string> &payload)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+
+    if (!shared_output_)
+    {
+        shared_output_.reset(new SharedOutput);
+    }
+
+    if (migrating_)
+    {
+        // 迁移途中只排队，注册到新的 loop 以后再发送
+        SharedOutput::Chunk chunk;
+        chunk.data = payload;
+        chunk.offset = 0;
+        shared_output_->chunks.push_back(chunk);
+        shared_output_->bytes += payload->size();
+        return;
+    }
+
+    size_t len = payload->size();
+    size_t nwrote = 0;
+    if (!auto_cork_ && !channel_.IsWriting() && PendingOutputBytes() == 0)
+    {
+        ssize_t n = WriteShared(payload, 0);
+        if (n >= 0)
+        {
+            nwrote = n;
+            loop()->metrics().bytes_written.Add(n);
+            AddTraffic(n);
+            if (nwrote == len)
+            {
+                QueueWriteComplete();
+                return;
+            }
+        }
+        else if (errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::SendSharedInLoop");
+            if (errno == EPIPE || errno == ECONNRESET)
+            {
+                return;
+            }
+        }
+    }
+
+    size_t remaining = len - nwrote;
+    size_t old_len = PendingOutputBytes();
+    if (old_len + remaining >= shared_->high_watermark
+        && old_len < shared_->high_watermark
+        && shared_->high_watermark_callback)
+    {
+        loop()->QueueInLoop(
+            std::bind(shared_->high_watermark_callback, shared_from_this(), old_len + remaining)
+        );
+    }
+
+    SharedOutput::Chunk chunk;
+    chunk.data = payload;
+    chunk.offset = nwrote;
+    shared_output_->chunks.push_back(chunk);
+    shared_output_->bytes += remaining;
+    loop()->metrics().output_bytes_pending.Add(remaining);
+    if (!channel_.IsWriting())
+    {
+        if (auto_cork_)
+        {
+            ScheduleCorkedFlush();
+        }
+        else
+        {
+            channel_.EnableWriting();
         }
     }
 }
@@ -102,19 +326,27 @@ void TcpConnection::SendInLoop(const void* data, size_t len)
         return;
     }
 
+    if (migrating_)
+    {
+        // 迁移途中只排队，注册到新的 loop 以后再发送
+        AppendOutput(static_cast<const char*>(data), len);
+        return;
+    }
+
     // 表示 channel_ 第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->IsWriting() && output_buffer_.readableBytes() == 0)
+    // 开启 auto-cork 时不直接写，全部放进发送队列，等本轮循环结束时统一发送
+    if (!auto_cork_ && !channel_.IsWriting() && PendingOutputBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = ::write(channel_.fd(), data, len);
         if (nwrote >= 0)
         {
+            loop()->metrics().bytes_written.Add(nwrote);
+            AddTraffic(nwrote);
             remaining = len - nwrote;
-            if (remaining == 0 && write_complete_callback_)
+            if (remaining == 0)
             {
                 // 数据全部发送完成，就不用再给 channel 设置 epollout 事件了
-                loop_->QueueInLoop(
-                    std::bind(write_complete_callback_, shared_from_this())
-                );
+                QueueWriteComplete();
             }
         }
         else    // nwrote < 0
@@ -136,81 +368,553 @@ void TcpConnection::SendInLoop(const void* data, size_t len)
     // 也就是调用 TcpConnection::HandleWrite 方法，把发送缓冲区中的数据全部发送完成
     if (!fault_error && remaining > 0) 
     {
-        size_t old_len = output_buffer_.readableBytes();
+        size_t old_len = PendingOutputBytes();
 
-        if (old_len + remaining >= high_watermark_
-            && old_len < high_watermark_
-            && high_watermark_callback_)
+        if (old_len + remaining >= shared_->high_watermark
+            && old_len < shared_->high_watermark
+            && shared_->high_watermark_callback)
         {
-            loop_->QueueInLoop(
-                std::bind(high_watermark_callback_, shared_from_this(), old_len + remaining)
+            loop()->QueueInLoop(
+                std::bind(shared_->high_watermark_callback, shared_from_this(), old_len + remaining)
             );
         }
 
-        output_buffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->IsWriting())
+        AppendOutput((char*)data + nwrote, remaining);
+        loop()->metrics().output_bytes_pending.Add(remaining);
+        if (!channel_.IsWriting())
+        {
+            if (auto_cork_)
+            {
+                ScheduleCorkedFlush();
+            }
+            else
+            {
+                // 一定要注册 channel 的写事件，否则 poller 不会给 channel 通知 epollout
+                channel_.EnableWriting(); 
+            }
+        }
+    }
+}
+
+
+void TcpConnection::AppendOutput(const char *data, size_t len)
+{
+    if (shared_output_ && !shared_output_->chunks.empty())
+    {
+        // 前面还有共享数据块在排队，拷贝一份排在它们后面
+        SharedOutput::Chunk chunk;
+        chunk.data = std::make_shared<std::string>(data, len);
+        chunk.offset = 0;
+        shared_output_->chunks.push_back(chunk);
+        shared_output_->bytes += len;
+    }
+    else
+    {
+        output_buffer_.append(data, len);
+    }
+}
+
+// 从发送队列头部去掉已经发出的 n 个字节
+void TcpConnection::ConsumeOutput(size_t n)
+{
+    size_t from_buffer = std::min(n, output_buffer_.readableBytes());
+    output_buffer_.retrieve(from_buffer);
+    n -= from_buffer;
+
+    while (n > 0)
+    {
+        SharedOutput::Chunk &chunk = shared_output_->chunks.front();
+        size_t consumed = std::min(n, chunk.data->size() - chunk.offset);
+        chunk.offset += consumed;
+        shared_output_->bytes -= consumed;
+        n -= consumed;
+        if (chunk.offset == chunk.data->size())
+        {
+            shared_output_->chunks.pop_front();
+        }
+    }
+}
+
+/**
+ * 尽量发出 output_buffer_ 和排在后面的共享数据块，返回发出的字节数
+ * 连续的数据用一次 sendmsg 聚合发送，一次装不下时前面的批次带上 MSG_MORE
+ * 需要零拷贝的数据块单独用 WriteShared 发送
+ */
+ssize_t TcpConnection::WriteOutput(bool *failed)
+{
+    static const int kMaxIovecs = 64;
+
+    ssize_t total = 0;
+    *failed = false;
+    while (PendingOutputBytes() > 0)
+    {
+        iovec iov[kMaxIovecs];
+        int iovcnt = 0;
+        size_t attempted = 0;
+        if (output_buffer_.readableBytes() > 0)
+        {
+            iov[iovcnt].iov_base = const_cast<char*>(output_buffer_.peek());
+            iov[iovcnt].iov_len = output_buffer_.readableBytes();
+            attempted += iov[iovcnt].iov_len;
+            ++iovcnt;
+        }
+        if (shared_output_)
+        {
+            for (const SharedOutput::Chunk &chunk : shared_output_->chunks)
+            {
+                size_t len = chunk.data->size() - chunk.offset;
+                if (iovcnt == kMaxIovecs || (zerocopy_threshold_ > 0 && len >= zerocopy_threshold_))
+                {
+                    break;
+                }
+                iov[iovcnt].iov_base = const_cast<char*>(chunk.data->data() + chunk.offset);
+                iov[iovcnt].iov_len = len;
+                attempted += len;
+                ++iovcnt;
+            }
+        }
+
+        ssize_t n = 0;
+        if (iovcnt == 0)
         {
-            // 一定要注册 channel 的写事件，否则 poller 不会给 channel 通知 epollout
-            channel_->EnableWriting(); 
+            // 队首就是需要零拷贝的数据块
+            SharedOutput::Chunk &chunk = shared_output_->chunks.front();
+            attempted = chunk.data->size() - chunk.offset;
+            n = WriteShared(chunk.data, chunk.offset);
+        }
+        else
+        {
+            struct msghdr msg;
+            ::memset(&msg, 0, sizeof msg);
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            int flags = MSG_NOSIGNAL;
+            if (attempted < PendingOutputBytes())
+            {
+                flags |= MSG_MORE;
+            }
+            n = ::sendmsg(channel_.fd(), &msg, flags);
+        }
+
+        if (n < 0)
+        {
+            *failed = errno != EWOULDBLOCK;
+            break;
+        }
+        ConsumeOutput(n);
+        total += n;
+        if (static_cast<size_t>(n) < attempted)
+        {
+            // 内核发送缓冲区满了
+            break;
         }
     }
+    return total;
 }
 
+void TcpConnection::ScheduleCorkedFlush()
+{
+    if (!cork_flush_scheduled_)
+    {
+        cork_flush_scheduled_ = true;
+        loop()->QueueAfterDispatch(
+            std::bind(&TcpConnection::FlushCorked, shared_from_this())
+        );
+    }
+}
+
+// 本轮循环结束时把 auto-cork 攒下的数据一次发出，发不完的交给可写事件
+void TcpConnection::FlushCorked()
+{
+    cork_flush_scheduled_ = false;
+    if (state_ == kDisconnected || migrating_ || channel_.IsWriting())
+    {
+        return;
+    }
+
+    bool failed = false;
+    ssize_t total = WriteOutput(&failed);
+    if (total > 0)
+    {
+        LoopMetrics &metrics = loop()->metrics();
+        metrics.bytes_written.Add(total);
+        metrics.output_bytes_pending.Add(-total);
+        AddTraffic(total);
+    }
+
+    if (PendingOutputBytes() == 0)
+    {
+        QueueWriteComplete();
+        if (state_ == kDisconnecting)
+        {
+            ShutdownInLoop();
+        }
+    }
+    else if (failed)
+    {
+        LOG_ERROR("TcpConnection::FlushCorked");
+    }
+    else
+    {
+        channel_.EnableWriting();
+    }
+}
 
 void TcpConnection::Shutdown()
 {
     if (state_ == kConnected)
     {
         set_state(kDisconnecting);
-        loop_->RunInLoop(
-            std::bind(&TcpConnection::ShutdownInLoop, this)
+        RunInOwnerLoop(
+            std::bind(&TcpConnection::ShutdownInLoop, shared_from_this())
         );
     }
 }
 
 void TcpConnection::ShutdownInLoop()
 {
-    if (!channel_->IsWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    // 迁移中的连接由 AttachInLoop 检查是否需要关闭
+    if (migrating_)
+    {
+        return;
+    }
+
+    // 说明outputBuffer中的数据已经全部发送完成，auto-cork 排队的数据由 FlushCorked 发完以后再关闭
+    if (!channel_.IsWriting() && PendingOutputBytes() == 0)
+    {
+        socket_.ShutdownWrite();
+    }
+}
+
+void TcpConnection::ForceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        set_state(kDisconnecting);
+        RunInOwnerLoop(
+            std::bind(&TcpConnection::ForceCloseInLoop, shared_from_this()), true
+        );
+    }
+}
+
+void TcpConnection::ForceCloseInLoop()
+{
+    if (migrating_)
+    {
+        // 迁移开始之前排进源 loop 的关闭，等连接在 target 上注册以后再执行
+        RunInOwnerLoop(std::bind(&TcpConnection::ForceCloseInLoop, shared_from_this()), true);
+        return;
+    }
+
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        HandleClose();
+    }
+}
+
+void TcpConnection::set_passthrough_handlers(const std::function<void()> &read_handler,
+                                const std::function<void()> &write_handler)
+{
+    if (read_handler || write_handler)
+    {
+        passthrough_.reset(new PassthroughHandlers);
+        passthrough_->read = read_handler;
+        passthrough_->write = write_handler;
+    }
+    else
+    {
+        passthrough_.reset();
+    }
+}
+
+int TcpConnection::fd() const
+{
+    return channel_.fd();
+}
+
+void TcpConnection::EnableReadEvents(bool on)
+{
+    if (on && !channel_.IsReading())
+    {
+        channel_.EnableReading();
+    }
+    else if (!on && channel_.IsReading())
+    {
+        channel_.DisableReading();
+    }
+}
+
+void TcpConnection::EnableWriteEvents(bool on)
+{
+    if (on && !channel_.IsWriting())
+    {
+        channel_.EnableWriting();
+    }
+    else if (!on && channel_.IsWriting())
+    {
+        channel_.DisableWriting();
+    }
+}
+
+uint64_t TcpConnection::AllocateCompletionSeq()
+{
+    if (!completions_)
+    {
+        completions_.reset(new OrderedCompletions);
+    }
+    return completions_->next_seq++;
+}
+
+void TcpConnection::DeliverCompletion(uint64_t seq, std::function<void()> done)
+{
+    OrderedCompletions &completions = *completions_;
+    if (seq != completions.next_deliver)
+    {
+        completions.ready[seq] = std::move(done);
+        return;
+    }
+
+    done();
+    ++completions.next_deliver;
+
+    // 执行后面已经完成的
+    while (!completions.ready.empty() && completions.ready.begin()->first == completions.next_deliver)
+    {
+        std::function<void()> next = std::move(completions.ready.begin()->second);
+        completions.ready.erase(completions.ready.begin());
+        next();
+        ++completions.next_deliver;
+    }
+}
+
+// 连接不在迁移时只在跨线程操作中短暂持有，按连接地址分散到一组锁上，不占用每个连接的内存
+static std::mutex& MigrationMutex(const TcpConnection *conn)
+{
+    static const size_t kNumMutexes = 64;
+    static std::mutex mutexes[kNumMutexes];
+    return mutexes[(reinterpret_cast<uintptr_t>(conn) >> 6) % kNumMutexes];
+}
+
+// 先读 loop_ 再读 migrating_：读到 target 时一定能看到迁移已经开始
+bool TcpConnection::IsInOwnerLoop() const
+{
+    return loop()->IsInLoopThread() && !migrating_;
+}
+
+/**
+ * 跨线程操作在锁内入队，和 MigrateInLoop 切换 loop_ 互斥
+ * 这样迁移开始前入队的操作都排在源 loop 的 HandoffInLoop 前面，之后的暂存在 backlog 中
+ */
+void TcpConnection::RunInOwnerLoop(std::function<void()> cb, bool queue)
+{
+    std::unique_lock<std::mutex> lock(MigrationMutex(this));
+    if (migrating_)
+    {
+        migration_->backlog.push_back(std::move(cb));
+        return;
+    }
+
+    EventLoop *loop = this->loop();
+    if (!queue && loop->IsInLoopThread())
+    {
+        lock.unlock();
+        cb();
+    }
+    else
+    {
+        loop->QueueInLoop(std::move(cb));
+    }
+}
+
+void TcpConnection::MigrateTo(EventLoop *target, const std::shared_ptr<TimingWheel> &idle_wheel)
+{
+    // 总是排队执行，保证源 loop 中当前这一轮的事件已经处理完
+    RunInOwnerLoop(std::bind(&TcpConnection::MigrateInLoop, shared_from_this(), target, idle_wheel), true);
+}
+
+// 第一步，在源 loop 中：从 poller 和时间轮中摘下，切换 loop_
+void TcpConnection::MigrateInLoop(EventLoop *target, const std::shared_ptr<TimingWheel> &idle_wheel)
+{
+    EventLoop *source = loop();
+    if (target == source || state_ != kConnected || passthrough_
+        || (completions_ && completions_->next_deliver != completions_->next_seq))
+    {
+        LOG_INFO("TcpConnection[%s] not migrated \n", name().c_str());
+        return;
+    }
+
+    MigrationState *migration = new MigrationState;
+    migration->idle_wheel = idle_wheel;
+    migration->reading = channel_.IsReading();
+
+    channel_.DisableAll();
+    channel_.Remove();
+    if (idle_wheel_)
+    {
+        idle_wheel_->Remove(&idle_entry_);
+    }
+
+    LoopMetrics &metrics = source->metrics();
+    metrics.connections.Add(-1);
+    metrics.output_bytes_pending.Add(-static_cast<int64_t>(PendingOutputBytes()));
+
+    {
+        std::unique_lock<std::mutex> lock(MigrationMutex(this));
+        migration_.reset(migration);
+        migrating_ = true;
+        loop_ = target;
+    }
+
+    // 切换之前已经排进源 loop 的操作还没执行，它们在源 loop 中只把数据追加到发送队列
+    source->QueueInLoop(std::bind(&TcpConnection::HandoffInLoop, shared_from_this()));
+}
+
+// 第二步，在源 loop 中：之前排队的操作都执行完了，交给 target
+void TcpConnection::HandoffInLoop()
+{
+    channel_.set_owner_loop(loop());
+    loop()->QueueInLoop(std::bind(&TcpConnection::AttachInLoop, shared_from_this()));
+}
+
+// 第三步，在 target 中：重新注册，按顺序执行迁移期间暂存的操作
+void TcpConnection::AttachInLoop()
+{
+    LoopMetrics &metrics = loop()->metrics();
+    metrics.connections.Increment();
+    metrics.output_bytes_pending.Add(PendingOutputBytes());
+
+    idle_wheel_ = migration_->idle_wheel;
+    if (idle_wheel_)
+    {
+        idle_entry_.conn = this;
+        idle_wheel_->Add(&idle_entry_);
+    }
+
+    if (migration_->reading)
+    {
+        channel_.EnableReading();
+    }
+    if (PendingOutputBytes() > 0)
+    {
+        channel_.EnableWriting();
+    }
+
+    std::vector<std::function<void()>> backlog;
     {
-        socket_->ShutdownWrite();
+        std::unique_lock<std::mutex> lock(MigrationMutex(this));
+        backlog.swap(migration_->backlog);
+        migration_.reset();
+        migrating_ = false;
+    }
+
+    for (const std::function<void()> &cb : backlog)
+    {
+        cb();
+    }
+
+    if (state_ == kDisconnecting)
+    {
+        ShutdownInLoop();
     }
 }
 
+bool TcpConnection::SetBusyPoll(int usecs)
+{
+    return socket_.SetBusyPoll(usecs, true);
+}
+
 void TcpConnection::ConnectEstablished()
 {
     set_state(kConnected);
-    channel_->tie(shared_from_this());
+    channel_.tie(shared_from_this());
+
+    if (idle_wheel_)
+    {
+        idle_entry_.conn = this;
+        idle_wheel_->Add(&idle_entry_);
+    }
+
+    if (zerocopy_threshold_ > 0)
+    {
+        int optval = 1;
+        if (::setsockopt(channel_.fd(), SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) < 0)
+        {
+            LOG_INFO("TcpConnection[%s] SO_ZEROCOPY not supported, errno=%d \n", name().c_str(), errno);
+            zerocopy_threshold_ = 0;
+        }
+    }
 
     // 向 poller 注册channel的 epollin 事件
-    channel_->EnableReading(); 
+    channel_.EnableReading(); 
+    loop()->metrics().connections.Increment();
 
-    connection_callback_(shared_from_this());
+    shared_->connection_callback(shared_from_this());
 }
 
 void TcpConnection::ConnectDestroyed()
 {
+    LoopMetrics &metrics = loop()->metrics();
+    metrics.connections.Add(-1);
+    metrics.closes.Increment();
+    metrics.output_bytes_pending.Add(-static_cast<int64_t>(PendingOutputBytes()));
+    output_buffer_.retrieveAll();
+    if (shared_output_)
+    {
+        shared_output_->chunks.clear();
+        shared_output_->bytes = 0;
+        if (!shared_output_->zerocopy_inflight.empty())
+        {
+            // 连接关闭以后收不到完成通知了，由 loop 的定时器持有一段时间再释放
+            std::shared_ptr<SharedOutput> lingering(shared_output_.release());
+            loop()->RunAfter(kZeroCopyLingerSeconds, [lingering]() {});
+        }
+    }
+
     if (state_ == kConnected)
     {
         set_state(kDisconnected);
 
         // 把 channel 的所有感兴趣的事件，从 poller 中 del 掉
-        channel_->DisableAll();         
+        channel_.DisableAll();         
+
+        shared_->connection_callback(shared_from_this());
+    }
 
-        connection_callback_(shared_from_this());
+    if (idle_wheel_)
+    {
+        idle_wheel_->Remove(&idle_entry_);
     }
 
     // 把 channel 从 poller 中删除掉
-    channel_->Remove();                 
+    channel_.Remove();                 
 }
 
 void TcpConnection::HandleRead(Timestamp receive_time)
 {
+    if (passthrough_ && passthrough_->read)
+    {
+        if (idle_wheel_)
+        {
+            idle_wheel_->Touch(&idle_entry_);
+        }
+        passthrough_->read();
+        return;
+    }
+
     int saved_errno = 0;
-    ssize_t n = input_buffer_.readFd(channel_->fd(), &saved_errno);
+    ssize_t n = input_buffer_.readFd(channel_.fd(), &saved_errno);
     if (n > 0)
     {
+        loop()->metrics().bytes_read.Add(n);
+        AddTraffic(n);
+
+        if (idle_wheel_)
+        {
+            idle_wheel_->Touch(&idle_entry_);
+        }
+
         // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作 onMessage
-        message_callback_(shared_from_this(), &input_buffer_, receive_time);
+        shared_->message_callback(shared_from_this(), &input_buffer_, receive_time);
     }
     else if (n == 0)
     {
@@ -226,37 +930,52 @@ void TcpConnection::HandleRead(Timestamp receive_time)
 
 void TcpConnection::HandleWrite()
 {
-    if (channel_->IsWriting())
+    if (passthrough_ && passthrough_->write)
     {
-        int saved_errno = 0;
-        ssize_t n = output_buffer_.writeFd(channel_->fd(), &saved_errno);
-        if (n > 0)
+        if (idle_wheel_)
         {
-            output_buffer_.retrieve(n);
-            if (output_buffer_.readableBytes() == 0)
+            idle_wheel_->Touch(&idle_entry_);
+        }
+        passthrough_->write();
+        return;
+    }
+
+    if (channel_.IsWriting())
+    {
+        LoopMetrics &metrics = loop()->metrics();
+        bool failed = false;
+        ssize_t total = WriteOutput(&failed);
+
+        if (total > 0)
+        {
+            if (idle_wheel_)
             {
-                channel_->DisableWriting();
-                if (write_complete_callback_)
-                {
-                    // 唤醒 loop_对应的 thread 线程，执行回调
-                    loop_->QueueInLoop(
-                        std::bind(write_complete_callback_, shared_from_this())
-                    );
-                }
+                idle_wheel_->Touch(&idle_entry_);
+            }
+
+            metrics.bytes_written.Add(total);
+            metrics.output_bytes_pending.Add(-total);
+            AddTraffic(total);
+
+            if (PendingOutputBytes() == 0)
+            {
+                channel_.DisableWriting();
+                // 唤醒 loop_对应的 thread 线程，执行回调
+                QueueWriteComplete();
                 if (state_ == kDisconnecting)
                 {
                     ShutdownInLoop();
                 }
             }
         }
-        else
+        else if (failed)
         {
             LOG_ERROR("TcpConnection::handleWrite");
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
     }
 }
 
@@ -264,22 +983,98 @@ void TcpConnection::HandleWrite()
 // poller => channel::CloseCallback => TcpConnection::HandleClose
 void TcpConnection::HandleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(), (int)state_);
     set_state(kDisconnected);
-    channel_->DisableAll();
+    channel_.DisableAll();
+
+    if (idle_wheel_)
+    {
+        idle_wheel_->Remove(&idle_entry_);
+    }
 
     TcpConnectionPtr connPtr(shared_from_this());
 
-    connection_callback_(connPtr);
-    close_callback_(connPtr);        // 关闭连接的回调，执行 TcpServer::RemoveConnection 回调方法
+    shared_->connection_callback(connPtr);
+    shared_->close_callback(connPtr);        // 关闭连接的回调，执行 TcpServer::RemoveConnection 回调方法
+}
+
+// 读取错误队列中的零拷贝完成通知，释放内核已经不再引用的数据
+bool TcpConnection::HandleZeroCopyNotifications()
+{
+    if (!shared_output_ || shared_output_->zerocopy_inflight.empty())
+    {
+        return false;
+    }
+
+    bool handled = false;
+    while (true)
+    {
+        char control[128];
+        msghdr msg;
+        bzero(&msg, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_.fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            break;
+        }
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            bool recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recverr)
+            {
+                continue;
+            }
+            const sock_extended_err *err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            handled = true;
+
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && zerocopy_threshold_ > 0)
+            {
+                // 内核还是拷贝了（比如 loopback），零拷贝只有额外开销，关掉
+                LOG_INFO("TcpConnection[%s] zerocopy fell back to copying, disabled \n", name().c_str());
+                zerocopy_threshold_ = 0;
+            }
+
+            // [ee_info, ee_data] 范围内的发送都已经完成，序号会回绕
+            uint32_t last = err->ee_data;
+            auto &inflight = shared_output_->zerocopy_inflight;
+            while (!inflight.empty() && static_cast<int32_t>(last - inflight.front().first) >= 0)
+            {
+                inflight.pop_front();
+            }
+        }
+    }
+
+    if (handled && shared_output_->zerocopy_inflight.empty()
+        && shared_output_->write_complete_pending)
+    {
+        shared_output_->write_complete_pending = false;
+        if (PendingOutputBytes() == 0)
+        {
+            QueueWriteComplete();
+        }
+    }
+    return handled;
 }
 
 void TcpConnection::HandleError()
 {
+    // 零拷贝完成通知也通过 EPOLLERR 报告
+    if (HandleZeroCopyNotifications())
+    {
+        return;
+    }
+
     int optval;
     socklen_t optlen = sizeof(optval);
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -288,5 +1083,5 @@ void TcpConnection::HandleError()
         err = optval;
     }
 
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
 }
\ No newline at end of file
@@ -5,56 +5,150 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "Socket.h"
+#include "Channel.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <map>
+#include <deque>
+#include <functional>
+#include <vector>
 
-class Channel;
 class EventLoop;
-class Socket;
+
+/**
+ * 同一个 TcpServer 的所有连接共用的回调和名字前缀，每个连接只保存一个指针
+ * 单独给某个连接设置回调时，这个连接复制一份自己的
+ */
+struct TcpConnectionShared
+{
+    TcpConnectionShared()
+        : high_watermark(64*1024*1024) // 64M
+    {}
+
+    std::string name_prefix;        // 连接名为 name_prefix + id
+    ConnectionCallback connection_callback;
+    MessageCallback message_callback;
+    WriteCompleteCallback write_complete_callback;
+    HighWaterMarkCallback high_watermark_callback;
+    size_t high_watermark;
+    CloseCallback close_callback;
+};
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过 accept 函数拿到 connfd
+ *
+ * 为了支持大量空闲连接，每个连接尽量少占内存：Socket 和 Channel 嵌在连接中，
+ * 回调和名字前缀共用 TcpConnectionShared，缓冲区在第一次读写时才分配，名字和本端地址用到时再生成
  */ 
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
-    TcpConnection(EventLoop *loop, 
-                const std::string &name, 
+    TcpConnection(EventLoop *loop,
+                const std::shared_ptr<TcpConnectionShared> &shared,
+                uint64_t id,
+                int sockfd,
+                const InetAddress& peerAddr);
+    // 不属于 TcpServer 的连接，使用自己的回调和名字
+    TcpConnection(EventLoop *loop,
+                const std::string &name,
                 int sockfd,
-                const InetAddress& localAddr,
                 const InetAddress& peerAddr);
     ~TcpConnection();
 
-    EventLoop* loop() const { return loop_; }
-    const std::string& name() const { return name_; }
-    const InetAddress& local_addr() const { return local_addr_; }
+    // 迁移以后会改变，可以跨线程读取
+    EventLoop* loop() const { return loop_.load(); }
+    uint64_t id() const { return id_; }
+    std::string name() const;
+    // 通过 getsockname 获取
+    InetAddress local_addr() const;
     const InetAddress& peer_addr() const { return peer_addr_; }
 
     bool connected() const { return state_ == kConnected; }
 
     void Send(const std::string &buf);
+    // 发送 buf 中所有可读的数据，发送以后 buf 被清空
+    void Send(Buffer *buf);
+    // 发送共享的数据，不拷贝，payload 在发送完成（开启零拷贝时是内核释放）之前一直被持有
+    void Send(const std::shared_ptr<const std::string> &payload);
     void Shutdown();
+    // 不等待对端，直接关闭连接
+    void ForceClose();
+    // 把 cb 排进连接当前所在的 loop 中执行，迁移期间暂存，迁移完成后在新 loop 中按顺序执行，可以跨线程调用
+    void QueueInOwnerLoop(std::function<void()> cb) { RunInOwnerLoop(std::move(cb), true); }
 
+    // 只修改这个连接的回调，不影响同一个 server 的其它连接
     void set_connection_callback(const ConnectionCallback& cb)
-    { connection_callback_ = cb; }
+    { MutableShared()->connection_callback = cb; }
 
     void set_message_callback(const MessageCallback& cb)
-    { message_callback_ = cb; }
+    { MutableShared()->message_callback = cb; }
 
     void set_write_complete_callback(const WriteCompleteCallback& cb)
-    { write_complete_callback_ = cb; }
+    { MutableShared()->write_complete_callback = cb; }
 
     void set_high_watermark_callback(const HighWaterMarkCallback& cb, size_t watermark)
     { 
-        high_watermark_callback_ = cb; 
-        high_watermark_ = watermark; 
+        TcpConnectionShared *shared = MutableShared();
+        shared->high_watermark_callback = cb; 
+        shared->high_watermark = watermark; 
     }
 
     void set_close_callback(const CloseCallback& cb)
-    { close_callback_ = cb; }
+    { MutableShared()->close_callback = cb; }
+
+    // 接收缓冲区，只在 loop 线程中访问
+    Buffer* input_buffer() { return &input_buffer_; }
+
+    // 上层协议保存在连接上的状态，比如 HttpServer 的解析器
+    void set_context(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void>& context() const { return context_; }
+
+    // 设置所在 loop 的空闲连接时间轮，在 ConnectEstablished 之前设置
+    void set_idle_wheel(const std::shared_ptr<TimingWheel> &wheel)
+    { idle_wheel_ = wheel; }
+
+    // 不小于 threshold 的共享数据用 MSG_ZEROCOPY 发送，0 表示关闭，在 ConnectEstablished 之前设置
+    // 内核不支持或者实际发生了拷贝（比如 loopback）时自动关闭
+    void set_zerocopy_threshold(size_t threshold) { zerocopy_threshold_ = threshold; }
+    size_t zerocopy_threshold() const { return zerocopy_threshold_; }
+
+    // 开启后 loop 线程中的发送只追加到发送队列，本轮循环结束时用一次 sendmsg 统一发出
+    // 一轮中多次 Send 的小响应会合并成一个报文，可以随时切换
+    void set_auto_cork(bool on) { auto_cork_ = on; }
+    bool auto_cork() const { return auto_cork_; }
+
+    // 在 socket 上开启 SO_BUSY_POLL 和 SO_PREFER_BUSY_POLL，配合 EventLoop::kBusyPoll 使用
+    bool SetBusyPoll(int usecs);
+
+    /**
+     * 给 TcpRelay 这类直接操作 fd 的组件使用，在 loop 线程中调用
+     * 设置以后 fd 上的读写事件直接交给 handler，不再经过 input_buffer_ 和 output_buffer_，传空的 handler 恢复
+     */ 
+    void set_passthrough_handlers(const std::function<void()> &read_handler,
+                                const std::function<void()> &write_handler);
+    int fd() const;
+    void EnableReadEvents(bool on);
+    void EnableWriteEvents(bool on);
 
+    // 按序号顺序执行完成回调，ThreadPool 用来把乱序完成的结果按提交顺序交付，在 loop 线程中调用
+    uint64_t AllocateCompletionSeq();
+    void DeliverCompletion(uint64_t seq, std::function<void()> done);
+
+    /**
+     * 把连接迁移到 target 上，可以跨线程调用，idle_wheel 为 target 上的空闲连接时间轮
+     * 从源 loop 的 poller 中摘下 channel，等源 loop 中已经排队的操作执行完，再在 target 中重新注册
+     * 迁移期间其它线程的 Send/Shutdown/ForceClose 暂存起来，注册以后按原来的顺序执行，数据不丢失也不乱序
+     * 使用 passthrough handler 或者有未完成的 ThreadPool 任务的连接不会迁移
+     */
+    void MigrateTo(EventLoop *target, const std::shared_ptr<TimingWheel> &idle_wheel = std::shared_ptr<TimingWheel>());
+    bool migrating() const { return migrating_; }
+
+    // 收发的总字节数，用来找出最忙的连接，可以跨线程读取
+    int64_t traffic_bytes() const { return traffic_bytes_.load(std::memory_order_relaxed); }
 
     void ConnectEstablished();
     void ConnectDestroyed();
@@ -63,33 +157,121 @@ private:
     enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
     void set_state(StateE s) { state_ = s; }
 
+    // 第一次单独设置回调时复制一份共用的回调
+    TcpConnectionShared* MutableShared();
+    // Channel 的 name provider，owner 是 tie 的 TcpConnection
+    static std::string ChannelOwnerName(const void *owner);
+
     void HandleRead(Timestamp receiveTime);
     void HandleWrite();
     void HandleClose();
     void HandleError();
 
     void SendInLoop(const void* message, size_t len);
+    void SendInLoop(const std::string &message);
+    void SendSharedInLoop(const std::shared_ptr<const std::string> &payload);
+    ssize_t WriteShared(const std::shared_ptr<const std::string> &payload, size_t offset);
+    bool HandleZeroCopyNotifications();
+    void QueueWriteComplete();
+    size_t PendingOutputBytes() const;
+    ssize_t WriteOutput(bool *failed);
+    void ConsumeOutput(size_t n);
+    void ScheduleCorkedFlush();
+    void FlushCorked();
     void ShutdownInLoop();
+    void ForceCloseInLoop();
+    void AppendOutput(const char *data, size_t len);
+    void AddTraffic(ssize_t n)
+    {
+        traffic_bytes_.store(traffic_bytes_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
 
-    EventLoop *loop_; // 这里一定不是base loop
-    const std::string name_;
+    // 在所属的 loop 中执行 cb，迁移期间暂存到 migration_->backlog
+    bool IsInOwnerLoop() const;
+    void RunInOwnerLoop(std::function<void()> cb, bool queue = false);
+    void MigrateInLoop(EventLoop *target, const std::shared_ptr<TimingWheel> &idle_wheel);
+    void HandoffInLoop();
+    void AttachInLoop();
+
+    std::atomic<EventLoop*> loop_; // 这里一定不是base loop
+    std::shared_ptr<TcpConnectionShared> shared_;
+    const uint64_t id_;
     std::atomic_int state_;
     bool reading_;
+    bool owns_shared_;              // shared_ 是这个连接自己的一份
 
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    Socket socket_;
+    Channel channel_;
 
-    const InetAddress local_addr_;
     const InetAddress peer_addr_;
 
-    ConnectionCallback connection_callback_;
-    MessageCallback message_callback_;
-    WriteCompleteCallback write_complete_callback_; 
-    HighWaterMarkCallback high_watermark_callback_;
-    CloseCallback close_callback_;
+    Buffer input_buffer_;        // 接收数据的缓冲区，第一次读到数据时分配
+    Buffer output_buffer_;      // 发送数据的缓冲区，第一次有数据没发完时分配
+
+    struct PassthroughHandlers
+    {
+        std::function<void()> read;
+        std::function<void()> write;
+    };
+    std::unique_ptr<PassthroughHandlers> passthrough_;
+
+    // 排在 output_buffer_ 后面的共享数据块，只在使用 Send(shared_ptr) 的连接上分配
+    // 一旦有数据块在排队，之后拷贝发送的数据也作为数据块排在后面，保证顺序
+    struct SharedOutput
+    {
+        struct Chunk
+        {
+            std::shared_ptr<const std::string> data;
+            size_t offset;
+        };
+
+        SharedOutput()
+            : bytes(0)
+            , next_zerocopy_id(0)
+            , write_complete_pending(false)
+        {}
+
+        std::deque<Chunk> chunks;
+        size_t bytes;                   // chunks 中还没发送的字节数
+        // 内核还在引用的零拷贝发送，按内核分配的序号递增
+        std::deque<std::pair<uint32_t, std::shared_ptr<const std::string>>> zerocopy_inflight;
+        uint32_t next_zerocopy_id;
+        bool write_complete_pending;    // 数据已经发完，等零拷贝完成通知以后再回调
+    };
+    std::unique_ptr<SharedOutput> shared_output_;
+    size_t zerocopy_threshold_;
+
+    bool auto_cork_;
+    bool cork_flush_scheduled_;     // 本轮循环已经登记过 FlushCorked
+
+    std::shared_ptr<void> context_;
+
+    // 没有使用 ThreadPool 的连接不分配
+    struct OrderedCompletions
+    {
+        OrderedCompletions()
+            : next_seq(0)
+            , next_deliver(0)
+        {}
+
+        uint64_t next_seq;
+        uint64_t next_deliver;
+        std::map<uint64_t, std::function<void()>> ready;   // 已经完成但前面还有没完成的
+    };
+    std::unique_ptr<OrderedCompletions> completions_;
 
-    size_t high_watermark_;
+    // 迁移过程中的状态，只在迁移时分配
+    struct MigrationState
+    {
+        std::shared_ptr<TimingWheel> idle_wheel;    // target 上的时间轮
+        bool reading;
+        std::vector<std::function<void()>> backlog;
+    };
+    std::unique_ptr<MigrationState> migration_;
+    std::atomic_bool migrating_;
+    std::atomic<int64_t> traffic_bytes_;    // 单写者
 
-    Buffer input_buffer_;        // 接收数据的缓冲区
-    Buffer output_buffer_;      // 发送数据的缓冲区
+    // 空闲连接检测，未开启时 idle_wheel_ 为空
+    std::shared_ptr<TimingWheel> idle_wheel_;
+    TimingWheel::Entry idle_entry_;
 };
\ No newline at end of file
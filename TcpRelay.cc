@@ -0,0 +1,398 @@
+#include "TcpRelay.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+namespace
+{
+
+// 每个方向 pipe 的大小，也是一次 splice 最多搬运的字节数
+const int kPipeSize = 1024 * 1024;
+
+}
+
+TcpRelay::TcpRelay(const TcpConnectionPtr &inbound, const InetAddress &upstream)
+    : loop_(inbound->loop())
+    , inbound_(inbound)
+    , upstream_addr_(upstream)
+    , upstream_fd_(-1)
+    , connecting_(false)
+    , closed_(false)
+{
+}
+
+TcpRelay::~TcpRelay()
+{
+    Direction *dirs[] = {&to_upstream_, &to_downstream_};
+    for (Direction *dir : dirs)
+    {
+        if (dir->pipe_read >= 0)
+        {
+            ::close(dir->pipe_read);
+            ::close(dir->pipe_write);
+        }
+    }
+    if (upstream_fd_ >= 0)
+    {
+        ::close(upstream_fd_);
+    }
+}
+
+bool TcpRelay::OpenPipe(Direction *dir)
+{
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("TcpRelay pipe2 error:%d \n", errno);
+        return false;
+    }
+    dir->pipe_read = fds[0];
+    dir->pipe_write = fds[1];
+
+    // 超过 /proc/sys/fs/pipe-max-size 时失败，使用默认大小
+    ::fcntl(dir->pipe_write, F_SETPIPE_SZ, kPipeSize);
+    int size = ::fcntl(dir->pipe_write, F_GETPIPE_SZ);
+    dir->capacity = size > 0 ? size : 65536;
+    return true;
+}
+
+void TcpRelay::Start()
+{
+    // 已经读到 input_buffer_ 里的数据（比如为了选择上游而解析过的协议头）先发给上游
+    Buffer *input = inbound_->input_buffer();
+    prefix_.append(input->peek(), input->readableBytes());
+    input->retrieveAll();
+
+    // 连上上游之前不读入站连接
+    inbound_->EnableReadEvents(false);
+    inbound_->set_passthrough_handlers(
+        std::bind(&TcpRelay::HandleInboundRead, this),
+        std::bind(&TcpRelay::HandleInboundWrite, this));
+
+    if (!OpenPipe(&to_upstream_) || !OpenPipe(&to_downstream_))
+    {
+        Close();
+        return;
+    }
+
+    upstream_fd_ = ::socket(upstream_addr_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (upstream_fd_ < 0)
+    {
+        LOG_ERROR("TcpRelay socket error:%d \n", errno);
+        Close();
+        return;
+    }
+
+    upstream_channel_.reset(new Channel(loop_, upstream_fd_));
+    upstream_channel_->set_name("relay upstream");
+    upstream_channel_->tie(shared_from_this());
+    upstream_channel_->set_read_callback(std::bind(&TcpRelay::HandleUpstreamRead, this));
+    upstream_channel_->set_write_callback(std::bind(&TcpRelay::HandleUpstreamWrite, this));
+    upstream_channel_->set_close_callback(std::bind(&TcpRelay::HandleUpstreamRead, this));
+    upstream_channel_->set_error_callback(std::bind(&TcpRelay::HandleUpstreamError, this));
+
+    to_upstream_.src_fd = inbound_->fd();
+    to_upstream_.dst_fd = upstream_fd_;
+    to_downstream_.src_fd = upstream_fd_;
+    to_downstream_.dst_fd = inbound_->fd();
+
+    int ret = ::connect(upstream_fd_, upstream_addr_.sock_addr(), upstream_addr_.sock_len());
+    if (ret == 0)
+    {
+        OnUpstreamConnected();
+    }
+    else if (errno == EINPROGRESS)
+    {
+        // 连接完成时 fd 可写
+        connecting_ = true;
+        upstream_channel_->EnableWriting();
+    }
+    else
+    {
+        LOG_ERROR("TcpRelay connect %s error:%d \n", upstream_addr_.ToIpPort().c_str(), errno);
+        Close();
+    }
+}
+
+void TcpRelay::Stop()
+{
+    Close();
+}
+
+void TcpRelay::OnUpstreamConnected()
+{
+    connecting_ = false;
+
+    int err = 0;
+    socklen_t len = sizeof err;
+    ::getsockopt(upstream_fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0)
+    {
+        LOG_ERROR("TcpRelay connect %s error:%d \n", upstream_addr_.ToIpPort().c_str(), err);
+        Close();
+        return;
+    }
+
+    upstream_channel_->EnableReading();
+    if (FlushPrefix())
+    {
+        SetDestinationWriting(&to_upstream_, false);
+        SetSourceReading(&to_upstream_, true);
+    }
+}
+
+// 返回 true 表示 prefix_ 已经全部发出
+bool TcpRelay::FlushPrefix()
+{
+    if (prefix_.readableBytes() == 0)
+    {
+        return true;
+    }
+
+    ssize_t n = ::write(upstream_fd_, prefix_.peek(), prefix_.readableBytes());
+    if (n > 0)
+    {
+        prefix_.retrieve(n);
+        to_upstream_.total += n;
+        loop_->metrics().bytes_written.Add(n);
+    }
+    else if (n < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR("TcpRelay write upstream error:%d \n", errno);
+        Close();
+        return false;
+    }
+
+    if (prefix_.readableBytes() > 0)
+    {
+        SetDestinationWriting(&to_upstream_, true);
+        return false;
+    }
+    return true;
+}
+
+void TcpRelay::HandleUpstreamRead()
+{
+    // 连接失败时报告的是 EPOLLHUP/EPOLLERR
+    if (connecting_)
+    {
+        OnUpstreamConnected();
+        return;
+    }
+    ReadSource(&to_downstream_);
+}
+
+void TcpRelay::HandleUpstreamWrite()
+{
+    if (connecting_)
+    {
+        OnUpstreamConnected();
+        return;
+    }
+    if (!FlushPrefix())
+    {
+        return;
+    }
+    Drain(&to_upstream_);
+}
+
+void TcpRelay::HandleUpstreamError()
+{
+    if (connecting_)
+    {
+        OnUpstreamConnected();
+        return;
+    }
+
+    int err = 0;
+    socklen_t len = sizeof err;
+    ::getsockopt(upstream_fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0)
+    {
+        LOG_ERROR("TcpRelay upstream %s error:%d \n", upstream_addr_.ToIpPort().c_str(), err);
+        Close();
+    }
+}
+
+void TcpRelay::HandleInboundRead()
+{
+    ReadSource(&to_upstream_);
+}
+
+void TcpRelay::HandleInboundWrite()
+{
+    Drain(&to_downstream_);
+}
+
+// 从源端读进 pipe，直到 pipe 满、源端暂时没有数据或者读到 EOF
+void TcpRelay::ReadSource(Direction *dir)
+{
+    if (closed_)
+    {
+        return;
+    }
+
+    while (!dir->src_eof && dir->in_pipe < dir->capacity)
+    {
+        ssize_t n = ::splice(dir->src_fd, nullptr, dir->pipe_write, nullptr,
+            dir->capacity - dir->in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            dir->in_pipe += n;
+            loop_->metrics().bytes_read.Add(n);
+        }
+        else if (n == 0)
+        {
+            dir->src_eof = true;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno == EAGAIN)
+        {
+            // pipe 中还有数据时分不清是源端读空了还是 pipe 满了，按满处理：
+            // 源端 EPOLLIN 是水平触发，目的端写不进去时一直打开会空转
+            dir->pipe_full = dir->in_pipe > 0;
+            break;
+        }
+        else
+        {
+            LOG_ERROR("TcpRelay splice from fd=%d error:%d \n", dir->src_fd, errno);
+            Close();
+            return;
+        }
+    }
+
+    Drain(dir);
+}
+
+// 把 pipe 中的数据写到目的端，然后根据 pipe 的状态调整两端关心的事件
+void TcpRelay::Drain(Direction *dir)
+{
+    if (closed_)
+    {
+        return;
+    }
+
+    while (dir->in_pipe > 0)
+    {
+        ssize_t n = ::splice(dir->pipe_read, nullptr, dir->dst_fd, nullptr,
+            dir->in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            dir->in_pipe -= n;
+            dir->pipe_full = false;
+            dir->total += n;
+            loop_->metrics().bytes_written.Add(n);
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && errno == EAGAIN)
+        {
+            break;
+        }
+        else
+        {
+            LOG_ERROR("TcpRelay splice to fd=%d error:%d \n", dir->dst_fd, errno);
+            Close();
+            return;
+        }
+    }
+
+    SetDestinationWriting(dir, dir->in_pipe > 0);
+    SetSourceReading(dir, !dir->src_eof && !dir->pipe_full && dir->in_pipe < dir->capacity);
+
+    if (dir->src_eof && dir->in_pipe == 0)
+    {
+        ShutdownDestination(dir);
+    }
+    MaybeFinish();
+}
+
+void TcpRelay::SetSourceReading(Direction *dir, bool on)
+{
+    if (dir == &to_upstream_)
+    {
+        inbound_->EnableReadEvents(on);
+    }
+    else if (on && !upstream_channel_->IsReading())
+    {
+        upstream_channel_->EnableReading();
+    }
+    else if (!on && upstream_channel_->IsReading())
+    {
+        upstream_channel_->DisableReading();
+    }
+}
+
+void TcpRelay::SetDestinationWriting(Direction *dir, bool on)
+{
+    if (dir == &to_downstream_)
+    {
+        inbound_->EnableWriteEvents(on);
+    }
+    else if (on && !upstream_channel_->IsWriting())
+    {
+        upstream_channel_->EnableWriting();
+    }
+    else if (!on && upstream_channel_->IsWriting())
+    {
+        upstream_channel_->DisableWriting();
+    }
+}
+
+// 半关闭：源端不会再有数据了，告诉目的端
+void TcpRelay::ShutdownDestination(Direction *dir)
+{
+    if (!dir->dst_shutdown)
+    {
+        dir->dst_shutdown = true;
+        ::shutdown(dir->dst_fd, SHUT_WR);
+    }
+}
+
+void TcpRelay::MaybeFinish()
+{
+    if (to_upstream_.dst_shutdown && to_downstream_.dst_shutdown)
+    {
+        Close();
+    }
+}
+
+void TcpRelay::Close()
+{
+    if (closed_)
+    {
+        return;
+    }
+    closed_ = true;
+
+    if (upstream_channel_)
+    {
+        upstream_channel_->DisableAll();
+        upstream_channel_->Remove();
+    }
+
+    // 可能正在 passthrough 的 handler 里，handler 放到下一次清除
+    TcpConnectionPtr conn = inbound_;
+    conn->EnableReadEvents(false);
+    conn->EnableWriteEvents(false);
+    loop_->QueueInLoop([conn]() {
+        conn->set_passthrough_handlers(std::function<void()>(), std::function<void()>());
+    });
+    conn->ForceClose();
+
+    if (close_callback_)
+    {
+        close_callback_(shared_from_this());
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+class EventLoop;
+class Channel;
+
+/**
+ * 四层转发：把一个已经建立的 TcpConnection 和一条到上游的连接配对，
+ * 两个方向的数据都通过各自的 pipe 用 splice() 搬运，不经过用户态缓冲区
+ *
+ * 背压：pipe 满了就停止读源端（关掉源端的 EPOLLIN），目的端写不进去时等 EPOLLOUT
+ * 半关闭：一端读到 EOF 并且 pipe 中的数据都发出去以后，对另一端 shutdown(SHUT_WR)，另一个方向继续转发
+ * 两个方向都结束或者任意一端出错时关闭整个转发
+ *
+ * 在入站连接所在的 loop 线程中创建和使用，通常保存在连接的 context 中：
+ *   连接建立时创建并 Start，连接断开时 Stop 并清空 context（打破 连接 -> context -> relay -> 连接 的引用环）
+ */ 
+class TcpRelay : noncopyable, public std::enable_shared_from_this<TcpRelay>
+{
+public:
+    using RelayCloseCallback = std::function<void (const std::shared_ptr<TcpRelay>&)>;
+
+    TcpRelay(const TcpConnectionPtr &inbound, const InetAddress &upstream);
+    ~TcpRelay();
+
+    void set_close_callback(const RelayCloseCallback &cb) { close_callback_ = cb; }
+
+    // 连接上游，连上以后开始转发；入站连接 input_buffer_ 中已有的数据先发给上游
+    void Start();
+    void Stop();
+
+    const TcpConnectionPtr& inbound() const { return inbound_; }
+    uint64_t bytes_to_upstream() const { return to_upstream_.total; }
+    uint64_t bytes_to_downstream() const { return to_downstream_.total; }
+private:
+    // 一个方向：从 src 读进 pipe，再从 pipe 写到 dst
+    struct Direction
+    {
+        Direction()
+            : src_fd(-1), dst_fd(-1), pipe_read(-1), pipe_write(-1)
+            , in_pipe(0), capacity(0), total(0), src_eof(false), pipe_full(false), dst_shutdown(false)
+        {}
+
+        int src_fd;
+        int dst_fd;
+        int pipe_read;
+        int pipe_write;
+        size_t in_pipe;         // pipe 中的字节数
+        size_t capacity;
+        uint64_t total;
+        bool src_eof;
+        bool pipe_full;         // pipe 没到 capacity 也可能写不进去（buffer 槽用完），Drain 腾出空间之前不读源端
+        bool dst_shutdown;
+    };
+
+    bool OpenPipe(Direction *dir);
+    void OnUpstreamConnected();
+    void HandleUpstreamRead();
+    void HandleUpstreamWrite();
+    void HandleUpstreamError();
+    void HandleInboundRead();
+    void HandleInboundWrite();
+
+    void ReadSource(Direction *dir);
+    void Drain(Direction *dir);
+    bool FlushPrefix();
+    void SetSourceReading(Direction *dir, bool on);
+    void SetDestinationWriting(Direction *dir, bool on);
+    void ShutdownDestination(Direction *dir);
+    void MaybeFinish();
+    void Close();
+
+    EventLoop *loop_;
+    TcpConnectionPtr inbound_;
+    InetAddress upstream_addr_;
+    int upstream_fd_;
+    std::unique_ptr<Channel> upstream_channel_;
+    bool connecting_;
+    bool closed_;
+
+    Direction to_upstream_;
+    Direction to_downstream_;
+    Buffer prefix_;             // 开始转发前入站连接已经读到的数据
+    RelayCloseCallback close_callback_;
+};
+
+using TcpRelayPtr = std::shared_ptr<TcpRelay>;
@@ -1,9 +1,13 @@
 #include "TcpServer.h"
+#include "Slab.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "MetricsExporter.h"
+#include "LoopWatchdog.h"
 
 #include <strings.h>
 #include <functional>
+#include <algorithm>
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -14,19 +18,67 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+// 已经 bind 过的 socket 的本地地址
+static InetAddress LocalAddressOf(int sockfd)
+{
+    sockaddr_storage local;
+    ::bzero(&local, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+
+    InetAddress addr;
+    addr.set_sock_addr((sockaddr*)&local, addrlen);
+    return addr;
+}
+
 TcpServer::TcpServer(EventLoop *loop,
                 const InetAddress &listen_addr,
                 const std::string &name_arg,
                 Option option)
-                : loop_(CheckLoopNotNull(loop))
-                , ip_port_(listen_addr.ToIpPort())
+                : TcpServer(CheckLoopNotNull(loop),
+                    new Acceptor(loop, listen_addr, option == kReusePort),
+                    listen_addr.ToIpPort(),
+                    name_arg)
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop, int listen_fd, const std::string &name_arg)
+                : TcpServer(CheckLoopNotNull(loop),
+                    new Acceptor(loop, listen_fd),
+                    LocalAddressOf(listen_fd).ToIpPort(),
+                    name_arg)
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop,
+                Acceptor *acceptor,
+                const std::string &ip_port,
+                const std::string &name_arg)
+                : loop_(loop)
+                , ip_port_(ip_port)
                 , name_(name_arg)
-                , acceptor_(new Acceptor(loop, listen_addr, option == kReusePort))
+                , acceptor_(acceptor)
                 , thread_pool_(new EventLoopThreadPool(loop, name_))
                 , connection_callback_()
                 , message_callback_()
                 , next_conn_id_(1)
                 , started_(0)
+                , pending_connections_(0)
+                , idle_timeout_seconds_(0)
+                , zerocopy_threshold_(0)
+                , auto_cork_(false)
+                , poll_policy_(EventLoop::kBlockingPoll)
+                , spin_us_(EventLoop::kDefaultSpinMicros)
+                , functor_budget_count_(0)
+                , functor_budget_us_(0)
+                , socket_busy_poll_us_(0)
+                , slow_callback_threshold_us_(0)
+                , stall_deadline_ms_(0)
+                , draining_(false)
+                , drain_deadline_reached_(false)
 {
     // 当有新用户连接时， 会执行 TcpServer::NewConnection 回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::NewConnection, this, 
@@ -35,6 +87,17 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
+    if (watchdog_)
+    {
+        watchdog_->Stop();
+    }
+
+    // 时间轮的 tick 在各自的 loop 线程中取消，绑定的 shared_ptr 保证执行前时间轮不会析构
+    for (auto &item : idle_wheels_)
+    {
+        item.first->RunInLoop(std::bind(&TimingWheel::Stop, item.second));
+    }
+
     for (auto &item : connections_)
     {
         
@@ -53,6 +116,12 @@ void TcpServer::SetThreadNum(int num_threads)
     thread_pool_->set_num_threads(num_threads);
 }
 
+void TcpServer::EnableMetricsExporter(const InetAddress &addr)
+{
+    metrics_exporter_.reset(new MetricsExporter(loop_, addr, name_ + "-metrics",
+        std::bind(&TcpServer::RenderMetrics, this)));
+}
+
 void TcpServer::Start()
 {
     // 防止一个TcpServer对象被 start 多次
@@ -61,60 +130,426 @@ void TcpServer::Start()
         // 启动底层的loop线程池
         thread_pool_->Start(thread_init_callback_); 
 
+        if (stall_deadline_ms_ > 0)
+        {
+            watchdog_.reset(new LoopWatchdog(stall_deadline_ms_));
+        }
+
+        std::vector<EventLoop*> loops = thread_pool_->GetAllLoops();
+        for (EventLoop *loop : loops)
+        {
+            SetupLoop(loop, true);
+        }
+        if (std::find(loops.begin(), loops.end(), loop_) == loops.end())
+        {
+            // baseloop 上统计了 accept 的个数
+            SetupLoop(loop_, false);
+        }
+
+        if (watchdog_)
+        {
+            watchdog_->Start();
+        }
+
+        if (metrics_exporter_)
+        {
+            metrics_exporter_->Start();
+        }
+
+        if (autoscale_)
+        {
+            autoscale_->last_check_us = MonotonicMicros();
+            loop_->RunEvery(autoscale_->interval_seconds, std::bind(&TcpServer::Autoscale, this));
+        }
+
+        if (rebalance_)
+        {
+            SampleLoopBusy(&rebalance_->last_busy_us);
+            loop_->RunEvery(rebalance_->interval_seconds, std::bind(&TcpServer::Rebalance, this));
+        }
+
         // 开始监听
         loop_->RunInLoop(std::bind(&Acceptor::Listen, acceptor_.get()));
     }
 }
 
+// 对每个 loop 应用服务器的配置，Start 时和运行时新建 loop 时调用，在 baseloop 线程中执行
+void TcpServer::SetupLoop(EventLoop *loop, bool io_loop)
+{
+    {
+        std::unique_lock<std::mutex> lock(stats_mutex_);
+        stats_loops_.push_back(loop);
+    }
+
+    if (slow_callback_threshold_us_ > 0)
+    {
+        loop->set_slow_callback_threshold(slow_callback_threshold_us_);
+    }
+
+    if (watchdog_)
+    {
+        watchdog_->Watch(loop);
+    }
+
+    if (!io_loop)
+    {
+        return;
+    }
+
+    if (poll_policy_ != EventLoop::kBlockingPoll)
+    {
+        loop->set_poll_policy(poll_policy_, spin_us_);
+    }
+
+    if (functor_budget_count_ > 0 || functor_budget_us_ > 0)
+    {
+        loop->set_functor_budget(functor_budget_count_, functor_budget_us_);
+    }
+
+    if (idle_timeout_seconds_ > 0)
+    {
+        std::shared_ptr<TimingWheel> wheel(new TimingWheel(loop, idle_timeout_seconds_));
+        idle_wheels_[loop] = wheel;
+        loop->RunInLoop(std::bind(&TimingWheel::Start, wheel));
+    }
+}
+
+void TcpServer::AddLoop()
+{
+    loop_->RunInLoop(std::bind(&TcpServer::AddLoopInLoop, this));
+}
+
+void TcpServer::RetireLoop()
+{
+    loop_->RunInLoop(std::bind(&TcpServer::RetireLoopInLoop, this));
+}
+
+void TcpServer::AddLoopInLoop()
+{
+    bool created = false;
+    EventLoop *loop = thread_pool_->AddLoop(&created);
+    if (created)
+    {
+        SetupLoop(loop, true);
+    }
+    else if (poll_policy_ != EventLoop::kBlockingPoll)
+    {
+        // 退役时改成了阻塞等待，重新启用时恢复
+        loop->set_poll_policy(poll_policy_, spin_us_);
+    }
+    LOG_INFO("TcpServer[%s] %s loop %p, %zu active loops \n", name_.c_str(),
+        created ? "created" : "reactivated", loop, thread_pool_->num_active_loops());
+}
+
+void TcpServer::RetireLoopInLoop()
+{
+    EventLoop *loop = thread_pool_->RetireLoop();
+    if (loop != nullptr)
+    {
+        // 退役的 loop 上只剩逐渐关闭的旧连接，不再自旋，把核让出来
+        loop->set_poll_policy(EventLoop::kBlockingPoll);
+        LOG_INFO("TcpServer[%s] retired loop %p, %zu active loops \n", name_.c_str(),
+            loop, thread_pool_->num_active_loops());
+    }
+}
+
+size_t TcpServer::num_active_loops() const
+{
+    return thread_pool_->num_active_loops();
+}
+
+void TcpServer::EnableAutoscale(int min_loops, int max_loops, double interval_seconds,
+                            double high_busy_ratio, double low_busy_ratio)
+{
+    autoscale_.reset(new AutoscaleState);
+    autoscale_->min_loops = std::max(1, min_loops);
+    autoscale_->max_loops = std::max(autoscale_->min_loops, max_loops);
+    autoscale_->interval_seconds = interval_seconds;
+    autoscale_->high_busy_ratio = high_busy_ratio;
+    autoscale_->low_busy_ratio = low_busy_ratio;
+    autoscale_->last_check_us = 0;
+}
+
+// 每个 loop 从上一次采样以来处理事件的时间（iteration_us 的累计值之差）
+// 所有 loop 都更新基准值，退役的 loop 重新启用时不会把退役期间的时间算进来
+std::unordered_map<EventLoop*, int64_t> TcpServer::SampleLoopBusy(std::unordered_map<EventLoop*, int64_t> *last_busy_us)
+{
+    std::unordered_map<EventLoop*, int64_t> busy_delta;
+    for (EventLoop *loop : thread_pool_->GetAllLoops())
+    {
+        int64_t busy = loop->metrics().iteration_us.sum();
+        int64_t &last = (*last_busy_us)[loop];
+        busy_delta[loop] = busy - last;
+        last = busy;
+    }
+    return busy_delta;
+}
+
+/**
+ * 用 iteration_us 的累计值估算每个 loop 在上一个周期内处理事件的时间占比
+ * 参与分配的 loop 平均占比超过上限时增加一个 loop，低于下限时退役一个，每个周期最多调整一次
+ */
+void TcpServer::Autoscale()
+{
+    int64_t now = MonotonicMicros();
+    int64_t elapsed = now - autoscale_->last_check_us;
+    autoscale_->last_check_us = now;
+
+    std::unordered_map<EventLoop*, int64_t> busy_delta = SampleLoopBusy(&autoscale_->last_busy_us);
+
+    std::vector<EventLoop*> active = thread_pool_->GetActiveLoops();
+    if (elapsed <= 0 || active.empty())
+    {
+        return;
+    }
+    int64_t total = 0;
+    for (EventLoop *loop : active)
+    {
+        total += busy_delta[loop];
+    }
+    double ratio = static_cast<double>(total) / (static_cast<double>(elapsed) * active.size());
+    int num_active = static_cast<int>(active.size());
+
+    if ((ratio > autoscale_->high_busy_ratio && num_active < autoscale_->max_loops)
+        || num_active < autoscale_->min_loops)
+    {
+        AddLoopInLoop();
+    }
+    else if ((ratio < autoscale_->low_busy_ratio && num_active > autoscale_->min_loops)
+        || num_active > autoscale_->max_loops)
+    {
+        RetireLoopInLoop();
+    }
+}
+
+void TcpServer::MigrateConnection(const TcpConnectionPtr &conn, EventLoop *target)
+{
+    loop_->RunInLoop(std::bind(&TcpServer::MigrateConnectionInLoop, this, conn, target));
+}
+
+void TcpServer::MigrateConnectionInLoop(const TcpConnectionPtr &conn, EventLoop *target)
+{
+    auto it = idle_wheels_.find(target);
+    conn->MigrateTo(target, it != idle_wheels_.end() ? it->second : std::shared_ptr<TimingWheel>());
+}
+
+void TcpServer::EnableRebalancer(double interval_seconds, double imbalance_ratio, int max_moves)
+{
+    rebalance_.reset(new RebalanceState);
+    rebalance_->interval_seconds = interval_seconds;
+    rebalance_->imbalance_ratio = imbalance_ratio;
+    rebalance_->max_moves = max_moves;
+}
+
+/**
+ * 找出上一个周期最忙和最闲的 io loop，忙碌时间相差超过 imbalance_ratio 倍时，
+ * 按流量从大到小把最忙的 loop 上的连接迁移到最闲的 loop，迁移的流量大约是两者差值的一半
+ * 单个连接的流量超过这个值时不迁移，否则只是把热点换到另一个 loop 上
+ */
+void TcpServer::Rebalance()
+{
+    std::unordered_map<EventLoop*, int64_t> busy_delta = SampleLoopBusy(&rebalance_->last_busy_us);
+
+    // 连接的流量增量，同时丢掉已经关闭的连接的记录
+    std::unordered_map<TcpConnection*, int64_t> last_traffic;
+    std::vector<std::pair<int64_t, TcpConnectionPtr>> traffic;
+    for (const auto &item : connections_)
+    {
+        const TcpConnectionPtr &conn = item.second;
+        int64_t bytes = conn->traffic_bytes();
+        auto it = rebalance_->last_traffic.find(conn.get());
+        int64_t delta = it != rebalance_->last_traffic.end() ? bytes - it->second : bytes;
+        last_traffic[conn.get()] = bytes;
+        traffic.push_back(std::make_pair(delta, conn));
+    }
+    rebalance_->last_traffic.swap(last_traffic);
+
+    std::vector<EventLoop*> active = thread_pool_->GetActiveLoops();
+    if (active.size() < 2)
+    {
+        return;
+    }
+    EventLoop *hot = active[0];
+    EventLoop *cold = active[0];
+    for (EventLoop *loop : active)
+    {
+        if (busy_delta[loop] > busy_delta[hot])
+        {
+            hot = loop;
+        }
+        if (busy_delta[loop] < busy_delta[cold])
+        {
+            cold = loop;
+        }
+    }
+    int64_t hot_busy = busy_delta[hot];
+    int64_t cold_busy = busy_delta[cold];
+    if (hot_busy <= 0 || hot_busy < rebalance_->imbalance_ratio * std::max<int64_t>(cold_busy, 1))
+    {
+        return;
+    }
+
+    int64_t hot_traffic = 0;
+    std::vector<std::pair<int64_t, TcpConnectionPtr>> candidates;
+    for (const auto &item : traffic)
+    {
+        if (item.second->loop() == hot && !item.second->migrating())
+        {
+            hot_traffic += item.first;
+            candidates.push_back(item);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<int64_t, TcpConnectionPtr> &a, const std::pair<int64_t, TcpConnectionPtr> &b) {
+            return a.first > b.first;
+        });
+
+    // 按忙碌时间的比例换算成要迁走的流量
+    double share = static_cast<double>(hot_busy - cold_busy) / 2 / hot_busy;
+    int64_t budget = static_cast<int64_t>(hot_traffic * share);
+    int moves = 0;
+    for (const auto &item : candidates)
+    {
+        if (moves >= rebalance_->max_moves || budget <= 0)
+        {
+            break;
+        }
+        if (item.first <= 0 || item.first > budget)
+        {
+            continue;
+        }
+        MigrateConnectionInLoop(item.second, cold);
+        budget -= item.first;
+        ++moves;
+    }
+
+    if (moves > 0)
+    {
+        LOG_INFO("TcpServer[%s] rebalance: moved %d connections from loop %p to %p \n",
+            name_.c_str(), moves, hot, cold);
+    }
+}
+
+LoopStats TcpServer::StatsSnapshot() const
+{
+    std::vector<EventLoop*> loops;
+    {
+        std::unique_lock<std::mutex> lock(stats_mutex_);
+        loops = stats_loops_;
+    }
+
+    LoopStats total;
+    for (EventLoop *loop : loops)
+    {
+        LoopStats stats;
+        loop->metrics().Snapshot(&stats);
+        total.Merge(stats);
+    }
+    return total;
+}
+
+std::string TcpServer::RenderMetrics() const
+{
+    return RenderPrometheus(name_, StatsSnapshot());
+}
+
 // 有新的客户端的连接，acceptor 会执行这个回调操作
 void TcpServer::NewConnection(int sockfd, const InetAddress &peer_addr)
 {
     // 轮询算法，选择一个sub loop，来管理 channel
     EventLoop *io_loop = thread_pool_->GetNextLoop(); 
 
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ip_port_.c_str(), next_conn_id_);
-    std::string conn_name = name_ + buf;
+    if (!connection_shared_)
+    {
+        connection_shared_ = std::make_shared<TcpConnectionShared>();
+        connection_shared_->name_prefix = name_ + "-" + ip_port_ + "#";
+        connection_shared_->connection_callback = connection_callback_;
+        connection_shared_->message_callback = message_callback_;
+        connection_shared_->write_complete_callback = write_complete_callback_;
+        connection_shared_->close_callback = std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1);
+    }
 
-    ++next_conn_id_;
+    uint64_t conn_id = next_conn_id_++;
    
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-        name_.c_str(), conn_name.c_str(), peer_addr.ToIpPort().c_str());
+    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s%lu] from %s \n",
+        name_.c_str(), connection_shared_->name_prefix.c_str(),
+        static_cast<unsigned long>(conn_id), peer_addr.ToIpPort().c_str());
 
-    // 通过 sockfd 获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    std::shared_ptr<TimingWheel> idle_wheel;
+    if (!idle_wheels_.empty())
     {
-        LOG_ERROR("sockets::getLocalAddr");
+        idle_wheel = idle_wheels_[io_loop];
     }
 
-    InetAddress local_addr(local);
+    if (io_loop != loop_)
+    {
+        // 在 AddConnectionInLoop 中减去，排空时要等这些连接也注册上
+        ++pending_connections_;
+        // 在 io loop 中创建连接，连接从 io loop 的 slab 中分配，通常也在 io loop 中释放，不需要跨线程归还
+        // loop 线程绑核时，连接对象和缓冲区也按 first-touch 分配在它所在的 NUMA 节点上
+        io_loop->RunInLoop(std::bind(&TcpServer::CreateConnection, this,
+            io_loop, connection_shared_, conn_id, sockfd, peer_addr, idle_wheel));
+    }
+    else
+    {
+        CreateConnection(io_loop, connection_shared_, conn_id, sockfd, peer_addr, idle_wheel);
+    }
+}
 
-    // 根据连接成功的sockfd，创建 TcpConnection 连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+void TcpServer::CreateConnection(EventLoop *io_loop,
+                            const std::shared_ptr<TcpConnectionShared> &shared,
+                            uint64_t conn_id,
+                            int sockfd,
+                            const InetAddress &peer_addr,
+                            const std::shared_ptr<TimingWheel> &idle_wheel)
+{
+    // 在 io loop 线程中执行，根据连接成功的sockfd，创建 TcpConnection 连接对象，和引用计数一起从 io loop 的 slab 中分配
+    // 迁移或者被其它线程持有的连接在别的线程中销毁时，内存经过 slab 的 remote free 回到 io loop
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+                            SlabAllocator<TcpConnection>(io_loop->slab()),
                             io_loop,
-                            conn_name,
+                            shared,         // 回调和名字前缀
+                            conn_id,
                             sockfd,         // Socket Channel
-                            local_addr,
-                            peer_addr));
-
-    connections_[conn_name] = conn;
+                            peer_addr);
 
-    // 下面的回调都是用户设置 TcpServer => TcpConnection => Channel=> Poller=> notify channel 回调
-    conn->set_connection_callback(connection_callback_);
-    conn->set_message_callback(message_callback_);
-    conn->set_write_complete_callback(write_complete_callback_);
+    if (loop_->IsInLoopThread())
+    {
+        connections_[conn_id] = conn;
+    }
+    else
+    {
+        // connections_ 只在 baseloop 中访问，之后的 RemoveConnection 也排在它后面
+        loop_->RunInLoop(std::bind(&TcpServer::AddConnectionInLoop, this, conn));
+    }
 
-    conn->set_close_callback(
-        std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1)
-    );
+    // 回调都在 shared 中，用户设置 TcpServer => TcpConnection => Channel=> Poller=> notify channel 回调
+    if (idle_wheel)
+    {
+        conn->set_idle_wheel(idle_wheel);
+    }
+    conn->set_zerocopy_threshold(zerocopy_threshold_);
+    conn->set_auto_cork(auto_cork_);
+    if (socket_busy_poll_us_ > 0)
+    {
+        conn->SetBusyPoll(socket_busy_poll_us_);
+    }
 
     // 直接调用TcpConnection::connectEstablished
     io_loop->RunInLoop(std::bind(&TcpConnection::ConnectEstablished, conn));
 }
 
+void TcpServer::AddConnectionInLoop(const TcpConnectionPtr &conn)
+{
+    --pending_connections_;
+    connections_[conn->id()] = conn;
+    // 排空开始以前 accept、之后才注册上的连接
+    if (draining_)
+    {
+        NotifyDraining(conn);
+    }
+}
+
 void TcpServer::RemoveConnection(const TcpConnectionPtr &conn)
 {
     loop_->RunInLoop(
@@ -127,10 +562,105 @@ void TcpServer::RemoveConnectionInLoop(const TcpConnectionPtr &conn)
     LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n", 
         name_.c_str(), conn->name().c_str());
 
-    connections_.erase(conn->name());
+    connections_.erase(conn->id());
     EventLoop *io_loop = conn->loop(); 
 
     io_loop->QueueInLoop(
         std::bind(&TcpConnection::ConnectDestroyed, conn)
     );
+
+    MaybeFinishDrain();
+}
+
+int TcpServer::listen_fd() const
+{
+    return acceptor_->fd();
+}
+
+void TcpServer::StopAccepting()
+{
+    loop_->RunInLoop(std::bind(&Acceptor::StopListening, acceptor_.get()));
+}
+
+void TcpServer::GracefulShutdown(double deadline_seconds, const std::function<void()> &done)
+{
+    loop_->RunInLoop(std::bind(&TcpServer::GracefulShutdownInLoop, this, deadline_seconds, done));
+}
+
+void TcpServer::GracefulShutdownInLoop(double deadline_seconds, const std::function<void()> &done)
+{
+    if (draining_)
+    {
+        return;
+    }
+    LOG_INFO("TcpServer[%s] draining %zu connections (%zu pending), deadline %.1fs \n",
+        name_.c_str(), connections_.size(), pending_connections_, deadline_seconds);
+
+    acceptor_->StopListening();
+    draining_ = true;
+    drain_deadline_reached_ = false;
+    drain_done_ = done;
+    if (connections_.empty() && pending_connections_ == 0)
+    {
+        FinishDrain();
+        return;
+    }
+    for (const auto &item : connections_)
+    {
+        NotifyDraining(item.second);
+    }
+    drain_timer_ = loop_->RunAfter(deadline_seconds, std::bind(&TcpServer::DrainDeadline, this));
+}
+
+// 排在 ConnectEstablished 之后，在连接所在的 loop 中执行
+void TcpServer::NotifyDraining(const TcpConnectionPtr &conn)
+{
+    if (drain_deadline_reached_)
+    {
+        conn->QueueInOwnerLoop(std::bind(&TcpConnection::ForceClose, conn));
+    }
+    else if (drain_callback_)
+    {
+        ConnectionCallback cb = drain_callback_;
+        conn->QueueInOwnerLoop([cb, conn]() {
+            if (conn->connected())
+            {
+                cb(conn);
+            }
+        });
+    }
+}
+
+// 到期还没有关闭的连接强制关闭，关闭以后由 RemoveConnectionInLoop 结束排空
+void TcpServer::DrainDeadline()
+{
+    LOG_INFO("TcpServer[%s] drain deadline reached, force closing %zu connections \n",
+        name_.c_str(), connections_.size());
+    // 之后才注册上的连接在 AddConnectionInLoop 中同样关闭
+    drain_deadline_reached_ = true;
+    for (const auto &item : connections_)
+    {
+        NotifyDraining(item.second);
+    }
+}
+
+// 已经注册的连接都关闭、交给 io loop 创建的连接也都注册过以后才算排空
+void TcpServer::MaybeFinishDrain()
+{
+    if (draining_ && connections_.empty() && pending_connections_ == 0)
+    {
+        FinishDrain();
+    }
+}
+
+void TcpServer::FinishDrain()
+{
+    draining_ = false;
+    loop_->Cancel(drain_timer_);
+    if (drain_done_)
+    {
+        // ConnectDestroyed 还在 io loop 中排队，回调也排队执行，不在 RemoveConnectionInLoop 中途调用
+        loop_->QueueInLoop(drain_done_);
+        drain_done_ = std::function<void()>();
+    }
 }
\ No newline at end of file
@@ -11,14 +11,20 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "TimingWheel.h"
+#include "Metrics.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
+#include <mutex>
 #include <unordered_map>
 
 // 对外的服务器编程使用的类
+class MetricsExporter;
+class LoopWatchdog;
+
 class TcpServer : noncopyable
 {
 public:
@@ -34,24 +40,133 @@ public:
                 const InetAddress &listenAddr,
                 const std::string &nameArg,
                 Option option = kNoReusePort);
+    // 接管一个已经在监听的 fd（比如热重启时从旧进程收到的），fd 由 TcpServer 关闭
+    TcpServer(EventLoop *loop, int listen_fd, const std::string &nameArg);
     ~TcpServer();
 
+    const std::string& name() const { return name_; }
+    const std::string& ip_port() const { return ip_port_; }
+    int listen_fd() const;
+
     void set_thread_init_callback(const ThreadInitCallback &cb) { thread_init_callback_ = cb; }
-    void set_connection_callback(const ConnectionCallback &cb) { connection_callback_ = cb; }
-    void set_message_callback(const MessageCallback &cb) { message_callback_ = cb; }
-    void set_write_complete_callback(const WriteCompleteCallback &cb) { write_complete_callback_ = cb; }
+    // 之后建立的连接共用这些回调，在 baseloop 线程中设置
+    void set_connection_callback(const ConnectionCallback &cb)
+    {
+        connection_callback_ = cb;
+        connection_shared_.reset();
+    }
+    void set_message_callback(const MessageCallback &cb)
+    {
+        message_callback_ = cb;
+        connection_shared_.reset();
+    }
+    void set_write_complete_callback(const WriteCompleteCallback &cb)
+    {
+        write_complete_callback_ = cb;
+        connection_shared_.reset();
+    }
 
     // 设置底层subloop的个数
     void SetThreadNum(int num_threads);
+    // subloop 线程依次绑定到 cpus 中的 cpu 上，新连接在所在的 loop 线程中创建，在 Start 之前设置
+    // cpus 可以用 Thread::ParseCpuList("0-3,8-11") 生成
+    void SetCpuAffinity(const std::vector<int> &cpus) { thread_pool_->set_cpu_affinity(cpus); }
+
+    // 开启空闲连接检测，超过 seconds 秒没有读写活动的连接会被关闭，在 Start 之前设置
+    void SetIdleTimeout(int seconds) { idle_timeout_seconds_ = seconds; }
+
+    // 在单独的端口上输出 Prometheus 格式的统计数据，在 Start 之前设置
+    void EnableMetricsExporter(const InetAddress &addr);
+
+    // 单次回调超过 micro_seconds 的慢回调会被记录到所在 loop 上，在 Start 之前设置
+    void SetSlowCallbackThreshold(int64_t micro_seconds) { slow_callback_threshold_us_ = micro_seconds; }
+    // 开启 watchdog 线程，某个 loop 一轮循环超过 deadline_ms 没有结束时输出它正在执行的回调
+    void EnableStallWatchdog(int deadline_ms) { stall_deadline_ms_ = deadline_ms; }
+
+    // 不小于 bytes 的共享数据（TcpConnection::Send(shared_ptr)）使用 MSG_ZEROCOPY 发送，在 Start 之前设置
+    void SetZeroCopyThreshold(size_t bytes) { zerocopy_threshold_ = bytes; }
+    // 新连接开启 auto-cork，一轮循环中的发送合并到循环结束时发出，在 Start 之前设置
+    void SetAutoCork(bool on) { auto_cork_ = on; }
+    // io loop 等待事件的方式，见 EventLoop::PollPolicy，在 Start 之前设置
+    void SetPollPolicy(EventLoop::PollPolicy policy, int spin_us = EventLoop::kDefaultSpinMicros)
+    {
+        poll_policy_ = policy;
+        spin_us_ = spin_us;
+    }
+    // io loop 每轮最多执行的 pending functor 个数和时间，见 EventLoop::set_functor_budget，在 Start 之前设置
+    void SetFunctorBudget(size_t max_functors, int64_t max_us)
+    {
+        functor_budget_count_ = max_functors;
+        functor_budget_us_ = max_us;
+    }
+    // 新连接的 socket 开启 SO_BUSY_POLL，0 表示不开启，在 Start 之前设置
+    void SetSocketBusyPoll(int usecs) { socket_busy_poll_us_ = usecs; }
 
     // 开启服务器监听
     void Start();
+
+    // 不再接受新连接，已有的连接不受影响，可以跨线程调用
+    void StopAccepting();
+    /**
+     * 停止接受新连接，等已有的连接自己关闭，超过 deadline_seconds 以后强制关闭剩下的
+     * 所有连接都关闭以后在 baseloop 中调用 done，可以跨线程调用
+     */
+    void GracefulShutdown(double deadline_seconds, const std::function<void()> &done);
+    /**
+     * 开始排空时对每个连接在它所在的 loop 中调用一次 cb，排空期间才注册上的连接也会调用
+     * 可以在 cb 中 Shutdown 空闲的长连接，不必等到 deadline，在 baseloop 线程中设置
+     */
+    void set_drain_callback(const ConnectionCallback &cb) { drain_callback_ = cb; }
+
+    // 把连接迁移到 target 上，不断开客户端，可以跨线程调用
+    void MigrateConnection(const TcpConnectionPtr &conn, EventLoop *target);
+    // 每隔 interval_seconds 检查一次，最忙的 io loop 的忙碌时间超过最闲的 imbalance_ratio 倍时，
+    // 把它上面流量最大的一些连接迁移到最闲的 loop，每次最多 max_moves 个，在 Start 之前设置
+    void EnableRebalancer(double interval_seconds = 5.0, double imbalance_ratio = 2.0, int max_moves = 8);
+
+    // 运行时增加一个参与分配新连接的 loop，或者退役最后加入的 loop（已有连接留在上面直到关闭），可以跨线程调用
+    void AddLoop();
+    void RetireLoop();
+    size_t num_active_loops() const;
+
+    // 每隔 interval_seconds 按 io loop 的平均忙碌比例在 [min_loops, max_loops] 内调整 loop 个数，在 Start 之前设置
+    void EnableAutoscale(int min_loops, int max_loops, double interval_seconds = 5.0,
+                        double high_busy_ratio = 0.7, double low_busy_ratio = 0.2);
+
+    // 汇总所有 loop 的统计数据，不会阻塞各个 loop，Start 之后任意线程都可以调用
+    LoopStats StatsSnapshot() const;
+    std::string RenderMetrics() const;
 private:
+    TcpServer(EventLoop *loop,
+                Acceptor *acceptor,
+                const std::string &ip_port,
+                const std::string &nameArg);
+
     void NewConnection(int sockfd, const InetAddress &peerAddr);
+    void CreateConnection(EventLoop *io_loop,
+                        const std::shared_ptr<TcpConnectionShared> &shared,
+                        uint64_t conn_id,
+                        int sockfd,
+                        const InetAddress &peer_addr,
+                        const std::shared_ptr<TimingWheel> &idle_wheel);
+    void AddConnectionInLoop(const TcpConnectionPtr &conn);
+    void SetupLoop(EventLoop *loop, bool io_loop);
+    void AddLoopInLoop();
+    void RetireLoopInLoop();
+    void Autoscale();
+    std::unordered_map<EventLoop*, int64_t> SampleLoopBusy(std::unordered_map<EventLoop*, int64_t> *last_busy_us);
+    void MigrateConnectionInLoop(const TcpConnectionPtr &conn, EventLoop *target);
+    void Rebalance();
+    void GracefulShutdownInLoop(double deadline_seconds, const std::function<void()> &done);
+    void NotifyDraining(const TcpConnectionPtr &conn);
+    void DrainDeadline();
+    void MaybeFinishDrain();
+    void FinishDrain();
     void RemoveConnection(const TcpConnectionPtr &conn);
     void RemoveConnectionInLoop(const TcpConnectionPtr &conn);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    using ConnectionMap = std::unordered_map<uint64_t, TcpConnectionPtr>;
+    using IdleWheelMap = std::unordered_map<EventLoop*, std::shared_ptr<TimingWheel>>;
 
 
     EventLoop *loop_;               // base loop 用户定义
@@ -67,6 +182,59 @@ private:
     ThreadInitCallback thread_init_callback_;           // loop线程初始化的回调
 
     std::atomic_int started_;
-    int next_conn_id_;
-    ConnectionMap connections_;     // 保存所有的连接
+    uint64_t next_conn_id_;
+    ConnectionMap connections_;     // 保存所有的连接，按连接 id 索引
+    size_t pending_connections_;    // 已经交给 io loop 创建、还没有加入 connections_ 的连接个数
+    // 所有连接共用的回调，第一个新连接到来时生成，修改回调以后重新生成，只在 baseloop 线程中访问
+    std::shared_ptr<TcpConnectionShared> connection_shared_;
+
+    int idle_timeout_seconds_;      // 0 表示不检测空闲连接
+    IdleWheelMap idle_wheels_;      // 每个 loop 一个时间轮，只在 baseloop 线程中访问
+
+    mutable std::mutex stats_mutex_;
+    std::vector<EventLoop*> stats_loops_;                 // 只增不减，由 stats_mutex_ 保护
+    std::unique_ptr<MetricsExporter> metrics_exporter_;
+
+    size_t zerocopy_threshold_;
+    bool auto_cork_;
+    EventLoop::PollPolicy poll_policy_;
+    int spin_us_;
+    size_t functor_budget_count_;
+    int64_t functor_budget_us_;
+    int socket_busy_poll_us_;
+
+    int64_t slow_callback_threshold_us_;
+    int stall_deadline_ms_;
+    std::unique_ptr<LoopWatchdog> watchdog_;
+
+    // 自动调整 loop 个数，只在 baseloop 线程中访问
+    struct AutoscaleState
+    {
+        int min_loops;
+        int max_loops;
+        double interval_seconds;
+        double high_busy_ratio;
+        double low_busy_ratio;
+        int64_t last_check_us;
+        std::unordered_map<EventLoop*, int64_t> last_busy_us;   // 上一次检查时 iteration_us 的累计值
+    };
+    std::unique_ptr<AutoscaleState> autoscale_;
+
+    // 连接迁移的负载均衡，只在 baseloop 线程中访问
+    struct RebalanceState
+    {
+        double interval_seconds;
+        double imbalance_ratio;
+        int max_moves;
+        std::unordered_map<EventLoop*, int64_t> last_busy_us;
+        std::unordered_map<TcpConnection*, int64_t> last_traffic;  // 上一次检查时连接的 traffic_bytes
+    };
+    std::unique_ptr<RebalanceState> rebalance_;
+
+    // 正在 GracefulShutdown，只在 baseloop 线程中访问
+    bool draining_;
+    bool drain_deadline_reached_;
+    ConnectionCallback drain_callback_;
+    std::function<void()> drain_done_;
+    TimerId drain_timer_;
 };
\ No newline at end of file
@@ -1,7 +1,14 @@
 #include "Thread.h"
 #include "CurrentThread.h"
 
+#include "Logger.h"
+
 #include <semaphore.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <errno.h>
 
 std::atomic_int Thread::num_created_(0);
 
@@ -11,6 +18,7 @@ Thread::Thread(ThreadFunc func, const std::string &name)
     , tid_(0)
     , func_(std::move(func))
     , name_(name)
+    , cpu_(-1)
 {
     SetDefaultName();
 }
@@ -32,6 +40,12 @@ void Thread::Start()
     thread_ = std::shared_ptr<std::thread>(new std::thread([&](){
         // 获取线程的tid值
         tid_ = CurrentThread::tid();
+        SetCurrentThreadName(name_);
+        // 在执行线程函数之前绑定，线程之后分配的内存按 first-touch 落在这个 cpu 所在的 NUMA 节点上
+        if (cpu_ >= 0)
+        {
+            PinCurrentThread(cpu_);
+        }
         sem_post(&sem);
         // 开启一个新线程，专门执行该线程函数
         func_(); 
@@ -57,4 +71,80 @@ void Thread::SetDefaultName()
         snprintf(buf, sizeof(buf), "Thread%d", num);
         name_ = buf;
     }
-}
\ No newline at end of file
+}
+
+bool Thread::PinCurrentThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        LOG_ERROR("pthread_setaffinity_np cpu=%d error:%d \n", cpu, err);
+        return false;
+    }
+    return true;
+}
+
+void Thread::SetCurrentThreadName(const std::string &name)
+{
+    // 内核限制线程名最长 15 个字符，截断时保留末尾的编号，区分同一个池中的线程
+    static const size_t kMaxNameLen = 15;
+    std::string kernel_name = name;
+    if (kernel_name.size() > kMaxNameLen)
+    {
+        size_t digits = kernel_name.size();
+        while (digits > 0 && isdigit(static_cast<unsigned char>(kernel_name[digits - 1])))
+        {
+            --digits;
+        }
+        std::string suffix = kernel_name.substr(digits);
+        if (suffix.size() > kMaxNameLen)
+        {
+            suffix = suffix.substr(suffix.size() - kMaxNameLen);
+        }
+        kernel_name = kernel_name.substr(0, kMaxNameLen - suffix.size()) + suffix;
+    }
+    ::pthread_setname_np(::pthread_self(), kernel_name.c_str());
+}
+
+std::vector<int> Thread::ParseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    const char *p = list.c_str();
+    while (*p != '\0')
+    {
+        char *end = nullptr;
+        long first = ::strtol(p, &end, 10);
+        if (end == p || first < 0)
+        {
+            return std::vector<int>();
+        }
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            ++p;
+            last = ::strtol(p, &end, 10);
+            if (end == p || last < first)
+            {
+                return std::vector<int>();
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p != '\0')
+        {
+            return std::vector<int>();
+        }
+    }
+    return cpus;
+}
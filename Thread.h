@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <string>
 #include <atomic>
+#include <vector>
 
 class Thread : noncopyable
 {
@@ -17,6 +18,10 @@ public:
     explicit Thread(ThreadFunc, const std::string &name = std::string());
     ~Thread();
 
+    // 线程启动时绑定到 cpu 上，-1 表示不绑定，在 Start 之前设置
+    void set_cpu(int cpu) { cpu_ = cpu; }
+    int cpu() const { return cpu_; }
+
     void Start();
     void Join();
 
@@ -25,6 +30,13 @@ public:
     const std::string& name() const { return name_; }
 
     static int num_created() { return num_created_; }
+
+    // 把当前线程绑定到 cpu 上
+    static bool PinCurrentThread(int cpu);
+    // 设置内核中的线程名（ps/top/perf 中显示），超过 15 个字符时保留末尾的编号
+    static void SetCurrentThreadName(const std::string &name);
+    // 解析 "0-3,8,10-11" 格式的 cpu 列表，格式错误时返回空
+    static std::vector<int> ParseCpuList(const std::string &list);
 private:
     void SetDefaultName();
 
@@ -34,5 +46,6 @@ private:
     pid_t tid_;
     ThreadFunc func_;
     std::string name_;
+    int cpu_;
     static std::atomic_int num_created_;
 };
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "ThreadPool.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+namespace
+{
+
+// 当前线程所属的线程池和在其中的下标，用来判断是不是工作线程自己提交的任务
+__thread const ThreadPool *t_pool = nullptr;
+__thread int t_worker_index = -1;
+
+}
+
+ThreadPool::ThreadPool(const std::string &name)
+    : name_(name)
+    , next_worker_(0)
+    , pending_(0)
+    , running_(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    if (running_)
+    {
+        Stop();
+    }
+}
+
+void ThreadPool::Start(int num_threads)
+{
+    running_ = true;
+    workers_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+    {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for (int i = 0; i < num_threads; ++i)
+    {
+        char name[name_.size() + 32];
+        snprintf(name, sizeof name, "%s%d", name_.c_str(), i);
+        workers_[i]->thread.reset(new Thread(std::bind(&ThreadPool::WorkerFunc, this, i), name));
+        workers_[i]->thread->Start();
+    }
+}
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        running_ = false;
+    }
+    idle_cond_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker->thread->Join();
+    }
+}
+
+void ThreadPool::Push(int index, Task task, bool back)
+{
+    Worker &worker = *workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (back)
+        {
+            worker.tasks.push_back(std::move(task));
+        }
+        else
+        {
+            worker.tasks.push_front(std::move(task));
+        }
+    }
+
+    // 先增加计数再加锁通知，等待中的线程在锁内检查计数，不会错过唤醒
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cond_.notify_one();
+}
+
+void ThreadPool::Submit(Task task)
+{
+    if (workers_.empty())
+    {
+        // 没有工作线程时直接在当前线程执行
+        task();
+        return;
+    }
+
+    if (t_pool == this)
+    {
+        Push(t_worker_index, std::move(task), true);
+    }
+    else
+    {
+        unsigned index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        // 外部提交的任务放在头部，和偷取的方向一致，先提交的先执行
+        Push(static_cast<int>(index), std::move(task), false);
+    }
+}
+
+void ThreadPool::Submit(EventLoop *loop, Task work, Task done)
+{
+    Submit([loop, work, done]() {
+        work();
+        loop->QueueInLoop(done);
+    });
+}
+
+void ThreadPool::Submit(const TcpConnectionPtr &conn, Task work, Task done)
+{
+    uint64_t seq = conn->AllocateCompletionSeq();
+    Submit([conn, seq, work, done]() {
+        work();
+        conn->QueueInOwnerLoop([conn, seq, done]() {
+            conn->DeliverCompletion(seq, done);
+        });
+    });
+}
+
+// 自己的队列从尾部取
+bool ThreadPool::PopLocal(int index, Task *task)
+{
+    Worker &worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+    {
+        return false;
+    }
+    *task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+// 从其它线程队列的头部偷取，从下一个线程开始找，避免所有线程都去偷同一个
+bool ThreadPool::Steal(int index, Task *task)
+{
+    int n = static_cast<int>(workers_.size());
+    for (int i = 1; i < n; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % n];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty())
+        {
+            continue;
+        }
+        *task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerFunc(int index)
+{
+    t_pool = this;
+    t_worker_index = index;
+
+    while (true)
+    {
+        Task task;
+        if (PopLocal(index, &task) || Steal(index, &task))
+        {
+            pending_.fetch_sub(1);
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        if (pending_.load() > 0)
+        {
+            // 有任务但是 try_lock 没抢到，再找一次
+            continue;
+        }
+        if (!running_)
+        {
+            break;
+        }
+        idle_cond_.wait(lock);
+    }
+
+    t_pool = nullptr;
+    t_worker_index = -1;
+}
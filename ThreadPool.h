@@ -0,0 +1,67 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class EventLoop;
+
+/**
+ * 计算线程池，把压缩、加解密、序列化这类 CPU 密集的工作从 io loop 中挪出去
+ *
+ * 每个工作线程有自己的任务队列，工作线程提交的任务放到自己队列的尾部并从尾部取（后进先出，缓存友好），
+ * 自己的队列空了以后从其它线程队列的头部偷取；其它线程提交的任务轮流分配到各个队列
+ * 所有队列都空时工作线程睡眠，等待新任务
+ */ 
+class ThreadPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(const std::string &name = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    void Start(int num_threads);
+    // 等待已经提交的任务执行完以后退出
+    void Stop();
+
+    // 在工作线程中执行 task
+    void Submit(Task task);
+    // 在工作线程中执行 work，完成以后在 loop 中执行 done
+    void Submit(EventLoop *loop, Task work, Task done);
+    // 在工作线程中执行 work，完成以后在连接所在的 loop 中执行 done，
+    // 同一个连接上的 done 按提交的顺序执行，即使 work 乱序完成；在连接所在的 loop 线程中调用
+    void Submit(const TcpConnectionPtr &conn, Task work, Task done);
+
+    size_t num_threads() const { return workers_.size(); }
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::unique_ptr<Thread> thread;
+    };
+
+    void WorkerFunc(int index);
+    bool PopLocal(int index, Task *task);
+    bool Steal(int index, Task *task);
+    void Push(int index, Task task, bool back);
+
+    const std::string name_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<unsigned> next_worker_;
+
+    std::atomic<int> pending_;          // 所有队列中的任务总数
+    std::atomic<bool> running_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+};
@@ -0,0 +1,15 @@
+#include "Timer.h"
+
+std::atomic<int64_t> Timer::num_created_(0);
+
+void Timer::Restart(Timestamp now)
+{
+    if (repeat_)
+    {
+        expiration_ = AddTime(now, interval_);
+    }
+    else
+    {
+        expiration_ = Timestamp();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+
+// 定时器，记录到期时间、回调以及重复间隔
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++num_created_)
+    {}
+
+    void Run() const { callback_(); }
+
+    // 重复定时器到期以后，重新计算下一次的到期时间
+    void Restart(Timestamp now);
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    static int64_t num_created() { return num_created_; }
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_;
+    const bool repeat_;
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> num_created_;
+};
@@ -0,0 +1,197 @@
+#include "TimerQueue.h"
+#include "Timer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+
+static int CreateTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create error:%d \n", errno);
+    }
+    return timerfd;
+}
+
+// 距离 when 还有多长时间，最小 100 微秒
+static timespec HowMuchTimeFromNow(Timestamp when)
+{
+    int64_t micro_seconds = when.micro_seconds_since_epoch()
+                            - Timestamp::Now().micro_seconds_since_epoch();
+    if (micro_seconds < 100)
+    {
+        micro_seconds = 100;
+    }
+
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(micro_seconds / Timestamp::kMicroSecondsPerSecond);
+    ts.tv_nsec = static_cast<long>((micro_seconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    return ts;
+}
+
+static void ReadTimerfd(int timerfd)
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::HandleRead() reads %ld bytes instead of 8 \n", n);
+    }
+}
+
+static void ResetTimerfd(int timerfd, Timestamp expiration)
+{
+    itimerspec new_value;
+    itimerspec old_value;
+    bzero(&new_value, sizeof new_value);
+    bzero(&old_value, sizeof old_value);
+    new_value.it_value = HowMuchTimeFromNow(expiration);
+    if (::timerfd_settime(timerfd, 0, &new_value, &old_value) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(CreateTimerfd())
+    , timerfd_channel_(loop, timerfd_)
+    , calling_expired_timers_(false)
+{
+    timerfd_channel_.set_name("timer queue");
+    timerfd_channel_.set_read_callback(std::bind(&TimerQueue::HandleRead, this));
+    timerfd_channel_.EnableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfd_channel_.DisableAll();
+    timerfd_channel_.Remove();
+    ::close(timerfd_);
+
+    for (const Entry &timer : timers_)
+    {
+        delete timer.second;
+    }
+}
+
+TimerId TimerQueue::AddTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    loop_->RunInLoop(std::bind(&TimerQueue::AddTimerInLoop, this, timer));
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::Cancel(TimerId timer_id)
+{
+    loop_->RunInLoop(std::bind(&TimerQueue::CancelInLoop, this, timer_id));
+}
+
+void TimerQueue::AddTimerInLoop(Timer *timer)
+{
+    bool earliest_changed = Insert(timer);
+    if (earliest_changed)
+    {
+        ResetTimerfd(timerfd_, timer->expiration());
+    }
+}
+
+void TimerQueue::CancelInLoop(TimerId timer_id)
+{
+    ActiveTimer timer(timer_id.timer_, timer_id.sequence_);
+    ActiveTimerSet::iterator it = active_timers_.find(timer);
+    if (it != active_timers_.end())
+    {
+        timers_.erase(Entry(it->first->expiration(), it->first));
+        delete it->first;
+        active_timers_.erase(it);
+    }
+    else if (calling_expired_timers_)
+    {
+        // 定时器正在执行回调（比如在回调里取消自己），等 Reset 时不再重新插入
+        canceling_timers_.insert(timer);
+    }
+}
+
+void TimerQueue::HandleRead()
+{
+    Timestamp now(Timestamp::Now());
+    ReadTimerfd(timerfd_);
+
+    std::vector<Entry> expired = GetExpired(now);
+
+    calling_expired_timers_ = true;
+    canceling_timers_.clear();
+    for (const Entry &it : expired)
+    {
+        it.second->Run();
+    }
+    calling_expired_timers_ = false;
+
+    Reset(expired, now);
+}
+
+std::vector<TimerQueue::Entry> TimerQueue::GetExpired(Timestamp now)
+{
+    std::vector<Entry> expired;
+    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
+    TimerList::iterator end = timers_.lower_bound(sentry);
+    std::copy(timers_.begin(), end, std::back_inserter(expired));
+    timers_.erase(timers_.begin(), end);
+
+    for (const Entry &it : expired)
+    {
+        active_timers_.erase(ActiveTimer(it.second, it.second->sequence()));
+    }
+    return expired;
+}
+
+void TimerQueue::Reset(const std::vector<Entry> &expired, Timestamp now)
+{
+    for (const Entry &it : expired)
+    {
+        ActiveTimer timer(it.second, it.second->sequence());
+        if (it.second->repeat()
+            && canceling_timers_.find(timer) == canceling_timers_.end())
+        {
+            it.second->Restart(now);
+            Insert(it.second);
+        }
+        else
+        {
+            delete it.second;
+        }
+    }
+
+    if (!timers_.empty())
+    {
+        Timestamp next_expire = timers_.begin()->second->expiration();
+        if (next_expire.valid())
+        {
+            ResetTimerfd(timerfd_, next_expire);
+        }
+    }
+}
+
+bool TimerQueue::Insert(Timer *timer)
+{
+    bool earliest_changed = false;
+    Timestamp when = timer->expiration();
+    TimerList::iterator it = timers_.begin();
+    if (it == timers_.end() || when < it->first)
+    {
+        earliest_changed = true;
+    }
+
+    timers_.insert(Entry(when, timer));
+    active_timers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliest_changed;
+}
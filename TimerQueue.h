@@ -0,0 +1,57 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+#include "TimerId.h"
+
+#include <set>
+#include <vector>
+
+class EventLoop;
+class Timer;
+
+/**
+ * 基于 timerfd 的定时器队列，timerfd 作为一个 Channel 注册到所属 loop 的 poller 上
+ * 所有的定时器都只在 loop 线程中增删，跨线程调用会通过 RunInLoop 转到 loop 线程
+ */ 
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // interval > 0 表示重复定时器
+    TimerId AddTimer(TimerCallback cb, Timestamp when, double interval);
+    void Cancel(TimerId timer_id);
+private:
+    using Entry = std::pair<Timestamp, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void AddTimerInLoop(Timer *timer);
+    void CancelInLoop(TimerId timer_id);
+
+    // timerfd 可读，处理所有到期的定时器
+    void HandleRead();
+
+    std::vector<Entry> GetExpired(Timestamp now);
+    void Reset(const std::vector<Entry> &expired, Timestamp now);
+
+    // 返回最早到期的时间是否发生了改变
+    bool Insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfd_channel_;
+
+    // 按到期时间排序
+    TimerList timers_;
+
+    // 按 Timer 地址排序，用于取消
+    ActiveTimerSet active_timers_;
+    bool calling_expired_timers_;
+    ActiveTimerSet canceling_timers_;
+};
@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 #include <time.h>
+#include <sys/time.h>
 
 Timestamp::Timestamp():micro_seconds_since_epoch_(0) {}
 
@@ -9,13 +10,17 @@ Timestamp::Timestamp(int64_t micro_seconds_since_epoch)
 
 Timestamp Timestamp::Now()
 {
-    return Timestamp(time(nullptr));
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
 std::string Timestamp::ToString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&micro_seconds_since_epoch_);
+    time_t seconds = static_cast<time_t>(micro_seconds_since_epoch_ / kMicroSecondsPerSecond);
+    tm tm_result;
+    tm *tm_time = localtime_r(&seconds, &tm_result);
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d", 
         tm_time->tm_year + 1900,
         tm_time->tm_mon + 1,
@@ -24,4 +29,4 @@ std::string Timestamp::ToString() const
         tm_time->tm_min,
         tm_time->tm_sec);
     return buf;
-}
\ No newline at end of file
+}
@@ -2,14 +2,44 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
 
 class Timestamp
 {
 public:
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
+
     Timestamp();
     explicit Timestamp(int64_t micro_seconds_since_epoch);
     static Timestamp Now();
     std::string ToString() const;
+
+    int64_t micro_seconds_since_epoch() const { return micro_seconds_since_epoch_; }
+    bool valid() const { return micro_seconds_since_epoch_ > 0; }
 private:
     int64_t micro_seconds_since_epoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.micro_seconds_since_epoch() < rhs.micro_seconds_since_epoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.micro_seconds_since_epoch() == rhs.micro_seconds_since_epoch();
+}
+
+// 两个时间点的差值，单位秒
+inline double TimeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.micro_seconds_since_epoch() - low.micro_seconds_since_epoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在 timestamp 的基础上加上 seconds 秒
+inline Timestamp AddTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.micro_seconds_since_epoch() + delta);
+}
@@ -0,0 +1,70 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, int idle_seconds)
+    : loop_(loop)
+    , idle_seconds_(idle_seconds)
+    , buckets_(idle_seconds + 1)
+    , cursor_(0)
+    , started_(false)
+{
+    for (Entry &head : buckets_)
+    {
+        head.prev = head.next = &head;
+    }
+}
+
+TimingWheel::~TimingWheel()
+{
+    // 还挂在时间轮上的连接不再被管理
+    for (Entry &head : buckets_)
+    {
+        while (head.next != &head)
+        {
+            Unlink(head.next);
+        }
+    }
+}
+
+void TimingWheel::Start()
+{
+    if (!started_)
+    {
+        started_ = true;
+        tick_timer_ = loop_->RunEvery(1.0, std::bind(&TimingWheel::OnTick, this));
+    }
+}
+
+void TimingWheel::Stop()
+{
+    if (started_)
+    {
+        started_ = false;
+        loop_->Cancel(tick_timer_);
+    }
+}
+
+void TimingWheel::Add(Entry *entry)
+{
+    Remove(entry);
+    Link(entry, cursor_);
+}
+
+void TimingWheel::OnTick()
+{
+    cursor_ = (cursor_ + 1) % static_cast<int>(buckets_.size());
+
+    // 新的当前桶里面是 idle_seconds_ 秒以前活跃过、之后再也没有动静的连接
+    Entry *head = &buckets_[cursor_];
+    while (head->next != head)
+    {
+        Entry *entry = head->next;
+        Unlink(entry);
+
+        LOG_INFO("TimingWheel evict idle connection [%s] after %d seconds \n",
+            entry->conn->name().c_str(), idle_seconds_);
+        entry->conn->ForceClose();
+    }
+}
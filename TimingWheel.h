@@ -0,0 +1,93 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TimerId.h"
+
+#include <vector>
+
+class EventLoop;
+class TcpConnection;
+
+/**
+ * 用于踢掉空闲连接的时间轮，每个 subloop 一个，只在所属 loop 线程中使用
+ * 
+ * 每秒走一格，共 idle_seconds + 1 个桶，连接挂在最近一次活跃时所在的桶上
+ * 桶用侵入式双向链表实现，连接活跃时只需要把节点摘下来挂到当前桶，O(1) 且不分配内存
+ * 指针转回到某个桶时，桶里的连接已经空闲超过 idle_seconds 秒，直接关闭
+ */ 
+class TimingWheel : noncopyable
+{
+public:
+    // 嵌在 TcpConnection 里面的链表节点
+    struct Entry
+    {
+        Entry()
+            : prev(nullptr)
+            , next(nullptr)
+            , bucket(-1)
+            , conn(nullptr)
+        {}
+
+        Entry *prev;
+        Entry *next;
+        int bucket;             // 所在的桶，-1 表示不在时间轮上
+        TcpConnection *conn;
+    };
+
+    TimingWheel(EventLoop *loop, int idle_seconds);
+    ~TimingWheel();
+
+    // 开始/停止每秒一次的 tick，必须在 loop 线程中调用
+    void Start();
+    void Stop();
+
+    // 连接建立时挂到时间轮上
+    void Add(Entry *entry);
+    // 连接有读写活动，挪到当前桶
+    void Touch(Entry *entry)
+    {
+        if (entry->bucket != cursor_ && entry->bucket >= 0)
+        {
+            Unlink(entry);
+            Link(entry, cursor_);
+        }
+    }
+    // 连接关闭时从时间轮上摘掉
+    void Remove(Entry *entry)
+    {
+        if (entry->bucket >= 0)
+        {
+            Unlink(entry);
+        }
+    }
+
+    int idle_seconds() const { return idle_seconds_; }
+private:
+    void OnTick();
+
+    void Link(Entry *entry, int bucket)
+    {
+        Entry *head = &buckets_[bucket];
+        entry->prev = head;
+        entry->next = head->next;
+        head->next->prev = entry;
+        head->next = entry;
+        entry->bucket = bucket;
+    }
+
+    void Unlink(Entry *entry)
+    {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        entry->prev = entry->next = nullptr;
+        entry->bucket = -1;
+    }
+
+    EventLoop *loop_;
+    const int idle_seconds_;
+    // 每个桶是一个带哨兵头节点的循环链表，大小固定不会扩容
+    std::vector<Entry> buckets_;
+    int cursor_;
+    bool started_;
+    TimerId tick_timer_;
+};
@@ -0,0 +1,372 @@
+#include "UdpChannel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+// 旧版本的头文件里没有这两个选项
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+namespace
+{
+
+// 一次可读事件最多读几批，避免一个繁忙的 socket 占住整个 loop
+const int kMaxBatchesPerEvent = 4;
+// 一次 sendmmsg 最多发送的数据报个数
+const size_t kMaxSendBatch = 1024;
+// 一次 GSO 发送的上限
+const size_t kMaxGsoSegments = 64;
+const size_t kMaxGsoBytes = 65000;
+
+int CreateNonblockingUdp(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+}
+
+const int UdpChannel::kDefaultBatchSize;
+const size_t UdpChannel::kDefaultDatagramSize;
+const size_t UdpChannel::kMaxDatagramSize;
+
+UdpChannel::UdpChannel(EventLoop *loop, const InetAddress &addr, bool reuseport, int batch_size)
+    : loop_(loop)
+    , socket_(CreateNonblockingUdp(addr.family()))
+    , channel_(loop, socket_.fd())
+    , gro_enabled_(false)
+    , gso_enabled_(false)
+    , in_callback_(false)
+    , flush_scheduled_(false)
+    , batch_size_(batch_size)
+    , slot_size_(kDefaultDatagramSize)
+    , send_next_(0)
+    , truncated_(0)
+    , send_dropped_(0)
+{
+    channel_.set_name("udp");
+    socket_.SetReuseAddr(true);
+    socket_.SetReusePort(reuseport);
+    socket_.BindAddress(addr);
+
+    channel_.set_read_callback(std::bind(&UdpChannel::HandleRead, this, std::placeholders::_1));
+    channel_.set_write_callback(std::bind(&UdpChannel::HandleWrite, this));
+}
+
+UdpChannel::~UdpChannel()
+{
+}
+
+bool UdpChannel::EnableGro(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(socket_.fd(), SOL_UDP, UDP_GRO, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("fd=%d UDP_GRO not supported, errno=%d \n", socket_.fd(), errno);
+        gro_enabled_ = false;
+        return false;
+    }
+    gro_enabled_ = on;
+    return true;
+}
+
+bool UdpChannel::EnableGso(bool on)
+{
+    // 设置 0 不会改变行为，只用来检测内核是否支持
+    int optval = 0;
+    if (on && ::setsockopt(socket_.fd(), SOL_UDP, UDP_SEGMENT, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("fd=%d UDP_SEGMENT not supported, errno=%d \n", socket_.fd(), errno);
+        gso_enabled_ = false;
+        return false;
+    }
+    gso_enabled_ = on;
+    return true;
+}
+
+void UdpChannel::Start()
+{
+    // GRO 合并以后的数据报最大 64KB
+    if (gro_enabled_)
+    {
+        slot_size_ = kMaxDatagramSize;
+    }
+
+    recv_buffer_.resize(batch_size_ * slot_size_);
+    recv_msgs_.resize(batch_size_);
+    recv_iovecs_.resize(batch_size_);
+    recv_addrs_.resize(batch_size_);
+    recv_control_.resize(batch_size_ * CMSG_SPACE(sizeof(int)));
+    datagrams_.resize(batch_size_);
+
+    for (int i = 0; i < batch_size_; ++i)
+    {
+        recv_iovecs_[i].iov_base = &recv_buffer_[i * slot_size_];
+        recv_iovecs_[i].iov_len = slot_size_;
+    }
+
+    channel_.EnableReading();
+}
+
+void UdpChannel::Stop()
+{
+    channel_.DisableAll();
+    channel_.Remove();
+}
+
+void UdpChannel::HandleRead(Timestamp receive_time)
+{
+    const size_t control_space = CMSG_SPACE(sizeof(int));
+    for (int round = 0; round < kMaxBatchesPerEvent; ++round)
+    {
+        // recvmmsg 会改写长度字段，每次都要重新设置
+        for (int i = 0; i < batch_size_; ++i)
+        {
+            msghdr &hdr = recv_msgs_[i].msg_hdr;
+            hdr.msg_name = &recv_addrs_[i];
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_iov = &recv_iovecs_[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = gro_enabled_ ? &recv_control_[i * control_space] : nullptr;
+            hdr.msg_controllen = gro_enabled_ ? control_space : 0;
+            hdr.msg_flags = 0;
+        }
+
+        int n = ::recvmmsg(socket_.fd(), &recv_msgs_[0], batch_size_, MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpChannel::HandleRead fd=%d errno=%d \n", socket_.fd(), errno);
+            }
+            break;
+        }
+
+        size_t bytes = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            const msghdr &hdr = recv_msgs_[i].msg_hdr;
+            UdpDatagram &datagram = datagrams_[i];
+            datagram.data = static_cast<const char*>(recv_iovecs_[i].iov_base);
+            datagram.len = recv_msgs_[i].msg_len;
+            datagram.peer.set_sock_addr(reinterpret_cast<const sockaddr*>(&recv_addrs_[i]), hdr.msg_namelen);
+            datagram.segment_size = 0;
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                ++truncated_;
+            }
+            if (gro_enabled_)
+            {
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+                        cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cmsg))
+                {
+                    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                    {
+                        int segment = 0;
+                        memcpy(&segment, CMSG_DATA(cmsg), sizeof segment);
+                        datagram.segment_size = static_cast<uint16_t>(segment);
+                    }
+                }
+            }
+            bytes += datagram.len;
+        }
+        loop_->metrics().bytes_read.Add(bytes);
+
+        if (batch_callback_ && n > 0)
+        {
+            in_callback_ = true;
+            batch_callback_(this, &datagrams_[0], n, receive_time);
+            in_callback_ = false;
+        }
+        Flush();
+
+        if (n < batch_size_)
+        {
+            break;
+        }
+    }
+}
+
+void UdpChannel::HandleWrite()
+{
+    Flush();
+}
+
+void UdpChannel::SendTo(const InetAddress &peer, const void *data, size_t len)
+{
+    Enqueue(peer, data, len, 0);
+}
+
+void UdpChannel::SendSegmented(const InetAddress &peer, const void *data, size_t len, uint16_t segment_size)
+{
+    const char *p = static_cast<const char*>(data);
+    if (segment_size == 0 || len <= segment_size)
+    {
+        Enqueue(peer, p, len, 0);
+        return;
+    }
+
+    if (!gso_enabled_)
+    {
+        // 内核不支持时在用户态切分
+        for (size_t offset = 0; offset < len; offset += segment_size)
+        {
+            size_t n = std::min(static_cast<size_t>(segment_size), len - offset);
+            Enqueue(peer, p + offset, n, 0);
+        }
+        return;
+    }
+
+    size_t segments = std::min(kMaxGsoSegments, kMaxGsoBytes / segment_size);
+    size_t chunk = std::max(segments, static_cast<size_t>(1)) * segment_size;
+    for (size_t offset = 0; offset < len; offset += chunk)
+    {
+        size_t n = std::min(chunk, len - offset);
+        Enqueue(peer, p + offset, n, n > segment_size ? segment_size : 0);
+    }
+}
+
+void UdpChannel::Enqueue(const InetAddress &peer, const void *data, size_t len, uint16_t segment_size)
+{
+    if (loop_->IsInLoopThread())
+    {
+        PendingDatagram pending;
+        pending.offset = send_payload_.size();
+        pending.len = len;
+        pending.peer = peer;
+        pending.segment_size = segment_size;
+        send_payload_.append(static_cast<const char*>(data), len);
+        send_queue_.push_back(pending);
+
+        // 读回调中发送的数据在回调返回后统一发出
+        if (!in_callback_)
+        {
+            ScheduleFlush();
+        }
+    }
+    else
+    {
+        void (UdpChannel::*fp)(const InetAddress&, const std::string&, uint16_t) = &UdpChannel::EnqueueInLoop;
+        loop_->RunInLoop(std::bind(fp, shared_from_this(), peer,
+            std::string(static_cast<const char*>(data), len), segment_size));
+    }
+}
+
+void UdpChannel::EnqueueInLoop(const InetAddress &peer, const std::string &data, uint16_t segment_size)
+{
+    Enqueue(peer, data.data(), data.size(), segment_size);
+}
+
+// 同一轮循环中排队的数据报合并成一次 sendmmsg
+void UdpChannel::ScheduleFlush()
+{
+    if (flush_scheduled_)
+    {
+        return;
+    }
+    flush_scheduled_ = true;
+    std::shared_ptr<UdpChannel> self = shared_from_this();
+    loop_->QueueInLoop([self]() {
+        self->flush_scheduled_ = false;
+        self->Flush();
+    });
+}
+
+void UdpChannel::Flush()
+{
+    const size_t control_space = CMSG_SPACE(sizeof(uint16_t));
+    size_t bytes = 0;
+    while (send_next_ < send_queue_.size())
+    {
+        size_t count = std::min(kMaxSendBatch, send_queue_.size() - send_next_);
+        send_msgs_.resize(count);
+        send_iovecs_.resize(count);
+        if (gso_enabled_)
+        {
+            send_control_.assign(count * control_space, 0);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            PendingDatagram &pending = send_queue_[send_next_ + i];
+            send_iovecs_[i].iov_base = &send_payload_[pending.offset];
+            send_iovecs_[i].iov_len = pending.len;
+
+            msghdr &hdr = send_msgs_[i].msg_hdr;
+            memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = const_cast<sockaddr*>(pending.peer.sock_addr());
+            hdr.msg_namelen = pending.peer.sock_len();
+            hdr.msg_iov = &send_iovecs_[i];
+            hdr.msg_iovlen = 1;
+            if (pending.segment_size != 0)
+            {
+                hdr.msg_control = &send_control_[i * control_space];
+                hdr.msg_controllen = control_space;
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(cmsg), &pending.segment_size, sizeof(uint16_t));
+            }
+        }
+
+        int n = ::sendmmsg(socket_.fd(), &send_msgs_[0], static_cast<unsigned int>(count), MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // socket 发送缓冲区满了，等可写以后再发
+                if (!channel_.IsWriting())
+                {
+                    channel_.EnableWriting();
+                }
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // 第一个数据报发送失败（比如对端不可达、数据报太大），丢掉它继续发后面的
+            LOG_ERROR("UdpChannel::Flush fd=%d errno=%d \n", socket_.fd(), errno);
+            ++send_dropped_;
+            ++send_next_;
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            bytes += send_queue_[send_next_ + i].len;
+        }
+        send_next_ += n;
+    }
+    loop_->metrics().bytes_written.Add(bytes);
+
+    if (send_next_ == send_queue_.size())
+    {
+        send_queue_.clear();
+        send_payload_.clear();
+        send_next_ = 0;
+        if (channel_.IsWriting())
+        {
+            channel_.DisableWriting();
+        }
+    }
+}
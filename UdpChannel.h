@@ -0,0 +1,118 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <sys/socket.h>
+#include <vector>
+#include <string>
+#include <memory>
+
+class EventLoop;
+
+// 收到的一个数据报，data 指向批量接收缓冲区
+struct UdpDatagram
+{
+    const char *data;
+    size_t len;
+    InetAddress peer;
+    uint16_t segment_size;      // 开启 GRO 后内核合并的每一段的长度，0 表示没有合并
+};
+
+/**
+ * 绑定在一个 loop 上的 UDP socket
+ *
+ * 可读时用 recvmmsg 批量读到复用的缓冲区里，整批交给回调
+ * 发送的数据报先在 loop 中排队，读回调返回以后（或者排队时所在的这一轮循环结束时）用 sendmmsg 批量发出
+ * socket 缓冲区满时开启可写事件，等待下一次可写再发
+ */
+class UdpChannel : noncopyable, public std::enable_shared_from_this<UdpChannel>
+{
+public:
+    static const int kDefaultBatchSize = 64;
+    static const size_t kDefaultDatagramSize = 2048;
+    static const size_t kMaxDatagramSize = 65536;
+
+    UdpChannel(EventLoop *loop, const InetAddress &addr, bool reuseport,
+            int batch_size = kDefaultBatchSize);
+    ~UdpChannel();
+
+    EventLoop* loop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+
+    void set_batch_callback(const UdpBatchCallback &cb) { batch_callback_ = cb; }
+
+    // 单个接收缓冲区的大小，超过的数据报会被截断，在 Start 之前调用
+    void set_max_datagram_size(size_t size) { slot_size_ = size; }
+
+    // 开启 GRO/GSO，内核不支持时返回 false，在 Start 之前调用
+    bool EnableGro(bool on);
+    bool EnableGso(bool on);
+    bool gso_enabled() const { return gso_enabled_; }
+
+    // 在 loop 线程中调用
+    void Start();
+    void Stop();
+
+    // 可以跨线程调用
+    void SendTo(const InetAddress &peer, const void *data, size_t len);
+    // 把 data 按 segment_size 切分成多个数据报发给同一个地址，开启 GSO 时交给内核切分
+    void SendSegmented(const InetAddress &peer, const void *data, size_t len, uint16_t segment_size);
+    // 立即发送排队的数据报，在 loop 线程中调用
+    void Flush();
+
+    uint64_t truncated() const { return truncated_; }
+    uint64_t send_dropped() const { return send_dropped_; }
+private:
+    // 等待发送的数据报，payload 在 send_payload_ 中的位置
+    struct PendingDatagram
+    {
+        size_t offset;
+        size_t len;
+        InetAddress peer;
+        uint16_t segment_size;
+    };
+
+    void HandleRead(Timestamp receive_time);
+    void HandleWrite();
+    void Enqueue(const InetAddress &peer, const void *data, size_t len, uint16_t segment_size);
+    void EnqueueInLoop(const InetAddress &peer, const std::string &data, uint16_t segment_size);
+    void ScheduleFlush();
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    UdpBatchCallback batch_callback_;
+
+    bool gro_enabled_;
+    bool gso_enabled_;
+    bool in_callback_;          // 正在执行读回调，回调结束后统一发送
+    bool flush_scheduled_;
+
+    // 接收缓冲区，创建后一直复用
+    const int batch_size_;
+    size_t slot_size_;
+    std::vector<char> recv_buffer_;
+    std::vector<mmsghdr> recv_msgs_;
+    std::vector<iovec> recv_iovecs_;
+    std::vector<sockaddr_storage> recv_addrs_;
+    std::vector<char> recv_control_;
+    std::vector<UdpDatagram> datagrams_;
+
+    // 发送队列
+    std::string send_payload_;
+    std::vector<PendingDatagram> send_queue_;
+    size_t send_next_;                  // 已经发出的数据报个数
+    std::vector<mmsghdr> send_msgs_;
+    std::vector<iovec> send_iovecs_;
+    std::vector<char> send_control_;
+
+    uint64_t truncated_;
+    uint64_t send_dropped_;
+};
+
+using UdpChannelPtr = std::shared_ptr<UdpChannel>;
@@ -0,0 +1,69 @@
+#include "UdpServer.h"
+#include "Logger.h"
+
+UdpServer::UdpServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            Option option)
+    : loop_(loop)
+    , listen_addr_(listen_addr)
+    , name_(name)
+    , reuseport_(option == kReusePort)
+    , thread_pool_(new EventLoopThreadPool(loop, name))
+    , batch_size_(UdpChannel::kDefaultBatchSize)
+    , max_datagram_size_(UdpChannel::kDefaultDatagramSize)
+    , gro_(false)
+    , gso_(false)
+    , started_(false)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    // 在各自的 loop 线程中注销，绑定的 shared_ptr 保证执行前 UdpChannel 不会析构
+    for (const UdpChannelPtr &channel : channels_)
+    {
+        channel->loop()->RunInLoop(std::bind(&UdpChannel::Stop, channel));
+    }
+}
+
+void UdpServer::Start()
+{
+    if (started_)
+    {
+        return;
+    }
+    started_ = true;
+
+    thread_pool_->Start(thread_init_callback_);
+
+    std::vector<EventLoop*> loops;
+    if (reuseport_)
+    {
+        loops = thread_pool_->GetAllLoops();
+    }
+    else
+    {
+        loops.push_back(loop_);
+    }
+
+    for (EventLoop *loop : loops)
+    {
+        UdpChannelPtr channel = std::make_shared<UdpChannel>(loop, listen_addr_, reuseport_, batch_size_);
+        channel->set_max_datagram_size(max_datagram_size_);
+        channel->set_batch_callback(batch_callback_);
+        if (gro_)
+        {
+            channel->EnableGro(true);
+        }
+        if (gso_)
+        {
+            channel->EnableGso(true);
+        }
+        channels_.push_back(channel);
+        loop->RunInLoop(std::bind(&UdpChannel::Start, channel));
+    }
+
+    LOG_INFO("UdpServer[%s] starts with %zu sockets on %s \n",
+        name_.c_str(), channels_.size(), listen_addr_.ToIpPort().c_str());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "UdpChannel.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * UDP 服务器，和 TcpServer 使用同样的 EventLoop 线程池
+ *
+ * kReusePort 时每个 loop 各自绑定一个 SO_REUSEPORT socket，由内核按四元组把数据报分散到各个 loop，
+ * 否则只在 baseloop 上绑定一个 socket
+ * 收到的数据报整批交给回调，回调中通过 UdpChannel::SendTo 回复，回调返回后统一用 sendmmsg 发出
+ */ 
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    enum Option
+    {
+        kNoReusePort,
+        kReusePort,
+    };
+
+    UdpServer(EventLoop *loop,
+            const InetAddress &listen_addr,
+            const std::string &name,
+            Option option = kNoReusePort);
+    ~UdpServer();
+
+    const std::string& name() const { return name_; }
+
+    void set_thread_init_callback(const ThreadInitCallback &cb) { thread_init_callback_ = cb; }
+    // 在各个 socket 所在的 loop 线程中调用
+    void set_batch_callback(const UdpBatchCallback &cb) { batch_callback_ = cb; }
+
+    // 以下选项在 Start 之前设置
+    void SetThreadNum(int num_threads) { thread_pool_->set_num_threads(num_threads); }
+    void SetBatchSize(int batch_size) { batch_size_ = batch_size; }
+    void SetMaxDatagramSize(size_t size) { max_datagram_size_ = size; }
+    // 内核不支持时自动退回普通收发
+    void EnableGro(bool on) { gro_ = on; }
+    void EnableGso(bool on) { gso_ = on; }
+
+    void Start();
+
+    // Start 之后不再改变
+    const std::vector<UdpChannelPtr>& channels() const { return channels_; }
+private:
+    EventLoop *loop_;
+    const InetAddress listen_addr_;
+    const std::string name_;
+    const bool reuseport_;
+    std::unique_ptr<EventLoopThreadPool> thread_pool_;
+
+    ThreadInitCallback thread_init_callback_;
+    UdpBatchCallback batch_callback_;
+
+    int batch_size_;
+    size_t max_datagram_size_;
+    bool gro_;
+    bool gso_;
+    bool started_;
+    std::vector<UdpChannelPtr> channels_;
+};
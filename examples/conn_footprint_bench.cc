@@ -0,0 +1,151 @@
+#include <TcpServer.h>
+#include <TcpConnection.h>
+#include <Slab.h>
+#include <Logger.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// 所有线程都从同一个 arena 分配，mallinfo2 才能统计到 io 线程中的分配
+static size_t HeapInUse()
+{
+    struct mallinfo2 info = ::mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// 记下 allocate_shared 实际申请的大小（对象 + 引用计数），布局和 SlabAllocator 一样
+static size_t g_requested_bytes = 0;
+
+template <typename T>
+class SizeProbe : public SlabAllocator<T>
+{
+public:
+    explicit SizeProbe(LoopSlab *slab) : SlabAllocator<T>(slab) {}
+
+    template <typename U>
+    SizeProbe(const SizeProbe<U> &other) : SlabAllocator<T>(other.slab()) {}
+
+    T* allocate(size_t n)
+    {
+        g_requested_bytes = n * sizeof(T);
+        return SlabAllocator<T>::allocate(n);
+    }
+};
+
+// 一个连接在 slab 中占用的块大小，按 LoopSlab 的分级向上取整
+static size_t SlabSlotSize(EventLoop *loop)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    std::allocate_shared<TcpConnection>(SizeProbe<TcpConnection>(loop->slab()),
+                                        loop, "probe", fd, InetAddress());
+    return (g_requested_bytes + LoopSlab::kGranularity - 1) / LoopSlab::kGranularity * LoopSlab::kGranularity;
+}
+
+static void WaitFor(const std::atomic<int> &value, int expected)
+{
+    while (value.load() != expected)
+    {
+        ::usleep(10 * 1000);
+    }
+}
+
+/**
+ * 建立 num_connections 个空闲连接，输出服务端每个连接占用的用户态内存（不包括内核中的 socket 和 epoll 开销）
+ * cold 一轮的堆增量包括 slab 新申请的 chunk；warm 一轮复用 cold 留下的 slab 块，堆增量之外再加上一个 slab 块才是完整的开销
+ * 连接数受 RLIMIT_NOFILE 限制，每个连接在本进程中占用两个 fd
+ */
+int main(int argc, char *argv[])
+{
+    int num_connections = argc > 1 ? atoi(argv[1]) : 10000;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 2;
+    uint16_t port = argc > 3 ? static_cast<uint16_t>(atoi(argv[3])) : 8005;
+
+    ::mallopt(M_ARENA_MAX, 1);
+
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    if (static_cast<rlim_t>(num_connections) * 2 + 64 > limit.rlim_cur)
+    {
+        num_connections = static_cast<int>((limit.rlim_cur - 64) / 2);
+        printf("RLIMIT_NOFILE is %lu, testing %d connections \n",
+            static_cast<unsigned long>(limit.rlim_cur), num_connections);
+    }
+
+    EventLoop loop;
+    std::atomic<int> connected(0);
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "FootprintBench");
+    server.set_connection_callback([&connected](const TcpConnectionPtr &conn) {
+        connected.fetch_add(conn->connected() ? 1 : -1);
+    });
+    server.set_message_callback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+    });
+    server.SetThreadNum(num_threads);
+    server.Start();
+
+    const size_t slot_size = SlabSlotSize(&loop);
+    printf("sizeof(TcpConnection) = %zu, allocate_shared block = %zu bytes \n", sizeof(TcpConnection), g_requested_bytes);
+
+    std::thread client([&]() {
+        std::vector<int> fds;
+        fds.reserve(num_connections);
+        sockaddr_in addr;
+        ::bzero(&addr, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        // 第一轮包括 slab 向系统申请的内存，第二轮 slab 和各个容器都已经扩容，只统计额外分配的部分
+        for (int round = 0; round < 2; ++round)
+        {
+            size_t before = HeapInUse();
+            for (int i = 0; i < num_connections; ++i)
+            {
+                int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+                {
+                    LOG_FATAL("connect error:%d \n", errno);
+                }
+                fds.push_back(fd);
+            }
+            WaitFor(connected, num_connections);
+            size_t after = HeapInUse();
+
+            size_t heap = (after - before) / num_connections;
+            if (round == 0)
+            {
+                printf("cold: %d idle connections, %zu bytes of heap per connection (slab chunks included) \n",
+                    num_connections, heap);
+            }
+            else
+            {
+                printf("warm: %d idle connections, %zu bytes of heap + %zu bytes slab slot = %zu bytes per connection \n",
+                    num_connections, heap, slot_size, heap + slot_size);
+            }
+
+            for (int fd : fds)
+            {
+                ::close(fd);
+            }
+            fds.clear();
+            WaitFor(connected, 0);
+        }
+        loop.RunInLoop([&loop]() { loop.Quit(); });
+    });
+
+    loop.Loop();
+    client.join();
+
+    return 0;
+}
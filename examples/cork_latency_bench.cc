@@ -0,0 +1,94 @@
+#include <TcpServer.h>
+#include <Logger.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * 开启 auto-cork 时从 Send 到写完成回调的延迟
+ * 客户端每隔 interval_ms 发一个请求，服务器回显；写完成回调应该在同一轮循环中执行，
+ * 延迟接近请求间隔说明回调一直等到下一个事件才执行
+ */
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8005;
+    int requests = argc > 2 ? atoi(argv[2]) : 50;
+    int interval_ms = argc > 3 ? atoi(argv[3]) : 20;
+
+    std::mutex mutex;
+    std::deque<int64_t> send_us;     // 还没有收到写完成回调的 Send 的时间
+    std::vector<int64_t> latencies;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "CorkLatencyBench");
+    server.SetAutoCork(true);
+    server.SetThreadNum(1);
+    server.set_connection_callback([](const TcpConnectionPtr&) {});
+    server.set_message_callback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            send_us.push_back(MonotonicMicros());
+        }
+        conn->Send(buf);
+    });
+    server.set_write_complete_callback([&](const TcpConnectionPtr&) {
+        // 每个请求的回显在一轮循环中发完，对应一次写完成回调
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!send_us.empty())
+        {
+            latencies.push_back(MonotonicMicros() - send_us.front());
+            send_us.pop_front();
+        }
+    });
+    server.Start();
+
+    std::thread client([&]() {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+        {
+            LOG_ERROR("cork_latency_bench connect error:%d \n", errno);
+            ::exit(1);
+        }
+
+        char buf[64];
+        for (int i = 0; i < requests; ++i)
+        {
+            if (::write(fd, "ping\n", 5) != 5 || ::read(fd, buf, sizeof buf) <= 0)
+            {
+                break;
+            }
+            ::usleep(interval_ms * 1000);
+        }
+        ::close(fd);
+        ::usleep(100 * 1000);
+        loop.RunInLoop([&loop]() { loop.Quit(); });
+    });
+
+    loop.Loop();
+    client.join();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    std::sort(latencies.begin(), latencies.end());
+    if (latencies.empty())
+    {
+        printf("no write complete callback in %d requests\n", requests);
+        return 1;
+    }
+    printf("%zu write complete callbacks, p50 = %ld us, max = %ld us (request interval %d ms)\n",
+        latencies.size(), static_cast<long>(latencies[latencies.size() / 2]),
+        static_cast<long>(latencies.back()), interval_ms);
+    return 0;
+}
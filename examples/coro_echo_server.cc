@@ -0,0 +1,37 @@
+#include <CoConnection.h>
+#include <Logger.h>
+
+#include <string>
+
+// 按行回显，收到 "sleep" 时先等一秒，收到 "quit" 时关闭连接
+Task<> Echo(CoConnectionPtr conn)
+{
+    std::string line;
+    while (co_await conn->ReadUntil("\r\n", &line))
+    {
+        if (line == "quit")
+        {
+            co_return;
+        }
+        if (line == "sleep")
+        {
+            co_await SleepFor(conn->loop(), 1000);
+        }
+        if (!co_await conn->Write(line + "\r\n"))
+        {
+            co_return;
+        }
+    }
+}
+
+int main()
+{
+    EventLoop loop;
+    CoServer server(&loop, InetAddress(8001), "CoEchoServer");
+    server.set_handler(Echo);
+    server.SetThreadNum(3);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <TcpServer.h>
+#include <HotRestart.h>
+#include <Logger.h>
+
+#include <memory>
+#include <vector>
+#include <stdlib.h>
+
+/**
+ * 可以热重启的 echo 服务器：再启动一个同样的进程，新进程从旧进程接过监听 socket，
+ * 旧进程停止 accept，等已有的连接关闭（最多 drain_seconds 秒）以后退出
+ */
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8003;
+    std::string control_path = argc > 2 ? argv[2] : "/tmp/simple_muduo_hot_restart.sock";
+    double drain_seconds = argc > 3 ? atof(argv[3]) : 30.0;
+
+    EventLoop loop;
+    std::unique_ptr<TcpServer> server;
+
+    std::vector<int> fds = HotRestartListener::FetchListenFds(control_path);
+    if (!fds.empty())
+    {
+        LOG_INFO("took over listen fd %d from the old process \n", fds[0]);
+        server.reset(new TcpServer(&loop, fds[0], "HotRestartServer"));
+    }
+    else
+    {
+        server.reset(new TcpServer(&loop, InetAddress(port), "HotRestartServer"));
+    }
+
+    server->set_connection_callback([](const TcpConnectionPtr &conn) {
+        LOG_INFO("connection %s %s \n", conn->name().c_str(), conn->connected() ? "up" : "down");
+    });
+    server->set_message_callback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->Send(buf->retrieveAllAsString());
+    });
+    // echo 没有跨消息的状态，开始排空时直接关闭写端，已经在发送的数据发完以后才关闭
+    server->set_drain_callback([](const TcpConnectionPtr &conn) {
+        conn->Shutdown();
+    });
+    server->SetThreadNum(2);
+    server->Start();
+
+    HotRestartListener listener(&loop, control_path);
+    listener.AddListenFd(server->listen_fd());
+    listener.set_handoff_callback([&]() {
+        server->GracefulShutdown(drain_seconds, [&loop]() { loop.Quit(); });
+    });
+    listener.Start();
+
+    loop.Loop();
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <HttpServer.h>
+#include <EventLoopThread.h>
+#include <Logger.h>
+
+#include <string>
+
+// 产生流式响应的后台 loop
+EventLoop *g_worker_loop = nullptr;
+
+void StreamTicks(std::shared_ptr<HttpStream> stream, int remaining)
+{
+    if (remaining == 0)
+    {
+        stream->Finish();
+        return;
+    }
+    stream->SendChunk("tick\n");
+    g_worker_loop->RunAfter(0.2, std::bind(StreamTicks, stream, remaining - 1));
+}
+
+void OnRequest(const HttpRequest &req, HttpResponse *resp)
+{
+    if (req.path() == "/health")
+    {
+        resp->set_content_type("text/plain");
+        resp->set_body("ok\n");
+    }
+    else if (req.path() == "/hello")
+    {
+        resp->set_content_type("text/plain");
+        resp->AppendBody("hello, ");
+        resp->AppendBody(req.query().empty() ? StringPiece("world") : req.query());
+        resp->AppendBody("\n");
+    }
+    else if (req.path() == "/chunked")
+    {
+        // 分块传输
+        resp->set_content_type("text/plain");
+        resp->set_chunked(true);
+        for (int i = 0; i < 3; ++i)
+        {
+            resp->AppendChunk("chunk\n");
+        }
+    }
+    else if (req.path() == "/stream")
+    {
+        // 流式响应：响应头先发出，之后每 200ms 在另一个线程中发送一个 chunk
+        resp->set_content_type("text/plain");
+        std::shared_ptr<HttpStream> stream = resp->StartStream();
+        g_worker_loop->RunInLoop(std::bind(StreamTicks, stream, 5));
+    }
+    else
+    {
+        resp->set_status_code(HttpResponse::k404NotFound);
+        resp->set_close_connection(true);
+    }
+}
+
+int main()
+{
+    EventLoopThread worker;
+    g_worker_loop = worker.StartLoop();
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(8000), "HttpServer-01");
+    server.set_http_callback(OnRequest);
+    server.SetThreadNum(3);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}
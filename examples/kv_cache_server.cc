@@ -0,0 +1,715 @@
+/**
+ * 兼容 Redis 协议（RESP）的分片内存缓存
+ *
+ * 每个 io loop 拥有一个分片，分片只在自己的 loop 线程中访问，不需要加锁
+ * key 属于其它分片时，把同一批命令中发往该分片的操作打包，通过 RunInLoop 转发过去执行，
+ * 结果再打包送回连接所在的 loop
+ * 每个连接上的回复按命令顺序占位，前面的回复全部就绪以后才发送，同一批回复拼到一个 Buffer 里一次写出
+ *
+ * 支持 GET/SET [EX|PX]/DEL/EXPIRE/MGET/PING，CONFIG 和 COMMAND 返回空数组，方便 redis-benchmark 直接压测
+ * 用法：kv_cache_server [port] [threads]
+ */
+#include <TcpServer.h>
+#include <Logger.h>
+#include <Metrics.h>
+#include <StringPiece.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+namespace
+{
+
+const size_t kMaxBulkLength = 64 * 1024 * 1024;
+const int64_t kMaxArgs = 1024 * 1024;
+
+bool EqualsIgnoreCase(StringPiece a, const char *b)
+{
+    size_t len = strlen(b);
+    if (a.size() != len)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (::toupper(static_cast<unsigned char>(a[i])) != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseInt(StringPiece str, int64_t *value)
+{
+    if (str.empty() || str.size() > 18)
+    {
+        return false;
+    }
+    bool negative = str[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == str.size())
+    {
+        return false;
+    }
+    int64_t v = 0;
+    for (; i < str.size(); ++i)
+    {
+        if (str[i] < '0' || str[i] > '9')
+        {
+            return false;
+        }
+        v = v * 10 + (str[i] - '0');
+    }
+    *value = negative ? -v : v;
+    return true;
+}
+
+void AppendInteger(std::string *out, int64_t value)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, ":%lld\r\n", static_cast<long long>(value));
+    out->append(buf, n);
+}
+
+void AppendBulk(std::string *out, StringPiece value)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "$%zu\r\n", value.size());
+    out->append(buf, n);
+    out->append(value.data(), value.size());
+    out->append("\r\n", 2);
+}
+
+const char kNullBulk[] = "$-1\r\n";
+const char kOk[] = "+OK\r\n";
+
+enum ParseResult
+{
+    kParseComplete,
+    kParseNeedMore,
+    kParseError,
+};
+
+/**
+ * 从 buf->peek() + offset 开始解析一条命令，参数指向 Buffer 内部
+ * 支持 RESP 数组格式和以空格分隔的内联命令
+ */
+ParseResult ParseCommand(const Buffer *buf, size_t offset, std::vector<StringPiece> *args, size_t *consumed)
+{
+    const char *begin = buf->peek() + offset;
+    const char *end = buf->beginWrite();
+    if (begin == end)
+    {
+        return kParseNeedMore;
+    }
+
+    const char *crlf = buf->findCRLF(begin);
+    if (crlf == nullptr)
+    {
+        return end - begin > 64 * 1024 ? kParseError : kParseNeedMore;
+    }
+
+    if (*begin != '*')
+    {
+        // 内联命令
+        const char *p = begin;
+        while (p < crlf)
+        {
+            while (p < crlf && *p == ' ')
+            {
+                ++p;
+            }
+            const char *word = p;
+            while (p < crlf && *p != ' ')
+            {
+                ++p;
+            }
+            if (p > word)
+            {
+                args->push_back(StringPiece(word, p - word));
+            }
+        }
+        *consumed = crlf + 2 - begin;
+        return kParseComplete;
+    }
+
+    int64_t argc = 0;
+    if (!ParseInt(StringPiece(begin + 1, crlf - begin - 1), &argc) || argc > kMaxArgs)
+    {
+        return kParseError;
+    }
+
+    const char *p = crlf + 2;
+    for (int64_t i = 0; i < argc; ++i)
+    {
+        if (p >= end)
+        {
+            return kParseNeedMore;
+        }
+        if (*p != '$')
+        {
+            return kParseError;
+        }
+        crlf = buf->findCRLF(p);
+        if (crlf == nullptr)
+        {
+            return kParseNeedMore;
+        }
+        int64_t len = 0;
+        if (!ParseInt(StringPiece(p + 1, crlf - p - 1), &len) || len < 0 || static_cast<size_t>(len) > kMaxBulkLength)
+        {
+            return kParseError;
+        }
+        const char *data = crlf + 2;
+        if (end - data < len + 2)
+        {
+            return kParseNeedMore;
+        }
+        if (data[len] != '\r' || data[len + 1] != '\n')
+        {
+            return kParseError;
+        }
+        args->push_back(StringPiece(data, len));
+        p = data + len + 2;
+    }
+
+    *consumed = p - begin;
+    return kParseComplete;
+}
+
+enum Command
+{
+    kGet,
+    kSet,
+    kDel,
+    kExpire,
+};
+
+// 转发到其它分片执行的操作，参数需要拷贝出来
+struct Op
+{
+    Command cmd;
+    uint64_t seq;           // 所属回复的序号
+    uint32_t part;          // 在回复中的位置，MGET/DEL 的多个 key 可能分布在不同分片
+    std::string key;
+    std::string value;
+    int64_t ttl_us;
+};
+
+struct OpResult
+{
+    uint64_t seq;
+    uint32_t part;
+    std::string reply;
+};
+
+using OpList = std::vector<Op>;
+using OpResultList = std::vector<OpResult>;
+
+/**
+ * 一个分片，只在所属 loop 线程中访问
+ * 过期时间按单调时钟计算，访问时惰性删除，另外每秒清理一次已经过期的 key
+ */
+class Shard
+{
+public:
+    explicit Shard(EventLoop *loop)
+        : loop_(loop)
+    {}
+
+    EventLoop* loop() const { return loop_; }
+
+    void Apply(Command cmd, StringPiece key, StringPiece value, int64_t ttl_us, std::string *reply)
+    {
+        switch (cmd)
+        {
+        case kGet:
+            {
+                const Entry *entry = Find(key.ToString());
+                if (entry != nullptr)
+                {
+                    AppendBulk(reply, entry->value);
+                }
+                else
+                {
+                    reply->append(kNullBulk);
+                }
+            }
+            break;
+        case kSet:
+            {
+                Entry &entry = map_[key.ToString()];
+                entry.value.assign(value.data(), value.size());
+                SetExpire(key, &entry, ttl_us > 0 ? MonotonicMicros() + ttl_us : 0);
+                reply->append(kOk);
+            }
+            break;
+        case kDel:
+            {
+                std::string k = key.ToString();
+                auto it = map_.find(k);
+                if (it != map_.end())
+                {
+                    SetExpire(key, &it->second, 0);
+                    map_.erase(it);
+                    reply->append(":1\r\n");
+                }
+                else
+                {
+                    reply->append(":0\r\n");
+                }
+            }
+            break;
+        case kExpire:
+            {
+                std::string k = key.ToString();
+                Entry *entry = Find(k);
+                if (entry != nullptr)
+                {
+                    SetExpire(key, entry, MonotonicMicros() + ttl_us);
+                    reply->append(":1\r\n");
+                }
+                else
+                {
+                    reply->append(":0\r\n");
+                }
+            }
+            break;
+        }
+    }
+
+    void ExpireSweep()
+    {
+        int64_t now = MonotonicMicros();
+        while (!expires_.empty() && expires_.begin()->first <= now)
+        {
+            map_.erase(expires_.begin()->second);
+            expires_.erase(expires_.begin());
+        }
+    }
+private:
+    struct Entry
+    {
+        Entry()
+            : expire_at_us(0)
+        {}
+
+        std::string value;
+        int64_t expire_at_us;       // 0 表示不过期
+    };
+
+    Entry* Find(const std::string &key)
+    {
+        auto it = map_.find(key);
+        if (it == map_.end())
+        {
+            return nullptr;
+        }
+        if (it->second.expire_at_us != 0 && it->second.expire_at_us <= MonotonicMicros())
+        {
+            expires_.erase(std::make_pair(it->second.expire_at_us, key));
+            map_.erase(it);
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    void SetExpire(StringPiece key, Entry *entry, int64_t expire_at_us)
+    {
+        if (entry->expire_at_us == expire_at_us)
+        {
+            return;
+        }
+        if (entry->expire_at_us != 0)
+        {
+            expires_.erase(std::make_pair(entry->expire_at_us, key.ToString()));
+        }
+        entry->expire_at_us = expire_at_us;
+        if (expire_at_us != 0)
+        {
+            expires_.insert(std::make_pair(expire_at_us, key.ToString()));
+        }
+    }
+
+    EventLoop *loop_;
+    std::unordered_map<std::string, Entry> map_;
+    std::set<std::pair<int64_t, std::string>> expires_;
+};
+
+// 当前 loop 线程拥有的分片
+__thread Shard *t_shard = nullptr;
+
+// 按命令顺序排列的回复，parts 全部就绪以后才能发送
+struct ReplySlot
+{
+    ReplySlot()
+        : pending(0)
+        , sum_integers(false)
+    {}
+
+    std::string head;                   // MGET 的数组头
+    std::vector<std::string> parts;
+    int pending;
+    bool sum_integers;                  // DEL 多个 key 时把各个分片的结果加起来
+};
+
+struct Session
+{
+    Session()
+        : first_seq(0)
+        , closing(false)
+    {}
+
+    std::deque<ReplySlot> slots;        // slots[i] 对应序号 first_seq + i
+    uint64_t first_seq;
+    bool closing;
+    std::vector<StringPiece> args;      // 解析时复用
+    Buffer output;
+};
+
+using SessionPtr = std::shared_ptr<Session>;
+
+class KvServer : noncopyable
+{
+public:
+    KvServer(EventLoop *loop, const InetAddress &addr, int num_threads)
+        : server_(loop, addr, "KvServer")
+    {
+        server_.set_connection_callback(
+            std::bind(&KvServer::OnConnection, this, std::placeholders::_1)
+        );
+        server_.set_message_callback(
+            std::bind(&KvServer::OnMessage, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+        );
+        server_.set_thread_init_callback(
+            std::bind(&KvServer::OnThreadInit, this, std::placeholders::_1)
+        );
+        server_.SetThreadNum(num_threads);
+    }
+
+    // 返回之后所有分片都已经创建好，shards_ 不再改变
+    void Start()
+    {
+        server_.Start();
+        LOG_INFO("KvServer starts with %zu shards \n", shards_.size());
+    }
+private:
+    void OnThreadInit(EventLoop *loop)
+    {
+        t_shard = new Shard(loop);
+        loop->RunEvery(1.0, std::bind(&Shard::ExpireSweep, t_shard));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        shards_.push_back(std::unique_ptr<Shard>(t_shard));
+    }
+
+    Shard* ShardOf(StringPiece key) const
+    {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            h = (h ^ static_cast<unsigned char>(key[i])) * 1099511628211ULL;
+        }
+        return shards_[h % shards_.size()].get();
+    }
+
+    void OnConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->set_context(std::make_shared<Session>());
+        }
+        else
+        {
+            conn->set_context(std::shared_ptr<void>());
+        }
+    }
+
+    void OnMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        SessionPtr session = std::static_pointer_cast<Session>(conn->context());
+        if (!session || session->closing)
+        {
+            buf->retrieveAll();
+            return;
+        }
+
+        // 一次读到的命令作为一批处理，发往同一个分片的操作合并成一个任务
+        std::unordered_map<Shard*, std::shared_ptr<OpList>> remote;
+        size_t offset = 0;
+        while (true)
+        {
+            session->args.clear();
+            size_t consumed = 0;
+            ParseResult result = ParseCommand(buf, offset, &session->args, &consumed);
+            if (result == kParseNeedMore)
+            {
+                break;
+            }
+            if (result == kParseError)
+            {
+                ReplySlot &slot = NewSlot(session.get(), 1);
+                slot.parts[0] = "-ERR Protocol error\r\n";
+                slot.pending = 0;
+                session->closing = true;
+                offset = buf->readableBytes();
+                break;
+            }
+            offset += consumed;
+            if (!session->args.empty())
+            {
+                Dispatch(session.get(), session->args, &remote);
+            }
+        }
+        // 本地执行的命令已经拷贝出回复，转发的操作也拷贝了参数，可以释放输入了
+        buf->retrieve(offset);
+
+        for (auto &item : remote)
+        {
+            Shard *shard = item.first;
+            std::shared_ptr<OpList> ops = item.second;
+            shard->loop()->RunInLoop([this, shard, ops, conn]() {
+                ExecuteRemote(shard, *ops, conn);
+            });
+        }
+
+        Flush(conn, session.get());
+    }
+
+    ReplySlot& NewSlot(Session *session, size_t parts)
+    {
+        session->slots.push_back(ReplySlot());
+        ReplySlot &slot = session->slots.back();
+        slot.parts.resize(parts);
+        slot.pending = static_cast<int>(parts);
+        return slot;
+    }
+
+    // 单个 key 的操作：属于本 loop 的分片直接执行，否则放入转发列表
+    void Submit(Session *session, ReplySlot &slot, uint32_t part, Command cmd,
+                StringPiece key, StringPiece value, int64_t ttl_us,
+                std::unordered_map<Shard*, std::shared_ptr<OpList>> *remote)
+    {
+        Shard *shard = ShardOf(key);
+        if (shard == t_shard)
+        {
+            shard->Apply(cmd, key, value, ttl_us, &slot.parts[part]);
+            --slot.pending;
+            return;
+        }
+
+        std::shared_ptr<OpList> &ops = (*remote)[shard];
+        if (!ops)
+        {
+            ops = std::make_shared<OpList>();
+        }
+        Op op;
+        op.cmd = cmd;
+        op.seq = session->first_seq + session->slots.size() - 1;
+        op.part = part;
+        op.key = key.ToString();
+        op.value = value.ToString();
+        op.ttl_us = ttl_us;
+        ops->push_back(std::move(op));
+    }
+
+    void Dispatch(Session *session, const std::vector<StringPiece> &args,
+                std::unordered_map<Shard*, std::shared_ptr<OpList>> *remote)
+    {
+        StringPiece name = args[0];
+        size_t argc = args.size();
+
+        if (EqualsIgnoreCase(name, "GET") && argc == 2)
+        {
+            ReplySlot &slot = NewSlot(session, 1);
+            Submit(session, slot, 0, kGet, args[1], StringPiece(), 0, remote);
+        }
+        else if (EqualsIgnoreCase(name, "SET") && (argc == 3 || argc == 5))
+        {
+            int64_t ttl_us = 0;
+            if (argc == 5)
+            {
+                int64_t n = 0;
+                bool ok = ParseInt(args[4], &n) && n > 0;
+                if (ok && EqualsIgnoreCase(args[3], "EX"))
+                {
+                    ttl_us = n * 1000 * 1000;
+                }
+                else if (ok && EqualsIgnoreCase(args[3], "PX"))
+                {
+                    ttl_us = n * 1000;
+                }
+                else
+                {
+                    ReplyNow(session, "-ERR syntax error\r\n");
+                    return;
+                }
+            }
+            ReplySlot &slot = NewSlot(session, 1);
+            Submit(session, slot, 0, kSet, args[1], args[2], ttl_us, remote);
+        }
+        else if (EqualsIgnoreCase(name, "DEL") && argc >= 2)
+        {
+            ReplySlot &slot = NewSlot(session, argc - 1);
+            slot.sum_integers = true;
+            for (size_t i = 1; i < argc; ++i)
+            {
+                Submit(session, slot, static_cast<uint32_t>(i - 1), kDel, args[i], StringPiece(), 0, remote);
+            }
+        }
+        else if (EqualsIgnoreCase(name, "EXPIRE") && argc == 3)
+        {
+            int64_t seconds = 0;
+            if (!ParseInt(args[2], &seconds))
+            {
+                ReplyNow(session, "-ERR value is not an integer or out of range\r\n");
+                return;
+            }
+            ReplySlot &slot = NewSlot(session, 1);
+            Submit(session, slot, 0, kExpire, args[1], StringPiece(), seconds * 1000 * 1000, remote);
+        }
+        else if (EqualsIgnoreCase(name, "MGET") && argc >= 2)
+        {
+            ReplySlot &slot = NewSlot(session, argc - 1);
+            slot.head = "*" + std::to_string(argc - 1) + "\r\n";
+            for (size_t i = 1; i < argc; ++i)
+            {
+                Submit(session, slot, static_cast<uint32_t>(i - 1), kGet, args[i], StringPiece(), 0, remote);
+            }
+        }
+        else if (EqualsIgnoreCase(name, "PING"))
+        {
+            if (argc >= 2)
+            {
+                std::string reply;
+                AppendBulk(&reply, args[1]);
+                ReplyNow(session, reply);
+            }
+            else
+            {
+                ReplyNow(session, "+PONG\r\n");
+            }
+        }
+        else if (EqualsIgnoreCase(name, "CONFIG") || EqualsIgnoreCase(name, "COMMAND"))
+        {
+            ReplyNow(session, "*0\r\n");
+        }
+        else
+        {
+            ReplyNow(session, "-ERR unknown command or wrong number of arguments\r\n");
+        }
+    }
+
+    void ReplyNow(Session *session, const std::string &reply)
+    {
+        ReplySlot &slot = NewSlot(session, 1);
+        slot.parts[0] = reply;
+        slot.pending = 0;
+    }
+
+    // 在分片所在的 loop 中执行，结果打包送回连接所在的 loop
+    void ExecuteRemote(Shard *shard, const OpList &ops, const TcpConnectionPtr &conn)
+    {
+        std::shared_ptr<OpResultList> results = std::make_shared<OpResultList>(ops.size());
+        for (size_t i = 0; i < ops.size(); ++i)
+        {
+            const Op &op = ops[i];
+            OpResult &result = (*results)[i];
+            result.seq = op.seq;
+            result.part = op.part;
+            shard->Apply(op.cmd, op.key, op.value, op.ttl_us, &result.reply);
+        }
+
+        conn->QueueInOwnerLoop([this, results, conn]() {
+            Deliver(conn, *results);
+        });
+    }
+
+    // 在连接所在的 loop 中执行
+    void Deliver(const TcpConnectionPtr &conn, OpResultList &results)
+    {
+        SessionPtr session = std::static_pointer_cast<Session>(conn->context());
+        if (!session)
+        {
+            return;
+        }
+        for (OpResult &result : results)
+        {
+            ReplySlot &slot = session->slots[result.seq - session->first_seq];
+            slot.parts[result.part].swap(result.reply);
+            --slot.pending;
+        }
+        Flush(conn, session.get());
+    }
+
+    // 把已经就绪的回复按顺序拼到一个 Buffer 里，一次发送
+    void Flush(const TcpConnectionPtr &conn, Session *session)
+    {
+        Buffer &output = session->output;
+        while (!session->slots.empty() && session->slots.front().pending == 0)
+        {
+            ReplySlot &slot = session->slots.front();
+            if (slot.sum_integers)
+            {
+                int64_t total = 0;
+                for (const std::string &part : slot.parts)
+                {
+                    total += part == ":1\r\n" ? 1 : 0;
+                }
+                std::string reply;
+                AppendInteger(&reply, total);
+                output.append(reply.data(), reply.size());
+            }
+            else
+            {
+                output.append(slot.head.data(), slot.head.size());
+                for (const std::string &part : slot.parts)
+                {
+                    output.append(part.data(), part.size());
+                }
+            }
+            session->slots.pop_front();
+            ++session->first_seq;
+        }
+
+        if (output.readableBytes() > 0)
+        {
+            conn->Send(&output);
+        }
+        if (session->closing && session->slots.empty())
+        {
+            conn->Shutdown();
+        }
+    }
+
+    TcpServer server_;
+    std::mutex mutex_;                          // 只在创建分片时使用
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 6379;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+
+    EventLoop loop;
+    KvServer server(&loop, InetAddress(port), num_threads);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}
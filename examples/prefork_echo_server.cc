@@ -0,0 +1,38 @@
+#include <TcpServer.h>
+#include <Prefork.h>
+#include <Logger.h>
+
+#include <stdlib.h>
+
+/**
+ * 多进程 echo 服务器：num_workers 个 worker 进程用 SO_REUSEPORT 监听同一个端口
+ * kill -9 一个 worker 会被自动重启，kill 监督进程（SIGTERM）时所有 worker 排空连接后退出
+ */
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8004;
+    int num_workers = argc > 2 ? atoi(argv[2]) : 4;
+    int num_threads = argc > 3 ? atoi(argv[3]) : 1;
+
+    PreforkSupervisor supervisor(num_workers, [port, num_threads](PreforkWorker *worker) {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "PreforkEchoServer", TcpServer::kReusePort);
+        server.set_connection_callback([](const TcpConnectionPtr&) {});
+        server.set_message_callback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            conn->Send(buf->retrieveAllAsString());
+        });
+        server.SetThreadNum(num_threads);
+        server.Start();
+
+        worker->Attach(&loop, &server, 10.0);
+        loop.Loop();
+        return 0;
+    });
+    supervisor.set_stats_callback([&supervisor](const LoopStats &total) {
+        LOG_INFO("prefork total: connections %ld accepts %ld bytes read %ld restarts %ld \n",
+            static_cast<long>(total.connections), static_cast<long>(total.accepts),
+            static_cast<long>(total.bytes_read), static_cast<long>(supervisor.restarts()));
+    }, 2.0);
+
+    return supervisor.Run();
+}
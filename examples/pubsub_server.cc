@@ -0,0 +1,40 @@
+#include <TcpServer.h>
+#include <Broadcast.h>
+#include <Logger.h>
+
+#include <stdlib.h>
+
+// 每个连接都是订阅者，任意连接发来的一行转发给所有连接，每个 loop 只收到一个广播任务
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8002;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+
+    EventLoop loop;
+    BroadcastGroup group;
+    TcpServer server(&loop, InetAddress(port), "PubSubServer");
+    server.set_connection_callback([&group](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            group.Subscribe(conn);
+        }
+        else
+        {
+            group.Unsubscribe(conn);
+        }
+    });
+    server.set_message_callback([&group](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        const char *eol = nullptr;
+        while ((eol = buf->findEOL()) != nullptr)
+        {
+            group.Broadcast(std::make_shared<const std::string>(buf->peek(), eol + 1));
+            buf->retrieveUntil(eol + 1);
+        }
+    });
+    server.SetThreadNum(num_threads);
+    server.SetAutoCork(true);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}
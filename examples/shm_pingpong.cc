@@ -0,0 +1,105 @@
+#include <EventLoop.h>
+#include <ShmConnection.h>
+#include <Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/**
+ * 共享内存连接的吞吐测试：fork 出一个 echo 进程，父进程通过 ShmConnection 发送 num_messages 个
+ * message_size 字节的消息，保持最多 window 字节在途，收完全部回显以后输出每秒消息数和门铃次数
+ */
+int main(int argc, char *argv[])
+{
+    long num_messages = argc > 1 ? atol(argv[1]) : 1000000;
+    size_t message_size = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 64;
+    size_t ring_size = argc > 3 ? static_cast<size_t>(atol(argv[3])) : ShmConnection::kDefaultRingSize;
+
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        LOG_FATAL("socketpair error:%d \n", errno);
+    }
+
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::close(sv[0]);
+        EventLoop loop;
+        ShmConnectionPtr conn = ShmConnection::Open(&loop, "shm-echo", sv[1]);
+        if (!conn)
+        {
+            return 1;
+        }
+        conn->set_connection_callback([&loop](const ShmConnectionPtr &c) {
+            if (!c->connected())
+            {
+                loop.Quit();
+            }
+        });
+        conn->set_message_callback([](const ShmConnectionPtr &c, Buffer *buf, Timestamp) {
+            c->Send(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        });
+        conn->Start();
+        loop.Loop();
+        return 0;
+    }
+    ::close(sv[1]);
+
+    EventLoop loop;
+    ShmConnectionPtr conn = ShmConnection::Create(&loop, "shm-client", sv[0], ring_size);
+    if (!conn)
+    {
+        return 1;
+    }
+
+    const std::string message(message_size, 'x');
+    const size_t total_bytes = message_size * static_cast<size_t>(num_messages);
+    const size_t window = conn->ring_size() / 2;
+    size_t sent = 0;
+    size_t received = 0;
+    Timestamp start;
+
+    auto top_up = [&](const ShmConnectionPtr &c) {
+        while (sent < total_bytes && sent - received < window)
+        {
+            c->Send(message);
+            sent += message_size;
+        }
+    };
+    conn->set_connection_callback([&](const ShmConnectionPtr &c) {
+        if (c->connected())
+        {
+            start = Timestamp::Now();
+            top_up(c);
+        }
+        else
+        {
+            loop.Quit();
+        }
+    });
+    conn->set_message_callback([&](const ShmConnectionPtr &c, Buffer *buf, Timestamp) {
+        received += buf->readableBytes();
+        buf->retrieveAll();
+        if (received >= total_bytes)
+        {
+            double seconds = TimeDifference(Timestamp::Now(), start);
+            printf("%ld messages of %zu bytes in %.3fs: %.0f msg/s, %.1f MB/s, doorbells %lu \n",
+                num_messages, message_size, seconds, num_messages / seconds,
+                total_bytes / seconds / 1024 / 1024, static_cast<unsigned long>(c->doorbells()));
+            c->Shutdown();
+            return;
+        }
+        top_up(c);
+    });
+    conn->Start();
+    loop.Loop();
+    conn.reset();
+
+    ::waitpid(pid, nullptr, 0);
+    return 0;
+}
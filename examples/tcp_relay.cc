@@ -0,0 +1,42 @@
+#include <TcpServer.h>
+#include <TcpRelay.h>
+#include <Logger.h>
+
+#include <stdlib.h>
+
+// 把 listen_port 上的连接转发到 upstream_ip:upstream_port，数据通过 splice 搬运
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("usage: %s listen_port upstream_ip upstream_port [threads]\n", argv[0]);
+        return 1;
+    }
+    InetAddress upstream(static_cast<uint16_t>(atoi(argv[3])), argv[2]);
+    int num_threads = argc > 4 ? atoi(argv[4]) : 4;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(static_cast<uint16_t>(atoi(argv[1]))), "TcpRelay");
+    server.set_connection_callback([upstream](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            TcpRelayPtr relay = std::make_shared<TcpRelay>(conn, upstream);
+            conn->set_context(relay);
+            relay->Start();
+        }
+        else
+        {
+            TcpRelayPtr relay = std::static_pointer_cast<TcpRelay>(conn->context());
+            conn->set_context(std::shared_ptr<void>());
+            if (relay)
+            {
+                relay->Stop();
+            }
+        }
+    });
+    server.SetThreadNum(num_threads);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <UdpServer.h>
+#include <Logger.h>
+
+#include <stdlib.h>
+
+// 把整批数据报原样发回，回调返回后由 sendmmsg 一次发出
+// GRO 合并的缓冲区按原来的段长切分发回，不能作为一个大数据报发出
+void OnBatch(UdpChannel *channel, const UdpDatagram *datagrams, size_t count, Timestamp)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const UdpDatagram &datagram = datagrams[i];
+        if (datagram.segment_size != 0)
+        {
+            channel->SendSegmented(datagram.peer, datagram.data, datagram.len, datagram.segment_size);
+        }
+        else
+        {
+            channel->SendTo(datagram.peer, datagram.data, datagram.len);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9000;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+
+    EventLoop loop;
+    UdpServer server(&loop, InetAddress(port), "UdpEchoServer", UdpServer::kReusePort);
+    server.set_batch_callback(OnBatch);
+    server.SetThreadNum(num_threads);
+    server.EnableGro(true);
+    server.Start();
+    loop.Loop();
+
+    return 0;
+}